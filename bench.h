@@ -0,0 +1,567 @@
+/* ex: set ts=2 et: */
+/*
+ * Copyright 2008 Ryan Flynn
+ *
+ * www.parseerror.com
+ *
+ * One timing harness for all the "how fast is X" programs in here, instead
+ * of a copy of speed() in each one that runs everything once between two
+ * gettimeofday()s and calls that a result.
+ *
+ * Each function gets some untimed warmup runs and then a number of timed
+ * trials; we report the median, the 99th percentile and a 95% confidence
+ * interval on the mean, and the speedup of the median against the first
+ * function in the section (traditionally "***calibrate***" or "obvious").
+ *
+ * Usage:
+ *
+ *   #include "bench.h"  <- first, it wants _GNU_SOURCE
+ *
+ *   static void trial(void *arg) { ...do the thing N times... }
+ *
+ *   bench_init(2, 15);                    warmup runs, timed trials
+ *   bench_section("name", NULL);          header; resets the speedup base
+ *   bench_run("obvious", trial, &arg, 0); name, one trial, its argument,
+ *                                         units of work per trial (or 0)
+ *
+ * Anything a trial computes and then throws away is fair game for the
+ * optimizer, and it has taken advantage of that before; pass results to
+ * BENCH_USE() and memory that's written but never read to bench_escape().
+ *
+ * Environment:
+ *   BENCH_WARMUP=n       untimed runs before the trials
+ *   BENCH_TRIALS=n       timed trials
+ *   BENCH_CPU=n          pin ourselves (and threads we create later) to cpu n
+ *   BENCH_CLOCK=tsc      time with rdtsc rather than CLOCK_MONOTONIC_RAW
+ *   BENCH_FORMAT=csv     or json; machine-readable output on stdout
+ *   BENCH_PERF=1         also count cycles, instructions, branch misses and
+ *                        L1d/LLC misses per trial with perf_event_open(2)
+ *                        (Linux; counts the calling thread only, and any
+ *                        counter the CPU or kernel won't give us shows "-")
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* CLOCK_MONOTONIC_RAW, sched_setaffinity() */
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+# include <sched.h>
+# include <stdint.h>
+# include <unistd.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+# define BENCH_HAVE_PERF
+#endif
+
+#ifndef CLOCK_MONOTONIC_RAW
+# define CLOCK_MONOTONIC_RAW CLOCK_MONOTONIC
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define BENCH_HAVE_TSC
+#endif
+
+/* not every program uses every function in here */
+#ifdef __GNUC__
+# define BENCH_STATIC static __attribute__((unused))
+#else
+# define BENCH_STATIC static
+#endif
+
+/*
+ * make the compiler believe 'x' is needed, without costing anything at
+ * runtime beyond having computed it
+ */
+#ifdef __GNUC__
+# define BENCH_USE(x) __asm__ __volatile__("" : : "g"(x))
+#else
+static volatile double Bench_Sink;
+# define BENCH_USE(x) (Bench_Sink = (double)(x))
+#endif
+
+/**
+ * make the compiler believe the memory behind 'p' is read, so stores to it
+ * aren't thrown away
+ */
+BENCH_STATIC void bench_escape(const void *p)
+{
+#ifdef __GNUC__
+  __asm__ __volatile__("" : : "g"(p) : "memory");
+#else
+  Bench_Sink = (double)(size_t)p;
+#endif
+}
+
+/*
+ * hardware counters, for BENCH_PERF
+ */
+enum bench_counter {
+  BENCH_CYCLES,
+  BENCH_INSTRUCTIONS,
+  BENCH_BRANCH_MISSES,
+  BENCH_L1D_MISSES,
+  BENCH_LLC_MISSES,
+  BENCH_COUNTERS
+};
+
+static const char * const Bench_Counter_Name[BENCH_COUNTERS] = {
+  "cycles", "instr", "br-miss", "L1d-miss", "LLC-miss"
+};
+
+typedef struct {
+  const char *name;
+  unsigned trials;
+  double min,    /* all in seconds per trial */
+         median,
+         p99,
+         mean,
+         ci95,   /* +/- this around the mean */
+         speedup, /* percent, vs. the section's first result */
+         rate,   /* work per second, if the caller told us the work */
+         counter[BENCH_COUNTERS], /* per trial; < 0 if we couldn't count it */
+         ipc;    /* instructions per cycle, < 0 if unknown */
+} bench_result;
+
+enum bench_format {
+  BENCH_TABLE,
+  BENCH_CSV,
+  BENCH_JSON
+};
+
+static struct {
+  unsigned warmup,
+           trials,
+           results;      /* printed so far */
+  int tsc;
+  double tsc_hz;
+  enum bench_format format;
+  const char *section,
+             *unit;      /* of bench_result.rate */
+  double baseline;       /* median of the section's first function */
+  double *samples;
+  int perf,              /* BENCH_PERF */
+      perf_fd[BENCH_COUNTERS];
+} Bench;
+
+BENCH_STATIC double bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef BENCH_HAVE_TSC
+BENCH_STATIC unsigned long long bench_rdtsc(void)
+{
+  unsigned lo, hi;
+  __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+  return ((unsigned long long)hi << 32) | lo;
+}
+
+/**
+ * how fast does the TSC tick? count it across 50ms of the real clock
+ */
+BENCH_STATIC double bench_tsc_hz(void)
+{
+  double t0 = bench_now(),
+         t1;
+  unsigned long long c0 = bench_rdtsc(),
+                     c1;
+  while ((t1 = bench_now()) - t0 < 0.05)
+    ;
+  c1 = bench_rdtsc();
+  return (c1 - c0) / (t1 - t0);
+}
+#endif
+
+/**
+ * time one call of f(arg) in seconds
+ */
+BENCH_STATIC double bench_time(void (*f)(void *), void *arg)
+{
+#ifdef BENCH_HAVE_TSC
+  if (Bench.tsc) {
+    unsigned long long c = bench_rdtsc();
+    f(arg);
+    return (bench_rdtsc() - c) / Bench.tsc_hz;
+  }
+#endif
+  {
+    double t = bench_now();
+    f(arg);
+    return bench_now() - t;
+  }
+}
+
+#ifdef BENCH_HAVE_PERF
+/**
+ * open one counter per event for this thread, disabled; the ones we can't
+ * have get -1
+ */
+BENCH_STATIC void bench_perf_open(void)
+{
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } Event[BENCH_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES } /* i.e. LLC */
+  };
+  unsigned i,
+           opened = 0;
+  for (i = 0; i < BENCH_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = Event[i].type;
+    attr.config = Event[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    /* more counters than the PMU has get multiplexed; scale by these */
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    Bench.perf_fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    opened += Bench.perf_fd[i] >= 0;
+  }
+  if (!opened) {
+    fprintf(stderr, "BENCH_PERF: perf_event_open: %s; no counters\n", strerror(errno));
+    Bench.perf = 0;
+  }
+}
+
+BENCH_STATIC void bench_perf_ctl(unsigned long req)
+{
+  unsigned i;
+  for (i = 0; i < BENCH_COUNTERS; i++)
+    if (Bench.perf_fd[i] >= 0)
+      ioctl(Bench.perf_fd[i], req, 0);
+}
+
+/**
+ * add what each counter saw since it was last reset to 'sum'
+ */
+BENCH_STATIC void bench_perf_read(double sum[BENCH_COUNTERS])
+{
+  unsigned i;
+  for (i = 0; i < BENCH_COUNTERS; i++) {
+    uint64_t v[3]; /* value, time enabled, time running */
+    if (Bench.perf_fd[i] < 0 || sizeof v != read(Bench.perf_fd[i], v, sizeof v))
+      sum[i] = -1;
+    else if (sum[i] >= 0 && v[2])
+      sum[i] += (double)v[0] * v[1] / v[2];
+  }
+}
+
+BENCH_STATIC void bench_perf_close(void)
+{
+  unsigned i;
+  for (i = 0; i < BENCH_COUNTERS; i++)
+    if (Bench.perf_fd[i] >= 0)
+      close(Bench.perf_fd[i]);
+}
+#endif
+
+BENCH_STATIC unsigned bench_env(const char *name, unsigned dflt)
+{
+  const char *s = getenv(name);
+  return s && *s ? (unsigned)strtoul(s, NULL, 10) : dflt;
+}
+
+/**
+ * printf, but only when the output is for people; everything else goes to
+ * stderr so it doesn't get in the way of csv/json
+ */
+BENCH_STATIC void bench_note(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vfprintf(BENCH_TABLE == Bench.format ? stdout : stderr, fmt, ap);
+  va_end(ap);
+  fflush(stdout);
+}
+
+BENCH_STATIC void bench_done(void)
+{
+  if (BENCH_JSON == Bench.format)
+    printf("%s]\n", Bench.results ? "\n" : "");
+#ifdef BENCH_HAVE_PERF
+  if (Bench.perf)
+    bench_perf_close();
+#endif
+  free(Bench.samples);
+  Bench.samples = NULL;
+}
+
+/**
+ * set defaults for warmup runs and timed trials (the environment wins),
+ * pin to a cpu if asked, and start the output
+ */
+BENCH_STATIC void bench_init(unsigned warmup, unsigned trials)
+{
+  const char *s;
+  Bench.warmup = bench_env("BENCH_WARMUP", warmup);
+  Bench.trials = bench_env("BENCH_TRIALS", trials);
+  if (Bench.trials < 1)
+    Bench.trials = 1;
+  Bench.samples = malloc(Bench.trials * sizeof *Bench.samples);
+  assert(Bench.samples);
+  Bench.format = BENCH_TABLE;
+  if ((s = getenv("BENCH_FORMAT"))) {
+    if (0 == strcmp(s, "csv"))
+      Bench.format = BENCH_CSV;
+    else if (0 == strcmp(s, "json"))
+      Bench.format = BENCH_JSON;
+  }
+  if ((s = getenv("BENCH_CLOCK")) && 0 == strcmp(s, "tsc")) {
+#ifdef BENCH_HAVE_TSC
+    Bench.tsc = 1;
+    Bench.tsc_hz = bench_tsc_hz();
+#else
+    fprintf(stderr, "BENCH_CLOCK=tsc: no TSC here, using CLOCK_MONOTONIC_RAW\n");
+#endif
+  }
+  if ((s = getenv("BENCH_CPU")) && *s) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(atoi(s), &set);
+    if (0 != sched_setaffinity(0, sizeof set, &set))
+      perror("BENCH_CPU sched_setaffinity");
+#else
+    fprintf(stderr, "BENCH_CPU: can't pin on this platform\n");
+#endif
+  }
+  if (bench_env("BENCH_PERF", 0)) {
+#ifdef BENCH_HAVE_PERF
+    Bench.perf = 1;
+    bench_perf_open();
+#else
+    fprintf(stderr, "BENCH_PERF: no perf_event_open here\n");
+#endif
+  }
+  if (BENCH_CSV == Bench.format)
+    printf("section,name,trials,median,p99,mean,ci95,min,speedup,rate,unit,"
+           "cycles,instructions,ipc,branch_misses,l1d_misses,llc_misses\n");
+  else if (BENCH_JSON == Bench.format)
+    printf("[");
+  atexit(bench_done);
+}
+
+/**
+ * start a new group of results: print a header and make the next result
+ * the one everything is compared to. 'unit' names bench_result.rate, e.g.
+ * "MB/s"; NULL if there's no rate
+ */
+BENCH_STATIC void bench_section(const char *title, const char *unit)
+{
+  Bench.section = title;
+  Bench.unit = unit;
+  Bench.baseline = 0;
+  if (BENCH_TABLE == Bench.format) {
+    printf("%28s %9s %9s %9s %8s", title, "median", "p99", "+/-95%", "speedup");
+    if (unit)
+      printf(" %12s", unit);
+    if (Bench.perf) {
+      unsigned i;
+      for (i = 0; i < BENCH_COUNTERS; i++) {
+        printf(" %9s", Bench_Counter_Name[i]);
+        if (BENCH_INSTRUCTIONS == i)
+          printf(" %5s", "IPC");
+      }
+    }
+    printf("\n");
+  }
+}
+
+/**
+ * the results from here on are compared to 'r' rather than the section's
+ * first
+ */
+BENCH_STATIC void bench_baseline(const bench_result *r)
+{
+  Bench.baseline = r->median;
+}
+
+BENCH_STATIC int bench_cmp(const void *va, const void *vb)
+{
+  double a = *(const double *)va,
+         b = *(const double *)vb;
+  return (a > b) - (a < b);
+}
+
+/* two-sided 95% Student's t, by degrees of freedom; normal after 30 */
+static const double Bench_T95[] = {
+  0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/**
+ * no -lm needed, thanks
+ */
+BENCH_STATIC double bench_sqrt(double x)
+{
+  double r = x > 1 ? x : 1;
+  unsigned i;
+  if (x <= 0)
+    return 0;
+  for (i = 0; i < 64; i++)
+    r = (r + x / r) / 2;
+  return r;
+}
+
+BENCH_STATIC void bench_stats(bench_result *r, double *s, unsigned n)
+{
+  double sum = 0,
+         var = 0;
+  unsigned i;
+  qsort(s, n, sizeof *s, bench_cmp);
+  for (i = 0; i < n; i++)
+    sum += s[i];
+  r->trials = n;
+  r->mean = sum / n;
+  for (i = 0; i < n; i++)
+    var += (s[i] - r->mean) * (s[i] - r->mean);
+  r->ci95 = n > 1 ? (n <= 30 ? Bench_T95[n-1] : 1.96) * bench_sqrt(var / (n - 1) / n) : 0;
+  r->min = s[0];
+  r->median = n & 1 ? s[n/2] : (s[n/2-1] + s[n/2]) / 2;
+  r->p99 = s[(99 * n + 99) / 100 - 1];
+}
+
+/**
+ * a counter for csv/json: empty or null if we don't have it
+ */
+BENCH_STATIC void bench_print_counter(double c, const char *none)
+{
+  if (c < 0)
+    printf("%s", none);
+  else
+    printf("%.9g", c);
+}
+
+BENCH_STATIC void bench_print(const bench_result *r)
+{
+  static const char * const Json_Name[BENCH_COUNTERS] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses"
+  };
+  unsigned i;
+  switch (Bench.format) {
+  case BENCH_TABLE: /* name is already out there, see bench_run() */
+    printf("%9.4f %9.4f %9.4f %7.1f%%", r->median, r->p99, r->ci95, r->speedup);
+    if (Bench.unit)
+      printf(" %12.4g", r->rate);
+    if (Bench.perf) {
+      for (i = 0; i < BENCH_COUNTERS; i++) {
+        if (r->counter[i] < 0)
+          printf(" %9s", "-");
+        else
+          printf(" %9.3g", r->counter[i]);
+        if (BENCH_INSTRUCTIONS == i) {
+          if (r->ipc < 0)
+            printf(" %5s", "-");
+          else
+            printf(" %5.2f", r->ipc);
+        }
+      }
+    }
+    printf("\n");
+    break;
+  case BENCH_CSV:
+    printf("\"%s\",\"%s\",%u,%.9g,%.9g,%.9g,%.9g,%.9g,%.2f,%.9g,\"%s\"",
+      Bench.section ? Bench.section : "", r->name, r->trials, r->median, r->p99,
+      r->mean, r->ci95, r->min, r->speedup, r->rate, Bench.unit ? Bench.unit : "");
+    for (i = 0; i < BENCH_COUNTERS; i++) {
+      printf(",");
+      bench_print_counter(r->counter[i], "");
+      if (BENCH_INSTRUCTIONS == i) {
+        printf(",");
+        bench_print_counter(r->ipc, "");
+      }
+    }
+    printf("\n");
+    break;
+  case BENCH_JSON:
+    printf("%s\n  {\"section\": \"%s\", \"name\": \"%s\", \"trials\": %u, "
+           "\"median\": %.9g, \"p99\": %.9g, \"mean\": %.9g, \"ci95\": %.9g, "
+           "\"min\": %.9g, \"speedup\": %.2f, \"rate\": %.9g, \"unit\": \"%s\"",
+      Bench.results ? "," : "", Bench.section ? Bench.section : "", r->name,
+      r->trials, r->median, r->p99, r->mean, r->ci95, r->min, r->speedup, r->rate,
+      Bench.unit ? Bench.unit : "");
+    for (i = 0; i < BENCH_COUNTERS; i++) {
+      printf(", \"%s\": ", Json_Name[i]);
+      bench_print_counter(r->counter[i], "null");
+      if (BENCH_INSTRUCTIONS == i) {
+        printf(", \"ipc\": ");
+        bench_print_counter(r->ipc, "null");
+      }
+    }
+    printf("}");
+    break;
+  }
+  Bench.results++;
+  fflush(stdout);
+}
+
+/**
+ * run trial(arg) Bench.warmup times untimed and then Bench.trials times
+ * timed, and print the result. 'work' is how much of Bench.unit one trial
+ * does, for the rate column; 0 if none.
+ */
+BENCH_STATIC bench_result bench_run(const char *name, void (*trial)(void *), void *arg, double work)
+{
+  bench_result r;
+  unsigned i;
+  if (BENCH_TABLE == Bench.format) {
+    printf("%28s ", name); /* so there's something to look at meanwhile */
+    fflush(stdout);
+  }
+  for (i = 0; i < Bench.warmup; i++)
+    trial(arg);
+  for (i = 0; i < BENCH_COUNTERS; i++)
+    r.counter[i] = Bench.perf ? 0 : -1;
+  for (i = 0; i < Bench.trials; i++) {
+#ifdef BENCH_HAVE_PERF
+    if (Bench.perf) {
+      bench_perf_ctl(PERF_EVENT_IOC_RESET);
+      bench_perf_ctl(PERF_EVENT_IOC_ENABLE);
+      Bench.samples[i] = bench_time(trial, arg);
+      bench_perf_ctl(PERF_EVENT_IOC_DISABLE);
+      bench_perf_read(r.counter);
+      continue;
+    }
+#endif
+    Bench.samples[i] = bench_time(trial, arg);
+  }
+  for (i = 0; i < BENCH_COUNTERS; i++)
+    if (r.counter[i] > 0)
+      r.counter[i] /= Bench.trials;
+  r.ipc = r.counter[BENCH_CYCLES] > 0 && r.counter[BENCH_INSTRUCTIONS] >= 0 ?
+    r.counter[BENCH_INSTRUCTIONS] / r.counter[BENCH_CYCLES] : -1;
+  r.name = name;
+  bench_stats(&r, Bench.samples, Bench.trials);
+  if (0 == Bench.baseline)
+    Bench.baseline = r.median;
+  r.speedup = Bench.baseline / r.median * 100 - 100;
+  r.rate = work > 0 ? work / r.median : 0;
+  bench_print(&r);
+  return r;
+}
+
+#endif /* BENCH_H */
@@ -30,18 +30,85 @@
  * to avoid gratuitous 'shift'ing of 'start' as bytes are consumed; but obviously
  * care must be taken to use the correct operations
  *
+ * a mirrored buf (see buf_init_mirrored()) has its storage mapped twice in a
+ * row, so data + start .. data + start + len is always contiguous even when
+ * it wraps; the circular functions then never have to split anything
+ *
+ * BUF_DEBUG=n at compile time turns on instrumentation; the default, 0,
+ * does no I/O and touches no memory beyond what the operation itself needs
+ *   1  a tracepoint (one line on stderr) per operation
+ *   2  ...and poison: buf_init() fills with 0xFF, consumed bytes get 0xFF,
+ *      so reading stale data shows up
+ *   3  ...and dump the whole buffer at each tracepoint
+ *
  * NOTE: don't modify the internals of 'buf' unless you really know what you are
  * doing, it was hard to get right!
  *
  */
 
+#ifdef __linux__
+# define _GNU_SOURCE /* memfd_create */
+#endif
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#ifdef __linux__
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 #include "buf.h"
 #include "util.h"
 
+#ifndef BUF_DEBUG
+# define BUF_DEBUG 0
+#endif
+
+#if BUF_DEBUG >= 1
+# define BUF_TRACE(b, ...) buf_trace(__func__, __LINE__, b, __VA_ARGS__)
+#else
+# define BUF_TRACE(b, ...) ((void)0)
+#endif
+
+#if BUF_DEBUG >= 1
+#include <stdarg.h>
+static void buf_trace(const char *func, unsigned line, const buf *b, const char *fmt, ...)
+{
+  va_list ap;
+  fprintf(stderr, "%s:%u: start=%lu len=%lu buflen=%lu ",
+    func, line, (unsigned long)b->start, (unsigned long)b->len, (unsigned long)b->buflen);
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+#if BUF_DEBUG >= 3
+  fprintf(stderr, " buf=\"");
+  dump_chars((char*)b->data, b->buflen, stderr);
+  fprintf(stderr, "\"");
+#endif
+  fprintf(stderr, "\n");
+}
+#endif
+
+#if BUF_DEBUG >= 2
+/**
+ * overwrite 'len' bytes from offset 'off' on, wrapping
+ */
+static void buf_poison(buf *b, size_t off, size_t len)
+{
+  size_t contig;
+  off %= b->buflen;
+  contig = b->buflen - off;
+  if (len <= contig || b->mirrored) {
+    memset(b->data + off, 0xFF, len);
+  } else {
+    memset(b->data + off, 0xFF, contig);
+    memset(b->data, 0xFF, len - contig);
+  }
+}
+#endif
+
 void buf_init(buf *b, u8 *buf, size_t buflen)
 {
   ASSERT(buf);
@@ -50,9 +117,75 @@ void buf_init(buf *b, u8 *buf, size_t buflen)
   b->buflen = buflen;
   b->start = 0,
   b->len = 0;
+  b->mirrored = 0;
+#if BUF_DEBUG >= 2
   memset(buf, 0xFF, buflen); /* NOTE: helps us find errors in buf's implementation;
-                              * performance hit is minimal as bufs are initialized
-                              * once upon startup and only rarely thereafter */
+                              * but it faults in every page of a big buf, so
+                              * not in production */
+#endif
+  BUF_TRACE(b, "init");
+}
+
+/**
+ * allocate a buf of at least 'buflen' bytes (rounded up to whole pages)
+ * whose pages are mapped twice, back to back, so that a circular buf's
+ * data is always contiguous from buf_start() and parsers can run on it
+ * in place. release with buf_free_mirrored()
+ * @return 0 on success, -1 and errno otherwise
+ */
+int buf_init_mirrored(buf *b, size_t buflen)
+{
+#ifdef __linux__
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  u8 *p;
+  int fd,
+      err;
+  ASSERT(buflen);
+  buflen = (buflen + page - 1) / page * page;
+  if (-1 == (fd = memfd_create("buf", MFD_CLOEXEC)))
+    return -1;
+  if (-1 == ftruncate(fd, (off_t)buflen))
+    goto fail;
+  /* reserve both halves at once so nobody else can land in the second */
+  p = mmap(NULL, buflen * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == p)
+    goto fail;
+  if (MAP_FAILED == mmap(p, buflen, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0)
+   || MAP_FAILED == mmap(p + buflen, buflen, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0)) {
+    err = errno;
+    munmap(p, buflen * 2);
+    errno = err;
+    goto fail;
+  }
+  close(fd);
+  buf_init(b, p, buflen);
+  b->mirrored = 1;
+  return 0;
+fail:
+  err = errno;
+  close(fd);
+  errno = err;
+  return -1;
+#else
+  (void)b, (void)buflen;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+void buf_free_mirrored(buf *b)
+{
+#ifdef __linux__
+  ASSERT(b->mirrored);
+  munmap(b->data, b->buflen * 2);
+  b->data = NULL;
+  b->buflen = b->start = b->len = 0;
+  b->mirrored = 0;
+#else
+  (void)b;
+#endif
 }
 
 /**
@@ -82,6 +215,7 @@ size_t buf_append(buf *b, const u8 *s, size_t len)
   }
   memcpy(buf_end(b), s, len);
   b->len += len;
+  BUF_TRACE(b, "append %lu", (unsigned long)len);
   ASSERT(b->len < b->buflen);
   return len;
 }
@@ -104,13 +238,9 @@ size_t buf_append_circ(buf *b, const u8 *s, size_t len)
 #endif
   contig = buf_space_contig(b);
   endpos = b->start + b->len;
-  printf("%s:%u: len=%u contig=%u endpos=%u b->start=%u b->len=%u b->buflen=%u buf=\"",
-    __func__, __LINE__, len, contig, endpos, b->start, b->len, b->buflen);
-  dump_chars((char*)b->data, b->buflen, stdout);
-  printf("\" s=\"");
-  dump_chars((char*)s, len, stdout);
-  printf("\"\n");
-  if (len <= contig) { /* straight-forward */
+  if (endpos >= b->buflen && !b->mirrored) /* already wrapped */
+    endpos -= b->buflen;
+  if (len <= contig || b->mirrored) { /* straight-forward */
     memcpy(b->data + endpos, s, len);
   } else { /* is circular */
     memcpy(b->data + endpos, s, contig); /* to the end... */
@@ -120,9 +250,7 @@ size_t buf_append_circ(buf *b, const u8 *s, size_t len)
   b->len += len;
   ASSERT(b->len <= b->buflen);
   ASSERT(b->start < b->buflen);
-#if 0
-  printf("buf_append_circ() len=%lu\n", (unsigned long)b->len);
-#endif
+  BUF_TRACE(b, "append_circ %lu", (unsigned long)len);
   return len;
 }
 
@@ -132,7 +260,7 @@ size_t buf_append_circ(buf *b, const u8 *s, size_t len)
 size_t buf_data_contig(buf *b)
 {
   size_t contig = b->len;
-  if (b->start + b->len > b->buflen)
+  if (b->start + b->len > b->buflen && !b->mirrored)
     contig = b->buflen - b->start;
   return contig;
 }
@@ -143,7 +271,9 @@ size_t buf_data_contig(buf *b)
 size_t buf_space_contig(buf *b)
 {
   size_t contig = b->start + b->len;
-  if (contig <= b->buflen) {
+  if (b->mirrored) {
+    contig = b->buflen - b->len;
+  } else if (contig <= b->buflen) {
     contig = b->buflen - contig;
   } else { /* is circular */
     contig = b->start - (contig - b->buflen);
@@ -151,16 +281,112 @@ size_t buf_space_contig(buf *b)
   return contig;
 }
 
+/**
+ * describe our data as up to 2 iovecs, the second being the part that has
+ * wrapped around to the beginning
+ * @return number of iovecs used, 0 if empty
+ */
+int buf_data_iov(buf *b, struct iovec *iov) /* 2 of them */
+{
+  size_t contig = buf_data_contig(b);
+  int n = 0;
+  if (contig) {
+    iov[n].iov_base = b->data + b->start;
+    iov[n++].iov_len = contig;
+  }
+  if (b->len > contig) {
+    iov[n].iov_base = b->data;
+    iov[n++].iov_len = b->len - contig;
+  }
+  return n;
+}
+
+/**
+ * describe our free space as up to 2 iovecs; the space after the end and,
+ * if we haven't wrapped yet, the space before 'start'
+ * @return number of iovecs used, 0 if full
+ */
+int buf_space_iov(buf *b, struct iovec *iov) /* 2 of them */
+{
+  size_t end = b->start + b->len,
+         space = b->buflen - b->len,
+         contig;
+  int n = 0;
+  if (b->mirrored) {
+    if (space) {
+      iov[n].iov_base = b->data + end;
+      iov[n++].iov_len = space;
+    }
+    return n;
+  }
+  if (end >= b->buflen)
+    end -= b->buflen;
+  contig = b->buflen - end;
+  if (contig > space)
+    contig = space;
+  if (contig) {
+    iov[n].iov_base = b->data + end;
+    iov[n++].iov_len = contig;
+  }
+  if (space > contig) {
+    iov[n].iov_base = b->data;
+    iov[n++].iov_len = space - contig;
+  }
+  return n;
+}
+
+/**
+ * readv(2) from fd directly into all our free space, wrapping as
+ * buf_append_circ() does; saves the copy in and the buf_shift()
+ * @return readv()'s return; -1 and ENOBUFS if we're full
+ */
+ssize_t buf_readv(buf *b, int fd)
+{
+  struct iovec iov[2];
+  int n = buf_space_iov(b, iov);
+  ssize_t got;
+  if (!n) {
+    errno = ENOBUFS;
+    return -1;
+  }
+  got = readv(fd, iov, n);
+  if (got > 0)
+    buf_lengthen(b, (size_t)got);
+  return got;
+}
+
+/**
+ * writev(2) as much of our data as fd will take, both halves if wrapped,
+ * and consume what was written
+ * @return writev()'s return; 0 if we're empty
+ */
+ssize_t buf_writev(buf *b, int fd)
+{
+  struct iovec iov[2];
+  int n = buf_data_iov(b, iov);
+  ssize_t sent;
+  if (!n)
+    return 0;
+  sent = writev(fd, iov, n);
+  if (sent > 0)
+    buf_consume(b, (size_t)sent);
+  return sent;
+}
+
 /**
  * record next 'len' bytes as consumed
  */
 void buf_consume(buf *b, size_t len)
 {
   ASSERT("buf_consume() can't consume more than we have!" && len <= buf_len(b));
+#if BUF_DEBUG >= 2
+  buf_poison(b, b->start, len);
+#endif
   b->start += len;
   b->start %= b->buflen; /* wrap around */
   b->len -= len;
   ASSERT(b->start < b->buflen);
+  BUF_TRACE(b, "consume %lu", (unsigned long)len);
 }
 
 /**
@@ -175,6 +401,7 @@ void buf_lengthen(buf *b, size_t len)
     abort();
   }
   b->len += len;
+  BUF_TRACE(b, "lengthen %lu", (unsigned long)len);
 }
 
 void buf_shift(buf *b)
@@ -184,22 +411,119 @@ void buf_shift(buf *b)
 #if 0 /* i think this is the right thing to do, but not certain... */
   ASSERT(b->start + b->len <= b->buflen); /* shouldn't be called on a circular buffer... right? */
 #endif
-  /* skip empty, full or circular */
+  /* skip empty, full or circular */
   if (b->len > 0 && b->start > 0)
     memmove(b->data, b->data + b->start, b->len);
   b->start = 0;
+  BUF_TRACE(b, "shift");
 }
 
 void buf_clr(buf *b)
 {
   b->start = b->len = 0;
+  BUF_TRACE(b, "clr");
+}
+
+/************************* spsc ****/
+
+void bufspsc_init(bufspsc *q, u8 *buf, size_t buflen)
+{
+  ASSERT(buf);
+  ASSERT(buflen);
+  memset(q, 0, sizeof *q);
+  q->data = buf;
+  q->buflen = buflen;
+}
+
+/**
+ * as buf_init_mirrored(); reserve and peek never have to stop at the end
+ */
+int bufspsc_init_mirrored(bufspsc *q, size_t buflen)
+{
+  buf b;
+  if (buf_init_mirrored(&b, buflen))
+    return -1;
+  bufspsc_init(q, b.data, b.buflen);
+  q->mirrored = 1;
+  return 0;
+}
+
+void bufspsc_free_mirrored(bufspsc *q)
+{
+  buf b;
+  ASSERT(q->mirrored);
+  memset(&b, 0, sizeof b);
+  b.data = q->data;
+  b.buflen = q->buflen;
+  b.mirrored = 1;
+  buf_free_mirrored(&b);
+  q->data = NULL;
+}
+
+/**
+ * producer: point *p at contiguous free space and say how much there is;
+ * only looks at the consumer's tail if we have less than 'min' cached.
+ * may return less than 'min' (or 0), try again later
+ */
+size_t bufspsc_reserve(bufspsc *q, size_t min, u8 **p)
+{
+  size_t head = q->prod.head,
+         space = q->buflen - (head - q->prod.tail_seen),
+         at = head % q->buflen;
+  if (space < min) {
+    q->prod.tail_seen = __atomic_load_n(&q->cons.tail, __ATOMIC_ACQUIRE);
+    space = q->buflen - (head - q->prod.tail_seen);
+  }
+  if (!q->mirrored && space > q->buflen - at)
+    space = q->buflen - at;
+  *p = q->data + at;
+  return space;
+}
+
+/**
+ * producer: publish 'len' bytes written after a reserve
+ */
+void bufspsc_commit(bufspsc *q, size_t len)
+{
+  ASSERT(q->prod.head + len - q->prod.tail_seen <= q->buflen);
+  __atomic_store_n(&q->prod.head, q->prod.head + len, __ATOMIC_RELEASE);
+}
+
+/**
+ * consumer: point *p at contiguous committed data and say how much there
+ * is; same deal as bufspsc_reserve()
+ */
+size_t bufspsc_peek(bufspsc *q, size_t min, u8 **p)
+{
+  size_t tail = q->cons.tail,
+         len = q->cons.head_seen - tail,
+         at = tail % q->buflen;
+  if (len < min) {
+    q->cons.head_seen = __atomic_load_n(&q->prod.head, __ATOMIC_ACQUIRE);
+    len = q->cons.head_seen - tail;
+  }
+  if (!q->mirrored && len > q->buflen - at)
+    len = q->buflen - at;
+  *p = q->data + at;
+  return len;
+}
+
+/**
+ * consumer: hand 'len' peeked bytes back to the producer
+ */
+void bufspsc_consume(bufspsc *q, size_t len)
+{
+  ASSERT(len <= q->cons.head_seen - q->cons.tail);
+  __atomic_store_n(&q->cons.tail, q->cons.tail + len, __ATOMIC_RELEASE);
 }
 
 #ifdef TEST
 
+#include <unistd.h>
+
 static void test_append_circ(void)
 {
-  u8 data[3] = "\xFF\xFF\xFF"; /* remember that currently buf_init() overwrites with 0xFF */
+  u8 data[3] = "\xFF\xFF\xFF"; /* what buf_init() poisons with under BUF_DEBUG >= 2 */
   buf b;
   buf_init(&b, data, sizeof data);
   printf("test_append_circ: around and around we go... ");
@@ -220,13 +544,17 @@ static void test_append_circ(void)
   buf_consume(&b, 3);
   buf_append_circ(&b, (u8 *)"BCD", 3);
   assert(0 == memcmp(data, (u8 *)"DBC", 3));
+  buf_consume(&b, 2);
+  buf_append_circ(&b, (u8 *)"EF", 2); /* appending to an already wrapped buf */
+  assert(0 == memcmp(data, (u8 *)"DEF", 3));
+  assert(0 == memcmp(buf_start(&b), (u8 *)"D", 1));
   buf_append_circ(&b, (u8 *)"", 0);
   printf("OK.\n");
 }
 
 static void test_contig(void)
 {
-  u8 data[3] = "\xFF\xFF\xFF"; /* remember that currently buf_init() overwrites with 0xFF */
+  u8 data[3] = "\xFF\xFF\xFF"; /* what buf_init() poisons with under BUF_DEBUG >= 2 */
   buf b;
   buf_init(&b, data, sizeof data);
   printf("test_contig... ");
@@ -263,12 +591,359 @@ static void test_contig(void)
   printf("OK.\n");
 }
 
+static void test_readv_writev(void)
+{
+  u8 data[8],
+     out[16];
+  int fd[2];
+  buf b;
+  buf_init(&b, data, sizeof data);
+  printf("test_readv_writev... ");
+  assert(0 == pipe(fd));
+
+  assert(0 == buf_writev(&b, fd[1])); /* empty, nothing to do */
+
+  assert(5 == write(fd[1], "ABCDE", 5));
+  assert(5 == buf_readv(&b, fd[0]));
+  assert(5 == buf_len(&b));
+  assert(0 == memcmp(data, "ABCDE", 5));
+  buf_consume(&b, 4); /* leave "E" at 4 */
+
+  /* free space wraps: 3 at the end, 4 at the beginning */
+  assert(7 == write(fd[1], "FGHIJKL", 7));
+  assert(7 == buf_readv(&b, fd[0]));
+  assert(8 == buf_len(&b));
+  assert(4 == buf_data_contig(&b));
+  assert(0 == memcmp(data, "IJKLEFGH", 8));
+
+  /* full */
+  assert(1 == write(fd[1], "M", 1));
+  assert(-1 == buf_readv(&b, fd[0]));
+  assert(ENOBUFS == errno);
+
+  /* drain both halves in one go, in order */
+  assert(8 == buf_writev(&b, fd[1]));
+  assert(0 == buf_len(&b));
+  assert(9 == read(fd[0], out, sizeof out));
+  assert(0 == memcmp(out, "MEFGHIJKL", 9));
+
+  close(fd[0]);
+  close(fd[1]);
+  printf("OK.\n");
+}
+
+static void test_mirrored(void)
+{
+  u8 out[16];
+  int fd[2];
+  size_t i;
+  buf b;
+  printf("test_mirrored... ");
+  if (buf_init_mirrored(&b, 1)) {
+    perror("buf_init_mirrored");
+    exit(1);
+  }
+  assert(b.buflen >= 4096);
+  assert(b.data[0] == b.data[b.buflen]);
+  b.data[b.buflen] = 'X'; /* the second mapping is the first */
+  assert('X' == b.data[0]);
+
+  /* push start up near the end and append across it */
+  buf_lengthen(&b, b.buflen - 3);
+  buf_consume(&b, b.buflen - 3);
+  assert(b.buflen == buf_space_contig(&b)); /* all of it, no wrap */
+  buf_append_circ(&b, (u8 *)"ABCDEFG", 7);
+  assert(7 == buf_len(&b));
+  assert(7 == buf_data_contig(&b));
+  assert(0 == memcmp(buf_start(&b), "ABCDEFG", 7));
+  assert(0 == memcmp(b.data, "DEFG", 4));
+
+  /* single iovec each way, even wrapped */
+  assert(0 == pipe(fd));
+  assert(7 == buf_writev(&b, fd[1]));
+  assert(7 == read(fd[0], out, sizeof out));
+  assert(0 == memcmp(out, "ABCDEFG", 7));
+  for (i = 0; i < 5; i++)
+    assert(1 == write(fd[1], "H", 1));
+  assert(5 == buf_readv(&b, fd[0]));
+  assert(5 == buf_data_contig(&b));
+  assert(0 == memcmp(buf_start(&b), "HHHHH", 5));
+  close(fd[0]);
+  close(fd[1]);
+
+  buf_free_mirrored(&b);
+  printf("OK.\n");
+}
+
+static void test_spsc(void)
+{
+  u8 data[8],
+     *p;
+  bufspsc q;
+  bufspsc_init(&q, data, sizeof data);
+  printf("test_spsc... ");
+  assert(8 == bufspsc_reserve(&q, 1, &p));
+  assert(0 == bufspsc_peek(&q, 1, &p));
+  memcpy(p, "ABCDEF", 6);
+  bufspsc_commit(&q, 6);
+  assert(6 == bufspsc_peek(&q, 1, &p));
+  assert(0 == memcmp(p, "ABCDEF", 6));
+  bufspsc_consume(&q, 5);
+  /* cached tail says 2 free; asking for more looks again, stops at the end */
+  assert(2 == bufspsc_reserve(&q, 1, &p));
+  assert(2 == bufspsc_reserve(&q, 4, &p));
+  memcpy(p, "GH", 2);
+  bufspsc_commit(&q, 2);
+  assert(5 == bufspsc_reserve(&q, 1, &p)); /* wrapped */
+  assert(p == data);
+  memcpy(p, "IJ", 2);
+  bufspsc_commit(&q, 2);
+  assert(1 == bufspsc_peek(&q, 1, &p)); /* cached head */
+  assert(3 == bufspsc_peek(&q, 2, &p)); /* up to the end */
+  assert(0 == memcmp(p, "FGH", 3));
+  bufspsc_consume(&q, 3);
+  assert(2 == bufspsc_peek(&q, 1, &p));
+  assert(0 == memcmp(p, "IJ", 2));
+  bufspsc_consume(&q, 2);
+  assert(0 == bufspsc_peek(&q, 1, &p));
+
+  /* mirrored: no stopping at the end */
+  assert(0 == bufspsc_init_mirrored(&q, 1));
+  q.prod.head = q.prod.tail_seen = q.cons.tail = q.cons.head_seen = q.buflen - 2;
+  assert(q.buflen == bufspsc_reserve(&q, 1, &p));
+  memcpy(p, "KLMN", 4);
+  bufspsc_commit(&q, 4);
+  assert(4 == bufspsc_peek(&q, 1, &p));
+  assert(0 == memcmp(p, "KLMN", 4));
+  bufspsc_free_mirrored(&q);
+  printf("OK.\n");
+}
+
 int main(void)
 {
   test_append_circ();
   test_contig();
+  test_readv_writev();
+  test_mirrored();
+  test_spsc();
   return 0;
 }
 
 #endif
 
+#ifdef BENCH
+
+/*
+ * bytes/s of small buf_append_circ()s, and buf_init() of a big buffer;
+ * compare -DBUF_DEBUG=3 for what these used to cost
+ *
+ * bytes/s through a bufspsc between two threads pinned to different cpus,
+ * against the same thing done with a buf and a mutex
+ *
+ *   cc -O3 -pthread -DBENCH buf.c && BENCH_CPU=0 ./a.out
+ */
+
+#include "bench.h"
+#include <pthread.h>
+
+#define BENCH_BUFLEN (256 * 1024)
+#define BENCH_CHUNK  (4 * 1024)      /* producer's writes and consumer's reads */
+#define BENCH_BYTES  (256ul << 20)   /* per trial */
+
+static struct {
+  bufspsc q;
+  buf b;
+  pthread_mutex_t lock;
+  int cpu[2]; /* producer, consumer */
+  unsigned long sum;
+} Bench_Buf;
+
+#define BENCH_MSG     64           /* bytes per append */
+#define BENCH_APPENDS (1u << 20)   /* per trial */
+#define BENCH_BIGBUF  (64ul << 20) /* for buf_init() */
+
+static void append_trial(void *arg)
+{
+  static const u8 msg[BENCH_MSG];
+  buf *b = arg;
+  unsigned i;
+  for (i = 0; i < BENCH_APPENDS; i++) {
+    buf_append_circ(b, msg, sizeof msg);
+    if (buf_len(b) > buf_buflen(b) / 2)
+      buf_consume(b, buf_len(b));
+  }
+  bench_escape(b->data);
+}
+
+static void init_trial(void *arg)
+{
+  u8 *big = malloc(BENCH_BIGBUF);
+  buf b;
+  (void)arg;
+  buf_init(&b, big, BENCH_BIGBUF);
+  bench_escape(big);
+  free(big);
+}
+
+static void bench_pin(int cpu)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+#else
+  (void)cpu;
+#endif
+}
+
+/* nothing to do; with one cpu, spinning just burns the other side's slice */
+static void bench_wait(unsigned *spins)
+{
+  if (++*spins > 64) {
+    sched_yield();
+    *spins = 0;
+  }
+}
+
+static void *spsc_consumer(void *arg)
+{
+  bufspsc *q = &Bench_Buf.q;
+  unsigned long left = BENCH_BYTES,
+                sum = 0;
+  unsigned spins = 0;
+  (void)arg;
+  bench_pin(Bench_Buf.cpu[1]);
+  while (left) {
+    u8 *p;
+    size_t n = bufspsc_peek(q, BENCH_CHUNK, &p);
+    if (!n) {
+      bench_wait(&spins);
+      continue;
+    }
+    if (n > BENCH_CHUNK)
+      n = BENCH_CHUNK;
+    sum += p[0] + p[n - 1]; /* touch it */
+    bufspsc_consume(q, n);
+    left -= n;
+  }
+  Bench_Buf.sum += sum;
+  return NULL;
+}
+
+static void spsc_trial(void *arg)
+{
+  static u8 chunk[BENCH_CHUNK];
+  bufspsc *q = &Bench_Buf.q;
+  unsigned long left = BENCH_BYTES;
+  unsigned spins = 0;
+  pthread_t t;
+  (void)arg;
+  q->prod.head = q->prod.tail_seen = q->cons.tail = q->cons.head_seen = 0;
+  pthread_create(&t, NULL, spsc_consumer, NULL);
+  while (left) {
+    u8 *p;
+    size_t n = bufspsc_reserve(q, BENCH_CHUNK, &p);
+    if (!n) {
+      bench_wait(&spins);
+      continue;
+    }
+    if (n > BENCH_CHUNK)
+      n = BENCH_CHUNK;
+    if (n > left)
+      n = left;
+    memcpy(p, chunk, n);
+    bufspsc_commit(q, n);
+    left -= n;
+  }
+  pthread_join(t, NULL);
+}
+
+static void *mutex_consumer(void *arg)
+{
+  buf *b = &Bench_Buf.b;
+  unsigned long left = BENCH_BYTES,
+                sum = 0;
+  unsigned spins = 0;
+  (void)arg;
+  bench_pin(Bench_Buf.cpu[1]);
+  while (left) {
+    size_t n;
+    pthread_mutex_lock(&Bench_Buf.lock);
+    n = buf_data_contig(b);
+    if (n > BENCH_CHUNK)
+      n = BENCH_CHUNK;
+    if (n) {
+      sum += buf_start(b)[0] + buf_start(b)[n - 1];
+      buf_consume(b, n);
+    }
+    pthread_mutex_unlock(&Bench_Buf.lock);
+    if (!n)
+      bench_wait(&spins);
+    left -= n;
+  }
+  Bench_Buf.sum += sum;
+  return NULL;
+}
+
+static void mutex_trial(void *arg)
+{
+  static u8 chunk[BENCH_CHUNK];
+  buf *b = &Bench_Buf.b;
+  unsigned long left = BENCH_BYTES;
+  unsigned spins = 0;
+  pthread_t t;
+  (void)arg;
+  buf_clr(b);
+  pthread_create(&t, NULL, mutex_consumer, NULL);
+  while (left) {
+    struct iovec iov[2];
+    size_t n = 0;
+    pthread_mutex_lock(&Bench_Buf.lock);
+    if (buf_space_iov(b, iov)) {
+      n = iov[0].iov_len;
+      if (n > BENCH_CHUNK)
+        n = BENCH_CHUNK;
+      if (n > left)
+        n = left;
+      memcpy(iov[0].iov_base, chunk, n);
+      buf_lengthen(b, n);
+    }
+    pthread_mutex_unlock(&Bench_Buf.lock);
+    if (!n)
+      bench_wait(&spins);
+    left -= n;
+  }
+  pthread_join(t, NULL);
+}
+
+int main(void)
+{
+  static u8 data[BENCH_BUFLEN];
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  bench_init(1, 5);
+  bench_note("BUF_DEBUG=%d\n", BUF_DEBUG);
+  buf_init(&Bench_Buf.b, data, sizeof data);
+  bench_section("append_circ", "bytes/s");
+  bench_run("64 bytes", append_trial, &Bench_Buf.b, (double)BENCH_MSG * BENCH_APPENDS);
+  bench_section("buf_init", "bytes/s");
+  bench_run("64 MB", init_trial, NULL, BENCH_BIGBUF);
+  Bench_Buf.cpu[0] = 0;
+  Bench_Buf.cpu[1] = ncpu > 1;
+  bench_note("producer on cpu %d, consumer on cpu %d, %lu MB per trial\n",
+    Bench_Buf.cpu[0], Bench_Buf.cpu[1], BENCH_BYTES >> 20);
+  bench_pin(Bench_Buf.cpu[0]);
+  buf_init(&Bench_Buf.b, data, sizeof data);
+  pthread_mutex_init(&Bench_Buf.lock, NULL);
+  bench_section("handoff", "bytes/s");
+  bench_run("buf+mutex", mutex_trial, NULL, BENCH_BYTES);
+  bufspsc_init(&Bench_Buf.q, data, sizeof data);
+  bench_run("bufspsc", spsc_trial, NULL, BENCH_BYTES);
+  if (0 == bufspsc_init_mirrored(&Bench_Buf.q, BENCH_BUFLEN)) {
+    bench_run("bufspsc mirrored", spsc_trial, NULL, BENCH_BYTES);
+    bufspsc_free_mirrored(&Bench_Buf.q);
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* ex: set ff=dos ts=2 et: */
+/* $Id$ */
+/*
+ * Copyright 2008 Ryan Flynn
+ * All rights reserved.
+ */
+/*
+ * buf: a fixed-size byte buffer, optionally managed circularly;
+ * see buf.c for the model
+ */
+
+#ifndef BUF_H
+#define BUF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef unsigned char u8;
+
+typedef struct {
+  u8 *data;
+  size_t buflen, /* bytes available at data */
+         start,  /* offset of our first byte */
+         len;    /* bytes stored after start, possibly wrapping past buflen */
+  int mirrored;  /* data is mapped twice, back to back; see buf_init_mirrored() */
+} buf;
+
+struct iovec;
+
+/*
+ * bufspsc: a circular buf shared by exactly one producer thread and one
+ * consumer thread, without a lock. head and tail count bytes ever committed
+ * and consumed; each side keeps a stale copy of the other's index on its own
+ * cache line and only goes back to the shared one when the copy says it's
+ * out of room/data
+ */
+#define BUF_CACHELINE 64
+
+typedef struct {
+  u8 *data;
+  size_t buflen;
+  int mirrored;
+  struct {
+    size_t head,      /* written by the producer only */
+           tail_seen; /* producer's copy of cons.tail */
+  } prod __attribute__((aligned(BUF_CACHELINE)));
+  struct {
+    size_t tail,      /* written by the consumer only */
+           head_seen; /* consumer's copy of prod.head */
+  } cons __attribute__((aligned(BUF_CACHELINE)));
+} bufspsc;
+
+#define buf_data(b)   ((b)->data)
+#define buf_buflen(b) ((b)->buflen)
+#define buf_len(b)    ((b)->len)
+#define buf_start(b)  ((b)->data + (b)->start)
+#define buf_end(b)    (buf_start(b) + (b)->len)
+/* room after the end; only meaningful for a non-circular buf */
+#define buf_space(b)  ((b)->buflen - ((b)->start + (b)->len))
+
+void   buf_init(buf *, u8 *, size_t buflen);
+int    buf_init_mirrored(buf *, size_t buflen);
+void   buf_free_mirrored(buf *);
+size_t buf_after(const buf *, const u8 *);
+size_t buf_append(buf *, const u8 *, size_t);
+size_t buf_append_circ(buf *, const u8 *, size_t);
+size_t buf_data_contig(buf *);
+size_t buf_space_contig(buf *);
+int    buf_data_iov(buf *, struct iovec *); /* 2 of them */
+int    buf_space_iov(buf *, struct iovec *); /* 2 of them */
+ssize_t buf_readv(buf *, int fd);
+ssize_t buf_writev(buf *, int fd);
+void   buf_consume(buf *, size_t);
+void   buf_lengthen(buf *, size_t);
+void   buf_shift(buf *);
+void   buf_clr(buf *);
+
+void   bufspsc_init(bufspsc *, u8 *, size_t buflen);
+int    bufspsc_init_mirrored(bufspsc *, size_t buflen);
+void   bufspsc_free_mirrored(bufspsc *);
+size_t bufspsc_reserve(bufspsc *, size_t min, u8 **);
+void   bufspsc_commit(bufspsc *, size_t);
+size_t bufspsc_peek(bufspsc *, size_t min, u8 **);
+void   bufspsc_consume(bufspsc *, size_t);
+
+#endif
+
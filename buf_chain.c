@@ -0,0 +1,370 @@
+/* ex: set ff=dos ts=2 et: */
+/* $Id$ */
+/*
+ * Copyright 2008 Ryan Flynn
+ * All rights reserved.
+ */
+/*
+ * a buf_chain is a queue of bytes with no fixed limit, for when a single buf
+ * would have to be sized for the worst burst:
+ *
+ *   head                                  tail
+ *    |                                     |
+ *   [ seg: ..start####len ] -> [ ###### ] -> [ ###.......... ]
+ *
+ * appends go to the tail segment, taking a new one from the pool when it's
+ * full; consumes come off the head segment, which goes back to the pool as
+ * soon as it's drained. segments are plain bufs used non-circularly.
+ *
+ * the pool carves segments out of slabs of 'perslab' at a time and keeps a
+ * free list; buf_pool_trim() gives slabs with nothing in use back to malloc,
+ * so that after a burst resident memory follows the backlog back down.
+ *
+ * test:
+ *   cc -c buf.c && cc -DTEST buf_chain.c buf.o
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "buf_chain.h"
+#include "util.h"
+
+#define BUF_SEG_ALIGN 16
+#define BUF_ROUND(n)  (((n) + BUF_SEG_ALIGN - 1) & ~(size_t)(BUF_SEG_ALIGN - 1))
+#define BUF_SLAB_HDR  BUF_ROUND(sizeof(buf_slab)) /* segments start here */
+
+void buf_pool_init(buf_pool *p, size_t seglen, size_t perslab)
+{
+  ASSERT(seglen);
+  ASSERT(perslab);
+  memset(p, 0, sizeof *p);
+  p->seglen = seglen;
+  p->segsize = BUF_ROUND(sizeof(buf_seg) + seglen);
+  p->perslab = perslab;
+}
+
+/**
+ * release every slab; every chain using the pool must be gone already
+ */
+void buf_pool_free(buf_pool *p)
+{
+  while (p->slabs) {
+    buf_slab *next = p->slabs->next;
+    ASSERT(0 == p->slabs->inuse);
+    free(p->slabs);
+    p->slabs = next;
+  }
+  p->free = NULL;
+  p->nslabs = p->nfree = 0;
+}
+
+static int pool_grow(buf_pool *p)
+{
+  buf_slab *s = malloc(BUF_SLAB_HDR + p->perslab * p->segsize);
+  u8 *seg;
+  size_t i;
+  if (!s)
+    return -1;
+  s->inuse = 0;
+  s->next = p->slabs;
+  p->slabs = s;
+  p->nslabs++;
+  seg = (u8 *)s + BUF_SLAB_HDR;
+  for (i = 0; i < p->perslab; i++, seg += p->segsize) {
+    buf_seg *g = (buf_seg *)seg;
+    g->slab = s;
+    g->next = p->free;
+    p->free = g;
+  }
+  p->nfree += p->perslab;
+  return 0;
+}
+
+static buf_seg * pool_get(buf_pool *p)
+{
+  buf_seg *g;
+  if (!p->free && pool_grow(p))
+    return NULL;
+  g = p->free;
+  p->free = g->next;
+  p->nfree--;
+  g->slab->inuse++;
+  g->next = NULL;
+  buf_init(&g->b, (u8 *)(g + 1), p->seglen);
+  return g;
+}
+
+static void pool_put(buf_pool *p, buf_seg *g)
+{
+  g->slab->inuse--;
+  g->next = p->free;
+  p->free = g;
+  p->nfree++;
+}
+
+/**
+ * free slabs none of whose segments are in use
+ * @return bytes given back
+ */
+size_t buf_pool_trim(buf_pool *p)
+{
+  buf_seg **g = &p->free;
+  buf_slab **s = &p->slabs;
+  size_t freed = 0;
+  /* pull the idle slabs' segments off the free list first */
+  while (*g) {
+    if (0 == (*g)->slab->inuse) {
+      *g = (*g)->next;
+      p->nfree--;
+    } else {
+      g = &(*g)->next;
+    }
+  }
+  while (*s) {
+    if (0 == (*s)->inuse) {
+      buf_slab *idle = *s;
+      *s = idle->next;
+      free(idle);
+      p->nslabs--;
+      freed += p->perslab * p->segsize;
+    } else {
+      s = &(*s)->next;
+    }
+  }
+  return freed;
+}
+
+void buf_chain_init(buf_chain *c, buf_pool *p)
+{
+  c->pool = p;
+  c->head = c->tail = NULL;
+  c->len = 0;
+}
+
+/**
+ * give all our segments back
+ */
+void buf_chain_free(buf_chain *c)
+{
+  while (c->head) {
+    buf_seg *next = c->head->next;
+    pool_put(c->pool, c->head);
+    c->head = next;
+  }
+  c->tail = NULL;
+  c->len = 0;
+}
+
+/**
+ * copy 'len' bytes onto the end, adding segments as needed
+ * @return bytes appended; less than 'len' only if we couldn't get memory
+ */
+size_t buf_chain_append(buf_chain *c, const u8 *s, size_t len)
+{
+  size_t done = 0;
+  while (done < len) {
+    size_t n;
+    if (!c->tail || !buf_space(&c->tail->b)) {
+      buf_seg *g = pool_get(c->pool);
+      if (!g)
+        break;
+      if (c->tail)
+        c->tail->next = g;
+      else
+        c->head = g;
+      c->tail = g;
+    }
+    n = buf_space(&c->tail->b);
+    if (n > len - done)
+      n = len - done;
+    memcpy(buf_end(&c->tail->b), s + done, n);
+    buf_lengthen(&c->tail->b, n);
+    done += n;
+  }
+  c->len += done;
+  return done;
+}
+
+/**
+ * point *p at the first contiguous run of bytes, without consuming
+ * @return its length, 0 if empty
+ */
+size_t buf_chain_peek(const buf_chain *c, const u8 **p)
+{
+  if (!c->len)
+    return 0;
+  *p = buf_start(&c->head->b);
+  return buf_len(&c->head->b);
+}
+
+/**
+ * copy up to 'len' bytes from the front into dst, across segments, without
+ * consuming
+ * @return bytes copied
+ */
+size_t buf_chain_copy(const buf_chain *c, u8 *dst, size_t len)
+{
+  const buf_seg *g;
+  size_t done = 0;
+  for (g = c->head; g && done < len; g = g->next) {
+    size_t n = buf_len(&g->b);
+    if (n > len - done)
+      n = len - done;
+    memcpy(dst + done, buf_start(&g->b), n);
+    done += n;
+  }
+  return done;
+}
+
+/**
+ * drop 'len' bytes from the front; drained segments go back to the pool
+ */
+void buf_chain_consume(buf_chain *c, size_t len)
+{
+  ASSERT("buf_chain_consume() can't consume more than we have!" && len <= c->len);
+  c->len -= len;
+  while (len) {
+    buf_seg *g = c->head;
+    size_t n = buf_len(&g->b);
+    if (n > len)
+      n = len;
+    buf_consume(&g->b, n);
+    len -= n;
+    if (!buf_len(&g->b)) {
+      c->head = g->next;
+      if (!c->head)
+        c->tail = NULL;
+      pool_put(c->pool, g);
+    }
+  }
+}
+
+/**
+ * describe up to 'max' segments' worth of data as iovecs, in order
+ * @return number used
+ */
+int buf_chain_iov(const buf_chain *c, struct iovec *iov, int max)
+{
+  const buf_seg *g;
+  int n = 0;
+  for (g = c->head; g && n < max; g = g->next) {
+    if (!buf_len(&g->b))
+      continue;
+    iov[n].iov_base = buf_start(&g->b);
+    iov[n++].iov_len = buf_len(&g->b);
+  }
+  return n;
+}
+
+/**
+ * writev(2) as much as fd will take, up to 64 segments at a time, and
+ * consume what was written
+ * @return writev()'s return; 0 if we're empty
+ */
+ssize_t buf_chain_writev(buf_chain *c, int fd)
+{
+  struct iovec iov[64];
+  int n = buf_chain_iov(c, iov, (int)(sizeof iov / sizeof iov[0]));
+  ssize_t sent;
+  if (!n)
+    return 0;
+  sent = writev(fd, iov, n);
+  if (sent > 0)
+    buf_chain_consume(c, (size_t)sent);
+  return sent;
+}
+
+#ifdef TEST
+
+#include <stdio.h>
+#include <unistd.h>
+
+static void test_chain(void)
+{
+  static const u8 Alpha[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  u8 out[64];
+  const u8 *p;
+  buf_pool pool;
+  buf_chain c;
+  printf("test_chain... ");
+  buf_pool_init(&pool, 4, 2);
+  buf_chain_init(&c, &pool);
+
+  assert(0 == buf_chain_peek(&c, &p));
+  assert(26 == buf_chain_append(&c, Alpha, 26));
+  assert(26 == buf_chain_len(&c));
+  assert(4 == pool.nslabs); /* 7 segments, 2 per slab */
+  assert(1 == pool.nfree);
+  assert(4 == buf_chain_peek(&c, &p));
+  assert(0 == memcmp(p, "ABCD", 4));
+  assert(26 == buf_chain_copy(&c, out, sizeof out));
+  assert(0 == memcmp(out, Alpha, 26));
+
+  buf_chain_consume(&c, 6); /* first segment back, second half gone */
+  assert(20 == buf_chain_len(&c));
+  assert(2 == pool.nfree);
+  assert(2 == buf_chain_peek(&c, &p));
+  assert(0 == memcmp(p, "GH", 2));
+  assert(5 == buf_chain_copy(&c, out, 5));
+  assert(0 == memcmp(out, "GHIJK", 5));
+
+  /* nothing idle yet: both free segments share a slab with a used one */
+  assert(0 == buf_pool_trim(&pool));
+  assert(4 == pool.nslabs && 2 == pool.nfree);
+
+  buf_chain_consume(&c, 20); /* everything back */
+  assert(0 == buf_chain_len(&c));
+  assert(NULL == c.head && NULL == c.tail);
+  assert(8 == pool.nfree);
+  assert(4 * 2 * pool.segsize == buf_pool_trim(&pool));
+  assert(0 == pool.nslabs && 0 == pool.nfree);
+
+  /* and it still works after */
+  assert(3 == buf_chain_append(&c, (u8 *)"xyz", 3));
+  buf_chain_consume(&c, 1);
+  assert(2 == buf_chain_copy(&c, out, sizeof out));
+  assert(0 == memcmp(out, "yz", 2));
+  buf_chain_free(&c);
+  buf_pool_free(&pool);
+  printf("OK.\n");
+}
+
+static void test_chain_writev(void)
+{
+  u8 in[1000],
+     out[1000];
+  buf_pool pool;
+  buf_chain c;
+  int fd[2];
+  size_t i;
+  printf("test_chain_writev... ");
+  for (i = 0; i < sizeof in; i++)
+    in[i] = (u8)(i * 7);
+  buf_pool_init(&pool, 100, 4);
+  buf_chain_init(&c, &pool);
+  assert(0 == pipe(fd));
+  assert(0 == buf_chain_writev(&c, fd[1]));
+  assert(sizeof in == buf_chain_append(&c, in, sizeof in));
+  buf_chain_consume(&c, 50);
+  assert(sizeof in - 50 == (size_t)buf_chain_writev(&c, fd[1]));
+  assert(0 == buf_chain_len(&c));
+  assert(sizeof in - 50 == (size_t)read(fd[0], out, sizeof out));
+  assert(0 == memcmp(out, in + 50, sizeof in - 50));
+  close(fd[0]);
+  close(fd[1]);
+  buf_chain_free(&c);
+  buf_pool_free(&pool);
+  printf("OK.\n");
+}
+
+int main(void)
+{
+  test_chain();
+  test_chain_writev();
+  return 0;
+}
+
+#endif
+
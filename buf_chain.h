@@ -0,0 +1,65 @@
+/* ex: set ff=dos ts=2 et: */
+/* $Id$ */
+/*
+ * Copyright 2008 Ryan Flynn
+ * All rights reserved.
+ */
+/*
+ * buf_chain: a growable queue of bytes made of fixed-size buf segments
+ * drawn from a shared buf_pool; see buf_chain.c
+ */
+
+#ifndef BUF_CHAIN_H
+#define BUF_CHAIN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "buf.h"
+
+typedef struct buf_seg {
+  struct buf_seg *next;
+  struct buf_slab *slab; /* where we were carved from */
+  buf b;                 /* over the bytes right after us */
+} buf_seg;
+
+typedef struct buf_slab {
+  struct buf_slab *next;
+  size_t inuse;          /* segments handed out */
+} buf_slab;
+
+typedef struct {
+  size_t seglen,         /* bytes of data per segment */
+         segsize,        /* ...plus header, rounded */
+         perslab;        /* segments per slab */
+  buf_seg *free;
+  buf_slab *slabs;
+  size_t nslabs,
+         nfree;
+} buf_pool;
+
+typedef struct {
+  buf_pool *pool;
+  buf_seg *head,         /* consume from here */
+          *tail;         /* append here */
+  size_t len;
+} buf_chain;
+
+struct iovec;
+
+#define buf_chain_len(c) ((c)->len)
+
+void   buf_pool_init(buf_pool *, size_t seglen, size_t perslab);
+void   buf_pool_free(buf_pool *);
+size_t buf_pool_trim(buf_pool *);
+
+void   buf_chain_init(buf_chain *, buf_pool *);
+void   buf_chain_free(buf_chain *);
+size_t buf_chain_append(buf_chain *, const u8 *, size_t);
+size_t buf_chain_peek(const buf_chain *, const u8 **);
+size_t buf_chain_copy(const buf_chain *, u8 *, size_t);
+void   buf_chain_consume(buf_chain *, size_t);
+int    buf_chain_iov(const buf_chain *, struct iovec *, int max);
+ssize_t buf_chain_writev(buf_chain *, int fd);
+
+#endif
+
@@ -0,0 +1,406 @@
+/* ex: set ff=dos ts=2 et: */
+/* $Id$ */
+/*
+ * Copyright 2008 Ryan Flynn
+ * All rights reserved.
+ */
+/*
+ * framing: everybody who reads from a buf ends up writing "is there a whole
+ * message in here yet?"; these answer it for the usual two kinds of protocol
+ * and hand back a buf_view of the message where it sits, even if it wraps:
+ *
+ *   buf_frame_delim()   messages ending in a 1 or 2 byte delimiter, e.g. \r\n
+ *   buf_frame_u32()     a big-endian 32-bit length, then that many bytes
+ *   buf_frame_varint()  a LEB128 (protobuf-style) length, then that many bytes
+ *
+ * each returns the number of bytes the whole frame takes, which is what to
+ * buf_frame_consume() when you're done with the view, or 0 if the frame
+ * isn't all there yet.
+ *
+ * the delimiter scan remembers how far it got, so when a long message
+ * trickles in we only look at the new bytes; it searches for the last byte
+ * of the delimiter 16 or 32 bytes at a time with SSE2/AVX2 where we have them
+ * and checks the byte before by hand.
+ *
+ * test:
+ *   cc -c buf.c && cc -DTEST buf_frame.c buf.o
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include "buf_frame.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(WIN32)
+# define CAN_SIMD
+#endif
+
+/**
+ * offset of the first 'c' in p[0..len), len if there isn't one
+ */
+static size_t scan_obvious(const u8 *p, size_t len, u8 c)
+{
+  size_t i = 0;
+  while (i < len && p[i] != c)
+    i++;
+  return i;
+}
+
+#ifdef CAN_SIMD
+
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static size_t scan_sse2(const u8 *p, size_t len, u8 c)
+{
+  const __m128i needle = _mm_set1_epi8((char)c);
+  size_t i;
+  for (i = 0; i + 16 <= len; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, needle));
+    if (m)
+      return i + (unsigned)__builtin_ctz(m);
+  }
+  return i + scan_obvious(p + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const u8 *p, size_t len, u8 c)
+{
+  const __m256i needle = _mm256_set1_epi8((char)c);
+  size_t i;
+  for (i = 0; i + 32 <= len; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+    unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle));
+    if (m)
+      return i + (unsigned)__builtin_ctz(m);
+  }
+  return i + scan_obvious(p + i, len - i, c);
+}
+
+#endif /* CAN_SIMD */
+
+static size_t (*Scan)(const u8 *, size_t, u8) = scan_obvious;
+
+static void scan_init(void)
+{
+#ifdef CAN_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    Scan = scan_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    Scan = scan_sse2;
+#endif
+}
+
+/**
+ * where the byte 'off' bytes after start lives, and how many of the bytes
+ * from there up to 'len' are contiguous with it
+ */
+static const u8 * buf_at(const buf *b, size_t off, size_t *contig)
+{
+  size_t pos = b->start + off;
+  *contig = b->len - off;
+  if (b->mirrored)
+    return b->data + pos;
+  if (pos >= b->buflen)
+    return b->data + pos - b->buflen;
+  if (*contig > b->buflen - pos)
+    *contig = b->buflen - pos;
+  return b->data + pos;
+}
+
+static u8 byte_at(const buf *b, size_t off)
+{
+  size_t contig;
+  return *buf_at(b, off, &contig);
+}
+
+static void view_at(const buf *b, size_t off, size_t len, buf_view *v)
+{
+  size_t contig;
+  v->p[0] = buf_at(b, off, &contig);
+  if (len <= contig) {
+    v->len[0] = len;
+    v->p[1] = NULL;
+    v->len[1] = 0;
+  } else {
+    v->len[0] = contig;
+    v->p[1] = b->data;
+    v->len[1] = len - contig;
+  }
+}
+
+void buf_frame_init(buf_frame *f, const char *delim, size_t dlen)
+{
+  ASSERT(1 == dlen || 2 == dlen);
+  if (Scan == scan_obvious)
+    scan_init();
+  memcpy(f->delim, delim, dlen);
+  f->dlen = dlen;
+  f->scanned = 0;
+}
+
+/**
+ * forget how far we've scanned; needed if you consume from the buf other
+ * than with buf_frame_consume()
+ */
+void buf_frame_reset(buf_frame *f)
+{
+  f->scanned = 0;
+}
+
+/**
+ * look for the delimiter in the bytes we haven't already looked at
+ * @return length of the frame including the delimiter, which *v covers
+ *         without it; 0 if there's no delimiter yet
+ */
+size_t buf_frame_delim(buf_frame *f, const buf *b, buf_view *v)
+{
+  const u8 last = f->delim[f->dlen - 1];
+  size_t off = f->scanned;
+  while (off < buf_len(b)) {
+    size_t contig,
+           i;
+    const u8 *p = buf_at(b, off, &contig);
+    i = Scan(p, contig, last);
+    off += i;
+    if (i == contig)
+      continue;
+    if (1 == f->dlen || (off && f->delim[0] == byte_at(b, off - 1))) {
+      f->scanned = off; /* so asking again finds it again straight away */
+      view_at(b, 0, off + 1 - f->dlen, v);
+      return off + 1;
+    }
+    off++; /* a lone last byte, e.g. \n without \r */
+  }
+  f->scanned = off;
+  return 0;
+}
+
+/**
+ * a frame with a 4-byte big-endian length before the payload
+ * @return length of the whole frame, *v covering the payload; 0 if it isn't
+ *         all here yet; -1 and EMSGSIZE if the length is over 'max'
+ */
+ssize_t buf_frame_u32(const buf *b, buf_view *v, uint32_t max)
+{
+  uint32_t n = 0;
+  size_t i;
+  if (buf_len(b) < 4)
+    return 0;
+  for (i = 0; i < 4; i++)
+    n = n << 8 | byte_at(b, i);
+  if (n > max) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (buf_len(b) - 4 < n)
+    return 0;
+  view_at(b, 4, n, v);
+  return (ssize_t)(4 + n);
+}
+
+/**
+ * a frame with a LEB128 length before the payload: 7 bits per byte, least
+ * significant first, high bit set on all but the last
+ * @return as buf_frame_u32(); -1 and EBADMSG for a length over 64 bits
+ */
+ssize_t buf_frame_varint(const buf *b, buf_view *v, uint64_t max)
+{
+  uint64_t n = 0;
+  size_t i = 0;
+  u8 c;
+  do {
+    if (i == buf_len(b))
+      return 0;
+    if (i == 10) {
+      errno = EBADMSG;
+      return -1;
+    }
+    c = byte_at(b, i);
+    if (9 == i && c > 1) { /* only 1 bit left */
+      errno = EBADMSG;
+      return -1;
+    }
+    n |= (uint64_t)(c & 0x7F) << (7 * i);
+    i++;
+  } while (c & 0x80);
+  if (n > max || n > (uint64_t)(SSIZE_MAX - i)) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (buf_len(b) - i < n)
+    return 0;
+  view_at(b, i, (size_t)n, v);
+  return (ssize_t)(i + n);
+}
+
+/**
+ * done with a frame: consume it and start scanning after it
+ */
+void buf_frame_consume(buf_frame *f, buf *b, size_t len)
+{
+  buf_consume(b, len);
+  if (f)
+    f->scanned = 0;
+}
+
+/**
+ * for when you do want it contiguous
+ * @return bytes copied, at most 'len'
+ */
+size_t buf_view_copy(const buf_view *v, u8 *dst, size_t len)
+{
+  size_t n0 = v->len[0] < len ? v->len[0] : len,
+         n1 = v->len[1] < len - n0 ? v->len[1] : len - n0;
+  memcpy(dst, v->p[0], n0);
+  if (n1)
+    memcpy(dst + n0, v->p[1], n1);
+  return n0 + n1;
+}
+
+#ifdef TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void test_scan(void)
+{
+  static size_t (* const F[])(const u8 *, size_t, u8) = {
+    scan_obvious,
+#ifdef CAN_SIMD
+    scan_sse2,
+    scan_avx2,
+#endif
+  };
+  u8 s[200];
+  size_t f,
+         len,
+         at;
+  printf("test_scan... ");
+  scan_init();
+  for (f = 0; f < sizeof F / sizeof F[0]; f++) {
+#ifdef CAN_SIMD
+    if (scan_avx2 == F[f] && !__builtin_cpu_supports("avx2"))
+      continue;
+#endif
+    for (len = 0; len <= sizeof s; len++) {
+      for (at = 0; at <= len; at++) {
+        memset(s, 'x', sizeof s);
+        if (at < len)
+          s[at] = '\n';
+        assert(at == F[f](s, len, '\n'));
+      }
+    }
+  }
+  printf("OK.\n");
+}
+
+/* put 's' in a fresh buf of 'size' so that it starts at 'start' */
+static void fill(buf *b, u8 *data, size_t size, size_t start, const char *s)
+{
+  buf_init(b, data, size);
+  buf_lengthen(b, start);
+  buf_consume(b, start);
+  buf_append_circ(b, (const u8 *)s, strlen(s));
+}
+
+static void test_delim(void)
+{
+  u8 data[16],
+     out[16];
+  buf b;
+  buf_frame f;
+  buf_view v;
+  size_t start;
+  printf("test_delim... ");
+  buf_frame_init(&f, "\r\n", 2);
+
+  /* every rotation, so the \r\n and the message straddle the end every way */
+  for (start = 0; start < sizeof data; start++) {
+    fill(&b, data, sizeof data, start, "AB\nC\r\nDEF\r\n");
+    buf_frame_reset(&f);
+    assert(6 == buf_frame_delim(&f, &b, &v));
+    assert(4 == buf_view_len(&v));
+    assert(4 == buf_view_copy(&v, out, sizeof out));
+    assert(0 == memcmp(out, "AB\nC", 4));
+    assert(6 == buf_frame_delim(&f, &b, &v)); /* not consumed, same answer */
+    buf_frame_consume(&f, &b, 6);
+    assert(5 == buf_frame_delim(&f, &b, &v));
+    assert(3 == buf_view_copy(&v, out, sizeof out));
+    assert(0 == memcmp(out, "DEF", 3));
+    buf_frame_consume(&f, &b, 5);
+    assert(0 == buf_frame_delim(&f, &b, &v));
+  }
+
+  /* trickling in: only new bytes are scanned */
+  fill(&b, data, sizeof data, 14, "hel");
+  buf_frame_reset(&f);
+  assert(0 == buf_frame_delim(&f, &b, &v));
+  assert(3 == f.scanned);
+  buf_append_circ(&b, (const u8 *)"lo\r", 3);
+  assert(0 == buf_frame_delim(&f, &b, &v));
+  assert(6 == f.scanned);
+  buf_append_circ(&b, (const u8 *)"\n", 1);
+  assert(7 == buf_frame_delim(&f, &b, &v));
+  assert(5 == buf_view_copy(&v, out, sizeof out));
+  assert(0 == memcmp(out, "hello", 5));
+
+  /* single byte delimiter */
+  buf_frame_init(&f, "\n", 1);
+  fill(&b, data, sizeof data, 0, "ab\n");
+  assert(3 == buf_frame_delim(&f, &b, &v));
+  assert(2 == buf_view_len(&v));
+  printf("OK.\n");
+}
+
+static void test_length(void)
+{
+  u8 data[16],
+     out[16];
+  buf b;
+  buf_view v;
+  size_t start;
+  printf("test_length... ");
+  for (start = 0; start < sizeof data; start++) {
+    fill(&b, data, sizeof data, start, "");
+    buf_append_circ(&b, (const u8 *)"\0\0\0\5hel", 7);
+    assert(0 == buf_frame_u32(&b, &v, 100)); /* not all here */
+    buf_append_circ(&b, (const u8 *)"lo!", 3);
+    assert(9 == buf_frame_u32(&b, &v, 100));
+    assert(5 == buf_view_copy(&v, out, sizeof out));
+    assert(0 == memcmp(out, "hello", 5));
+    assert(-1 == buf_frame_u32(&b, &v, 4));
+    assert(EMSGSIZE == errno);
+  }
+  for (start = 0; start < sizeof data; start++) {
+    fill(&b, data, sizeof data, start, "\x82");
+    assert(0 == buf_frame_varint(&b, &v, 1000)); /* length not all here */
+    buf_append_circ(&b, (const u8 *)"\x01", 1); /* 2 + 1 << 7 = 130 */
+    assert(0 == buf_frame_varint(&b, &v, 1000));
+    assert(-1 == buf_frame_varint(&b, &v, 129));
+    assert(EMSGSIZE == errno);
+    fill(&b, data, sizeof data, start, "\x03" "abcd");
+    assert(4 == buf_frame_varint(&b, &v, 1000));
+    assert(3 == buf_view_copy(&v, out, sizeof out));
+    assert(0 == memcmp(out, "abc", 3));
+  }
+  fill(&b, data, sizeof data, 0, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01");
+  assert(-1 == buf_frame_varint(&b, &v, (uint64_t)-1));
+  assert(EBADMSG == errno);
+  printf("OK.\n");
+}
+
+int main(void)
+{
+  test_scan();
+  test_delim();
+  test_length();
+  return 0;
+}
+
+#endif
+
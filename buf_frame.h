@@ -0,0 +1,50 @@
+/* ex: set ff=dos ts=2 et: */
+/* $Id$ */
+/*
+ * Copyright 2008 Ryan Flynn
+ * All rights reserved.
+ */
+/*
+ * buf_frame: find whole messages in a (possibly circular) buf without
+ * copying them out; see buf_frame.c
+ */
+
+#ifndef BUF_FRAME_H
+#define BUF_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "buf.h"
+
+/*
+ * a message in place; it's in two pieces only if it wraps around the end of
+ * a circular, non-mirrored buf
+ */
+typedef struct {
+  const u8 *p[2];
+  size_t len[2];
+} buf_view;
+
+#define buf_view_len(v) ((v)->len[0] + (v)->len[1])
+
+/*
+ * delimiter scanning state, so bytes already looked at aren't looked at
+ * again when more arrive
+ */
+typedef struct {
+  u8 delim[2];
+  size_t dlen,
+         scanned; /* bytes after start known not to end a delimiter */
+} buf_frame;
+
+void    buf_frame_init(buf_frame *, const char *delim, size_t dlen);
+void    buf_frame_reset(buf_frame *);
+size_t  buf_frame_delim(buf_frame *, const buf *, buf_view *);
+ssize_t buf_frame_u32(const buf *, buf_view *, uint32_t max);
+ssize_t buf_frame_varint(const buf *, buf_view *, uint64_t max);
+void    buf_frame_consume(buf_frame *, buf *, size_t);
+size_t  buf_view_copy(const buf_view *, u8 *, size_t);
+
+#endif
+
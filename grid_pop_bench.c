@@ -29,13 +29,16 @@
  *
  */
 
+#include "bench.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define GRID_SIZE 16
 
-#define N_TIMES 1000000 /* test times */
+#define N_TIMES 20000 /* test times, per trial */
 
 typedef struct {
   unsigned char c[GRID_SIZE][GRID_SIZE];
@@ -167,40 +170,38 @@ static void test(const char *name, void (*f)(grid *))
   //grid_hist(&g);
 }
 
+static void (*Pop)(grid *); /* the one being timed */
+
 /**
- * run function f N_TIMES times and record how long it takes
+ * run Pop N_TIMES times
  */
+static void trial(void *arg)
+{
+  grid *g = arg;
+  int i = -N_TIMES;
+  do
+    Pop(g);
+  while (i++);
+  bench_escape(g);
+}
+
 static void speed(const char *name, void (*f)(grid *))
 {
-  static double orig = 0;
   static grid g;
-  struct timeval tv[2];
-  double d[2], secs;
-  int i;
-  printf("%20s ", name);
   test(name, f);
   /* test speed */
-  i = -N_TIMES;
-  gettimeofday(tv, NULL);
-  do
-    f(&g);
-  while (i++);
-  gettimeofday(tv + 1, NULL);
-  d[0] = (tv[0].tv_sec * 1000000) + tv[0].tv_usec;
-  d[1] = (tv[1].tv_sec * 1000000) + tv[1].tv_usec;
-  secs = (d[1] - d[0]) / 1000000;
-  if (0 == orig)
-    orig = secs;
-  printf("%7.3f %6.0f%%\n", secs, ((orig / secs) * 100) - 100);
+  Pop = f;
+  bench_run(name, trial, &g, 0);
 }
 
 int main(void)
 {
-  printf("RAND_MAX=%d\n", RAND_MAX);
-  printf("N_TIMES=%d\n", N_TIMES);
+  bench_init(2, 15);
+  bench_note("RAND_MAX=%d\n", RAND_MAX);
+  bench_note("N_TIMES=%d\n", N_TIMES);
   srand(time(NULL));
   /* do it... */
-  printf("%20s %7s %5s\n", "name", "time", "speedup");
+  bench_section("name", NULL);
   speed("grid_pop", grid_pop);
   speed("grid_pop_lessrand", grid_pop_lessrand);
   speed("grid_pop_bits", grid_pop_bits);
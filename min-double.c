@@ -3,11 +3,12 @@
  * Thu Nov 01 10:53:35 EST
  */
 
+#include "bench.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-#define N_TIMES 10000000 /* test times */
+#define N_TIMES 10000000 /* test times, per trial */
 
 static void test(const char *name, double (*f)(double, double))
 {
@@ -20,31 +21,28 @@ static void test(const char *name, double (*f)(double, double))
   assert(99. == f(99., 2e10));
 }
 
+static double (*Min)(double, double); /* the one being timed */
+static double V[2];
+
 /**
- * run function f N_TIMES times and record how long it takes
+ * run Min N_TIMES times
  */
-static double Orig = 0;
-static void speed(const char *name, double (*f)(double, double))
+static void trial(void *unused)
 {
-  struct timeval tv[2];
-  double v[2] = { drand48(), drand48() };
-  double d[2], secs;
-  int i;
-  printf("%20s ", name);
-  /* test speed */
-  i = -N_TIMES/2;
-  gettimeofday(tv, NULL);
+  int i = -N_TIMES/2;
+  (void)unused;
   do {
-    f(v[0], v[1]);
-    f(v[1], v[0]);
+    BENCH_USE(Min(V[0], V[1]));
+    BENCH_USE(Min(V[1], V[0]));
   } while (i++);
-  gettimeofday(tv + 1, NULL);
-  d[0] = (tv[0].tv_sec * 1000000) + tv[0].tv_usec;
-  d[1] = (tv[1].tv_sec * 1000000) + tv[1].tv_usec;
-  secs = (d[1] - d[0]) / 1000000;
-  if (0 == Orig)
-    Orig = secs;
-  printf("%7.3f %6.0f%%\n", secs, ((Orig / secs) * 100) - 100);
+}
+
+static void speed(const char *name, double (*f)(double, double))
+{
+  V[0] = drand48();
+  V[1] = drand48();
+  Min = f;
+  bench_run(name, trial, NULL, 0);
 }
 
 static double obvious(double x, double y)
@@ -70,7 +68,8 @@ static double array(double x, double y)
 
 int main(void)
 {
-  printf("%20s %7s %5s\n", "name", "time", "speedup");
+  bench_init(2, 15);
+  bench_section("name", NULL);
   speed("***calibrate***", obvious);
   speed("obvious", obvious);
   speed("invert", invert);
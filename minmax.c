@@ -9,9 +9,17 @@
  *
  */
 
+#include "bench.h"
+#include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 
+#define LEN     4096
+#define N_TIMES 1000 /* calls per trial */
+
+typedef void (*minmax_f)(const int[], size_t, int *, int *);
+
 void obvious(const int n[], size_t len, int *min, int *max)
 {
   if (len) {
@@ -63,13 +71,71 @@ void nonbranching(const int n[], size_t len, int *min, int *max)
   }
 }
 
-main()
+static minmax_f Minmax; /* the one being timed */
+static int Data[LEN];
+
+/**
+ * check f against the obvious on a short list and on Data
+ */
+static void test(const char *name, minmax_f f)
 {
   static const int N[] = { -1, 2, 6, 0 }; /* list we're searching */
   int min = INT_MIN,
-      max = INT_MIN;
-  minmax(N, sizeof N / sizeof N[0], &min, &max);
-  printf("min=%d max=%d\n", min, max);
+      max = INT_MIN,
+      omin,
+      omax;
+  f(N, sizeof N / sizeof N[0], &min, &max);
+  if (-1 != min || 6 != max) {
+    fprintf(stderr, "%s: min=%d max=%d, expected min=-1 max=6\n", name, min, max);
+    exit(1);
+  }
+  obvious(Data, LEN, &omin, &omax);
+  f(Data, LEN, &min, &max);
+  assert(min == omin && max == omax);
+}
+
+static void trial(void *arg)
+{
+  int i = -N_TIMES,
+      min,
+      max;
+  (void)arg;
+  do {
+    Minmax(Data, LEN, &min, &max);
+    BENCH_USE(min);
+    BENCH_USE(max);
+  } while (i++);
+}
+
+static void speed(const char *name, minmax_f f)
+{
+  test(name, f);
+  Minmax = f;
+  bench_run(name, trial, NULL, (double)LEN * N_TIMES);
+}
+
+static void run(void)
+{
+  speed("obvious", obvious);
+  speed("obvious_else", obvious_else);
+  speed("nonbranching", nonbranching);
+}
+
+int main(void)
+{
+  unsigned i;
+  bench_init(2, 15);
+  /* min and max settle quickly, so the branches are nearly free... */
+  srand(1);
+  for (i = 0; i < LEN; i++)
+    Data[i] = rand() - RAND_MAX / 2;
+  bench_section("random", "ints/s");
+  run();
+  /* ...unless every element is a new max */
+  for (i = 0; i < LEN; i++)
+    Data[i] = (int)i;
+  bench_section("ascending", "ints/s");
+  run();
   return 0;
 }
 
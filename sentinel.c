@@ -3,83 +3,95 @@
  * Sun Oct  7 03:57:17 EDT 2007
  */
 
+#include "bench.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define VALUE     5
 #define DATA_SIZE 1024
 
-#define N_TIMES 1000000 /* test times */
+#define N_TIMES 100000 /* test times, per trial */
 
 typedef struct {
   size_t len;
   int data[DATA_SIZE+1];
 } vector;
 
+static size_t (*Find)(vector *); /* the one being timed */
+
 /**
- * run function f N_TIMES times and record how long it takes
+ * run Find N_TIMES times
  */
-static double Orig = 0;
-static void speed(const char *name, void (*f)(vector *), vector *v)
+static void trial(void *arg)
 {
-  struct timeval tv[2];
-  double d[2], secs;
-  int i;
-  printf("%20s ", name);
-  //test(name, f);
-  /* test speed */
-  i = -N_TIMES;
-  gettimeofday(tv, NULL);
+  vector *v = arg;
+  int i = -N_TIMES;
   do
-    f(v);
+    BENCH_USE(Find(v));
   while (i++);
-  gettimeofday(tv + 1, NULL);
-  d[0] = (tv[0].tv_sec * 1000000) + tv[0].tv_usec;
-  d[1] = (tv[1].tv_sec * 1000000) + tv[1].tv_usec;
-  secs = (d[1] - d[0]) / 1000000;
-  if (0 == Orig)
-    Orig = secs;
-  printf("%7.3f %6.0f%%\n", secs, ((Orig / secs) * 100) - 100);
 }
 
-static void bound_for(vector *v)
+/**
+ * the sentinel functions leave their sentinels behind, so start everyone
+ * off with the same vector
+ */
+static void vector_init(vector *v)
+{
+  v->len = DATA_SIZE;
+  memset(v->data, 0, sizeof v->data);
+  v->data[DATA_SIZE/2] = VALUE;
+}
+
+static void speed(const char *name, size_t (*f)(vector *), vector *v)
+{
+  //test(name, f);
+  vector_init(v);
+  Find = f;
+  bench_run(name, trial, v, 0);
+}
+
+static size_t bound_for(vector *v)
 {
   size_t i;
   for (i = 0; i < v->len; i++)
     if (v->data[i] == VALUE)
       break;
+  return i;
 }
 
-static void bound_while(vector *v)
+static size_t bound_while(vector *v)
 {
   size_t i = 0;
   while (i < v->len && v->data[i] != VALUE)
     i++;
+  return i;
 }
 
-static void sentinel(vector *v)
+static size_t sentinel(vector *v)
 {
   int i = -1;
   v->data[DATA_SIZE] = VALUE;
   while (v->data[++i] != VALUE);
+  return i;
 }
 
-static void sentinel_backwards(vector *v)
+static size_t sentinel_backwards(vector *v)
 {
   size_t i = DATA_SIZE;
   v->data[0] = VALUE;
   do
     --i;
   while (VALUE != v->data[i]);
+  return i;
 }
 
 int main(void)
 {
   vector v;
-  memset(v.data, 0, sizeof v.data);
-  v.data[DATA_SIZE/2] = VALUE;
-  printf("%20s %7s %5s\n", "name", "time", "speedup");
+  bench_init(2, 15);
+  bench_section("name", NULL);
   speed("***calibrate***", bound_for, &v);
   speed("bound_for", bound_for, &v);
   speed("bound_while", bound_while, &v);
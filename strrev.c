@@ -10,8 +10,12 @@
  *
  * NOTE: run like so and send me all the results:
  *  $ cat /proc/cpuinfo # or equivalent
- *  $ cc -std=c99 -W -Wall -pedantic -O3 -o strrev strrev.c
+ *  $ cc -std=c99 -W -Wall -pedantic -O3 -pthread -o strrev strrev.c
  *  $ ./strrev
+ * (bench.h explains the knobs, e.g. BENCH_FORMAT=csv ./strrev)
+ *
+ * or, to actually go looking for a palindrome (see r196_main):
+ *  $ ./strrev 196 196 196.ckpt
  *
  * I stumbled across this exercise in Palindromic Numbers from
  * <URL:http://mathworld.wolfram.com/196-Algorithm.html> by way of MathWorld's
@@ -41,6 +45,7 @@
  * and so on.
  *
  */
+#include "bench.h" /* first, it wants _GNU_SOURCE; which also gets us pthread barriers */
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -1643,6 +1648,415 @@ void byte256_w128(char *dst, const char *src, unsigned len)
 
 #endif
 
+/*
+ * in-place reversal.
+ *
+ * all of the above want a second buffer as big as the first, and for the
+ * 196 search that's pure waste: we only ever want the digits flipped where
+ * they sit, and dragging them through another MAXLEN buffer doubles the
+ * number of bytes that go over the bus.
+ *
+ * these take a block from each end into registers, reverse both and write
+ * each one back where the other came from. careful: unlike the dst/src
+ * versions they must not touch a byte in the middle twice, so the loops run
+ * while there are two whole blocks left rather than up to 'halfway'
+ */
+
+/**
+ * swap the bytes in [i, j) end for end, one at a time
+ */
+static void inplace_middle(char *s, long i, long j)
+{
+  while (i < --j) {
+    char c = s[i];
+    s[i++] = s[j];
+    s[j] = c;
+  }
+}
+
+/**
+ * the obvious way, for reference
+ */
+void inplace_obvious(char *s, unsigned len)
+{
+  inplace_middle(s, 0, len);
+}
+
+/**
+ * swap 8-byte blocks, whatever remains at the middle is done bytewise
+ */
+void inplace_w64(char *s, unsigned len)
+{
+  long i = 0,
+       j = len; /* [i, j) is still unreversed */
+  while (j - i >= 16) {
+    uint64_t lo = *(uint64_t *)(s+i),
+             hi = *(uint64_t *)(s+j-8);
+    *(uint64_t *)(s+i)   = bswap64(hi);
+    *(uint64_t *)(s+j-8) = bswap64(lo);
+    i += 8, j -= 8;
+  }
+  inplace_middle(s, i, j);
+}
+
+/**
+ * inplace_w64 unrolled to 32 bytes a side
+ */
+void inplace_w64x4(char *s, unsigned len)
+{
+  long i = 0,
+       j = len;
+  while (j - i >= 64) {
+    uint64_t lo0 = *(uint64_t *)(s+i),
+             lo1 = *(uint64_t *)(s+i+8),
+             lo2 = *(uint64_t *)(s+i+16),
+             lo3 = *(uint64_t *)(s+i+24),
+             hi0 = *(uint64_t *)(s+j-8),
+             hi1 = *(uint64_t *)(s+j-16),
+             hi2 = *(uint64_t *)(s+j-24),
+             hi3 = *(uint64_t *)(s+j-32);
+    *(uint64_t *)(s+i)    = bswap64(hi0);
+    *(uint64_t *)(s+i+8)  = bswap64(hi1);
+    *(uint64_t *)(s+i+16) = bswap64(hi2);
+    *(uint64_t *)(s+i+24) = bswap64(hi3);
+    *(uint64_t *)(s+j-8)  = bswap64(lo0);
+    *(uint64_t *)(s+j-16) = bswap64(lo1);
+    *(uint64_t *)(s+j-24) = bswap64(lo2);
+    *(uint64_t *)(s+j-32) = bswap64(lo3);
+    i += 32, j -= 32;
+  }
+  while (j - i >= 16) {
+    uint64_t lo = *(uint64_t *)(s+i),
+             hi = *(uint64_t *)(s+j-8);
+    *(uint64_t *)(s+i)   = bswap64(hi);
+    *(uint64_t *)(s+j-8) = bswap64(lo);
+    i += 8, j -= 8;
+  }
+  inplace_middle(s, i, j);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(WIN32)
+# define CAN_SIMD
+#endif
+
+#ifdef CAN_SIMD
+
+#include <immintrin.h>
+
+/*
+ * everything above swaps bytes with scalar bswaps. x86 has had a byte shuffle
+ * in the vector unit since SSSE3 which will reverse a whole register in one
+ * instruction, so try that at 16, 32 and 64 bytes.
+ *
+ * each kernel is compiled for its own instruction set via target() so the
+ * rest of the file doesn't need -mavx2 et al.; which ones are actually safe
+ * to call is figured out at runtime, see simd_init()
+ */
+
+/**
+ * 16 bytes per pshufb
+ */
+__attribute__((target("ssse3")))
+void byte16_ssse3(char *dst, const char *src, unsigned len)
+{
+  if (len) {
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                       7,  6,  5,  4,  3,  2, 1, 0);
+    long i = 0,
+         halfway = len / 2;
+    while (i <= halfway-16) {
+      __m128i lo = _mm_loadu_si128((const __m128i *)(src+i)),
+              hi = _mm_loadu_si128((const __m128i *)(src+len-16-i));
+      _mm_storeu_si128((__m128i *)(dst+len-16-i), _mm_shuffle_epi8(lo, rev));
+      _mm_storeu_si128((__m128i *)(dst+i),        _mm_shuffle_epi8(hi, rev));
+      i += 16;
+    }
+    while (i <= halfway) {
+      dst[i] = src[len-1-i];
+      dst[len-1-i] = src[i];
+      i++;
+    }
+  }
+}
+
+/**
+ * 32 bytes per vpshufb+vpermq; AVX2's vpshufb only shuffles within each
+ * 128-bit lane, so reverse each lane and then swap the lanes
+ */
+__attribute__((target("avx2")))
+void byte32_avx2(char *dst, const char *src, unsigned len)
+{
+  if (len) {
+    const __m256i rev = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+                                          7,  6,  5,  4,  3,  2, 1, 0,
+                                         15, 14, 13, 12, 11, 10, 9, 8,
+                                          7,  6,  5,  4,  3,  2, 1, 0);
+    long i = 0,
+         halfway = len / 2;
+    while (i <= halfway-32) {
+      __m256i lo = _mm256_loadu_si256((const __m256i *)(src+i)),
+              hi = _mm256_loadu_si256((const __m256i *)(src+len-32-i));
+      lo = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(lo, rev), 0x4E);
+      hi = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(hi, rev), 0x4E);
+      _mm256_storeu_si256((__m256i *)(dst+len-32-i), lo);
+      _mm256_storeu_si256((__m256i *)(dst+i),        hi);
+      i += 32;
+    }
+    /* up to 31 bytes left on each side */
+    while (i <= halfway-16) {
+      __m128i lo = _mm_loadu_si128((const __m128i *)(src+i)),
+              hi = _mm_loadu_si128((const __m128i *)(src+len-16-i));
+      _mm_storeu_si128((__m128i *)(dst+len-16-i),
+        _mm_shuffle_epi8(lo, _mm256_castsi256_si128(rev)));
+      _mm_storeu_si128((__m128i *)(dst+i),
+        _mm_shuffle_epi8(hi, _mm256_castsi256_si128(rev)));
+      i += 16;
+    }
+    while (i <= halfway) {
+      dst[i] = src[len-1-i];
+      dst[len-1-i] = src[i];
+      i++;
+    }
+  }
+}
+
+static const char Rev64[64] = {
+  63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48,
+  47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32,
+  31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+  15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0
+};
+
+/**
+ * 64 bytes per vpermb, which unlike vpshufb can move any byte anywhere.
+ * needs AVX-512 VBMI (Cannon Lake/Ice Lake and later)
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void byte64_avx512vbmi(char *dst, const char *src, unsigned len)
+{
+  if (len) {
+    const __m512i rev = _mm512_loadu_si512(Rev64);
+    long i = 0,
+         halfway = len / 2;
+    while (i <= halfway-64) {
+      __m512i lo = _mm512_loadu_si512(src+i),
+              hi = _mm512_loadu_si512(src+len-64-i);
+      _mm512_storeu_si512(dst+len-64-i, _mm512_permutexvar_epi8(rev, lo));
+      _mm512_storeu_si512(dst+i,        _mm512_permutexvar_epi8(rev, hi));
+      i += 64;
+    }
+    while (i <= halfway-16) {
+      const __m128i rev16 = _mm_loadu_si128((const __m128i *)(Rev64+48));
+      __m128i lo = _mm_loadu_si128((const __m128i *)(src+i)),
+              hi = _mm_loadu_si128((const __m128i *)(src+len-16-i));
+      _mm_storeu_si128((__m128i *)(dst+len-16-i), _mm_shuffle_epi8(lo, rev16));
+      _mm_storeu_si128((__m128i *)(dst+i),        _mm_shuffle_epi8(hi, rev16));
+      i += 16;
+    }
+    while (i <= halfway) {
+      dst[i] = src[len-1-i];
+      dst[len-1-i] = src[i];
+      i++;
+    }
+  }
+}
+
+/**
+ * 64 bytes for AVX-512 parts without VBMI (Skylake-X): vpshufb within each
+ * of the four 128-bit lanes, then vshufi64x2 to reverse the lanes
+ */
+__attribute__((target("avx512f,avx512bw")))
+void byte64_avx512bw(char *dst, const char *src, unsigned len)
+{
+  if (len) {
+    const __m128i rev16 = _mm_loadu_si128((const __m128i *)(Rev64+48));
+    const __m512i rev = _mm512_broadcast_i32x4(rev16);
+    long i = 0,
+         halfway = len / 2;
+    while (i <= halfway-64) {
+      __m512i lo = _mm512_loadu_si512(src+i),
+              hi = _mm512_loadu_si512(src+len-64-i);
+      lo = _mm512_shuffle_epi8(lo, rev);
+      hi = _mm512_shuffle_epi8(hi, rev);
+      _mm512_storeu_si512(dst+len-64-i, _mm512_shuffle_i64x2(lo, lo, 0x1B));
+      _mm512_storeu_si512(dst+i,        _mm512_shuffle_i64x2(hi, hi, 0x1B));
+      i += 64;
+    }
+    while (i <= halfway-16) {
+      __m128i lo = _mm_loadu_si128((const __m128i *)(src+i)),
+              hi = _mm_loadu_si128((const __m128i *)(src+len-16-i));
+      _mm_storeu_si128((__m128i *)(dst+len-16-i), _mm_shuffle_epi8(lo, rev16));
+      _mm_storeu_si128((__m128i *)(dst+i),        _mm_shuffle_epi8(hi, rev16));
+      i += 16;
+    }
+    while (i <= halfway) {
+      dst[i] = src[len-1-i];
+      dst[len-1-i] = src[i];
+      i++;
+    }
+  }
+}
+
+/**
+ * in-place, 16 bytes a side per pshufb; see inplace_w64
+ */
+__attribute__((target("ssse3")))
+void inplace16_ssse3(char *s, unsigned len)
+{
+  const __m128i rev = _mm_loadu_si128((const __m128i *)(Rev64+48));
+  long i = 0,
+       j = len;
+  while (j - i >= 32) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(s+i)),
+            hi = _mm_loadu_si128((const __m128i *)(s+j-16));
+    _mm_storeu_si128((__m128i *)(s+i),    _mm_shuffle_epi8(hi, rev));
+    _mm_storeu_si128((__m128i *)(s+j-16), _mm_shuffle_epi8(lo, rev));
+    i += 16, j -= 16;
+  }
+  inplace_middle(s, i, j);
+}
+
+/**
+ * in-place, 32 bytes a side per vpshufb+vpermq
+ */
+__attribute__((target("avx2")))
+void inplace32_avx2(char *s, unsigned len)
+{
+  const __m128i rev16 = _mm_loadu_si128((const __m128i *)(Rev64+48));
+  const __m256i rev = _mm256_broadcastsi128_si256(rev16);
+  long i = 0,
+       j = len;
+  while (j - i >= 64) {
+    __m256i lo = _mm256_loadu_si256((const __m256i *)(s+i)),
+            hi = _mm256_loadu_si256((const __m256i *)(s+j-32));
+    lo = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(lo, rev), 0x4E);
+    hi = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(hi, rev), 0x4E);
+    _mm256_storeu_si256((__m256i *)(s+i),    hi);
+    _mm256_storeu_si256((__m256i *)(s+j-32), lo);
+    i += 32, j -= 32;
+  }
+  if (j - i >= 32) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(s+i)),
+            hi = _mm_loadu_si128((const __m128i *)(s+j-16));
+    _mm_storeu_si128((__m128i *)(s+i),    _mm_shuffle_epi8(hi, rev16));
+    _mm_storeu_si128((__m128i *)(s+j-16), _mm_shuffle_epi8(lo, rev16));
+    i += 16, j -= 16;
+  }
+  inplace_middle(s, i, j);
+}
+
+/**
+ * in-place, 64 bytes a side per vpermb
+ */
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+void inplace64_avx512vbmi(char *s, unsigned len)
+{
+  const __m512i rev = _mm512_loadu_si512(Rev64);
+  const __m128i rev16 = _mm_loadu_si128((const __m128i *)(Rev64+48));
+  long i = 0,
+       j = len;
+  while (j - i >= 128) {
+    __m512i lo = _mm512_loadu_si512(s+i),
+            hi = _mm512_loadu_si512(s+j-64);
+    _mm512_storeu_si512(s+i,    _mm512_permutexvar_epi8(rev, hi));
+    _mm512_storeu_si512(s+j-64, _mm512_permutexvar_epi8(rev, lo));
+    i += 64, j -= 64;
+  }
+  while (j - i >= 32) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(s+i)),
+            hi = _mm_loadu_si128((const __m128i *)(s+j-16));
+    _mm_storeu_si128((__m128i *)(s+i),    _mm_shuffle_epi8(hi, rev16));
+    _mm_storeu_si128((__m128i *)(s+j-16), _mm_shuffle_epi8(lo, rev16));
+    i += 16, j -= 16;
+  }
+  inplace_middle(s, i, j);
+}
+
+enum simd_feature {
+  SIMD_SSSE3,
+  SIMD_AVX2,
+  SIMD_AVX512BW,
+  SIMD_AVX512VBMI
+};
+
+/**
+ * ask CPUID (by way of GCC, which also checks that the OS saves the wide
+ * registers for us) whether we can run a given kernel
+ */
+static int simd_supported(enum simd_feature feat)
+{
+  __builtin_cpu_init();
+  switch (feat) {
+  case SIMD_SSSE3:      return __builtin_cpu_supports("ssse3");
+  case SIMD_AVX2:       return __builtin_cpu_supports("avx2");
+  case SIMD_AVX512BW:   return __builtin_cpu_supports("avx512bw");
+  case SIMD_AVX512VBMI: return __builtin_cpu_supports("avx512vbmi") &&
+                               __builtin_cpu_supports("avx512bw");
+  }
+  return 0;
+}
+
+/*
+ * every SIMD kernel, best first. simd_init() picks the first one this CPU can
+ * run and main() times all of them that it can.
+ */
+static const struct simd {
+  const char *name;
+  enum simd_feature feat;
+  void (*f)(char *, const char *, unsigned);
+  const char *iname; /* in-place version, if there is one */
+  void (*fi)(char *, unsigned);
+} Simd[] = {
+  { "byte64_avx512vbmi",  SIMD_AVX512VBMI,  byte64_avx512vbmi,
+    "inplace64_avx512vbmi",                 inplace64_avx512vbmi },
+  { "byte64_avx512bw",    SIMD_AVX512BW,    byte64_avx512bw,
+    NULL,                                   NULL },
+  { "byte32_avx2",        SIMD_AVX2,        byte32_avx2,
+    "inplace32_avx2",                       inplace32_avx2 },
+  { "byte16_ssse3",       SIMD_SSSE3,       byte16_ssse3,
+    "inplace16_ssse3",                      inplace16_ssse3 }
+};
+
+#endif /* CAN_SIMD */
+
+static void (*Byte_simd)(char *, const char *, unsigned) = byte8_w64;
+static void (*Inplace_simd)(char *, unsigned) = inplace_w64x4;
+
+/**
+ * choose the best kernels for this CPU, once.
+ * anything without SSSE3 (or not x86, or not GCC) keeps byte8_w64 and
+ * inplace_w64x4
+ */
+static void simd_init(void)
+{
+#ifdef CAN_SIMD
+  unsigned i = sizeof Simd / sizeof Simd[0];
+  while (i--) {
+    if (simd_supported(Simd[i].feat)) {
+      Byte_simd = Simd[i].f;
+      if (Simd[i].fi)
+        Inplace_simd = Simd[i].fi;
+    }
+  }
+#endif
+}
+
+/**
+ * whatever simd_init() picked; costs one indirect call per string
+ */
+void byte_simd(char *dst, const char *src, unsigned len)
+{
+  Byte_simd(dst, src, len);
+}
+
+/**
+ * in-place version of byte_simd
+ */
+void inplace_simd(char *s, unsigned len)
+{
+  Inplace_simd(s, len);
+}
+
 
 /************************* test crap ****************************/
 
@@ -1753,58 +2167,914 @@ void test(const char *name, void (*f)(char *, const char *, unsigned))
   }
 }
 
+/**
+ * test an in-place function over the same strings as test(), then against
+ * inplace_obvious for every length up to a few vector widths, which covers
+ * every way the blocks from each end can meet in the middle: exactly, with a
+ * byte or so between them, and with less than a block left on each side
+ */
+void test_inplace(const char *name, void (*f)(char *, unsigned))
+{
+  static const char Str[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789./";
+  char buf[1 + 512 + 1],
+       ref[512];
+  char *s = buf + 1;
+  unsigned len, i;
+  (void)name;
+  for (len = 0; len <= 512; len++) {
+    buf[0] = buf[len + 1] = 0x7F; /* detect buffer underflow/overflow */
+    for (i = 0; i < len; i++)
+      s[i] = ref[i] = Str[(i * 7 + len) % (sizeof Str - 1)];
+    inplace_obvious(ref, len);
+    f(s, len);
+    assert(0x7F == buf[0]); /* check underflow */
+    assert(0x7F == buf[len + 1]); /* check overflow */
+    assert(0 == memcmp(s, ref, len));
+    f(s, len); /* and back again */
+    for (i = 0; i < len; i++)
+      assert(s[i] == Str[(i * 7 + len) % (sizeof Str - 1)]);
+  }
+  /* a palindrome must come out the same */
+  memset(s, 'a', 512);
+  for (i = 0; i < 256; i++)
+    s[i] = s[511 - i] = Str[i % (sizeof Str - 1)];
+  memcpy(ref, s, 512);
+  f(s, 512);
+  assert(0 == memcmp(s, ref, 512));
+}
+
 #define MAXLEN 128*1024 /* maximum string length to test */
+#define SWEEP  7        /* time every SWEEPth length from MAXLEN down to 0 */
+
+/*
+ * what the current trial is running; see bench.h
+ */
+static void (*Run_f)(char *, const char *, unsigned);
+static void (*Run_fi)(char *, unsigned);
+static char *Run_src,
+            *Run_dst;
 
 /**
- * return the number of seconds required to run function 'f' against
- * input 'src' for all lengths [0..len]
+ * bytes reversed by one trial, i.e. the sum of the lengths it does
  */
-static double speed(char *dst, const char *src, unsigned len, void (*f)())
+static double sweep_bytes(void)
 {
-  double d[2], total;
-  struct timeval tv[2];
-  /* test speed */
-  gettimeofday(tv, NULL);
+  double bytes = 0;
+  long len;
+  for (len = MAXLEN; len >= 0; len -= SWEEP)
+    bytes += len;
+  return bytes;
+}
+
+/**
+ * one trial: run Run_f against Run_src for lengths [MAXLEN..0]
+ */
+static void trial(void *unused)
+{
+  long len = MAXLEN;
+  (void)unused;
   do
-    f(dst, src, len);
-  while (len--); /* run for all variations of [len..0] */
-  gettimeofday(tv + 1, NULL);
-  d[0] = (tv[0].tv_sec * 1000000) + tv[0].tv_usec;
-  d[1] = (tv[1].tv_sec * 1000000) + tv[1].tv_usec;
-  total = (d[1] - d[0]) / 1000000;
-  printf("%5.2f ", total);
-  fflush(stdout);
-  return total;
+    Run_f(Run_dst, Run_src, (unsigned)len);
+  while ((len -= SWEEP) >= 0);
+  bench_escape(Run_dst);
 }
 
 /**
- * run function 'f' through a variety of lengths and print the total amount of time
+ * trial() for an in-place function; Run_src is reversed back and forth
+ */
+static void trial_inplace(void *unused)
+{
+  long len = MAXLEN;
+  (void)unused;
+  do
+    Run_fi(Run_src, (unsigned)len);
+  while ((len -= SWEEP) >= 0);
+  bench_escape(Run_src);
+}
+
+/**
+ * run function 'f' through a variety of lengths and report the time per
+ * sweep and the throughput in MB of string reversed per second. note that
+ * a dst/src function moves each byte through two buffers and an in-place
+ * one through only one, that's rather the point
  */
 static void run(const char *name, void (*f)(char *, const char *, unsigned))
 {
-  static double FirstRun = 0;
-  char *src = malloc(MAXLEN),
-       *dst = malloc(MAXLEN);
-  double time = 0;
+  bench_result r;
   unsigned i = MAXLEN;
-  assert(src);
-  assert(dst);
+  Run_src = malloc(MAXLEN);
+  Run_dst = malloc(MAXLEN);
+  assert(Run_src);
+  assert(Run_dst);
   while (i--)
-    src[i] = (char)(rand() % 10); /* ~10% chance swapped chars will be the same */
-  printf("%28s ", name);
-  fflush(stdout);
+    Run_src[i] = (char)(rand() % 10); /* ~10% chance swapped chars will be the same */
   /* test for correctness ... */
   test(name, f);
-  time += speed(dst, src, MAXLEN, f);
-  if (0 == FirstRun)
-    FirstRun = time;
-  printf(" %6.1f%%\n", FirstRun/time*100-100);
+  Run_f = f;
+  r = bench_run(name, trial, NULL, sweep_bytes() / (1024 * 1024));
   if (obvious == f)
-    FirstRun = time;
-  free(src);
-  free(dst);
+    bench_baseline(&r);
+  free(Run_src);
+  free(Run_dst);
+}
+
+/**
+ * run() for in-place functions
+ */
+static void run_inplace(const char *name, void (*f)(char *, unsigned))
+{
+  unsigned i = MAXLEN;
+  Run_src = malloc(MAXLEN);
+  assert(Run_src);
+  while (i--)
+    Run_src[i] = (char)(rand() % 10);
+  test_inplace(name, f);
+  Run_fi = f;
+  bench_run(name, trial_inplace, NULL, sweep_bytes() / (1024 * 1024));
+  free(Run_src);
+}
+
+/************************* 196 ****************************/
+
+/*
+ * the actual point of all this: Rev(n) + n over and over until we hit a
+ * palindrome, which for 196 nobody ever has.
+ *
+ * digits are kept one per byte, least significant first, because that's the
+ * layout every kernel above reverses. each iteration is one pass that
+ * reads the number forwards and backwards at once (the backwards load being
+ * one of the reversals above), adds, resolves the carries for a whole block
+ * at a time, writes the result to a second buffer, and notes whether the
+ * number it read was a palindrome.
+ *
+ * the carries are the only hard part: sum digit s[i] = d[i] + d[len-1-i] is
+ * 0..18, and position i passes a carry on if s[i] >= 10 (generate) or
+ * s[i] == 9 and it got one (propagate). that is exactly binary addition of a
+ * generate mask G and a generate-or-propagate mask G|P, so one integer add
+ * settles a block's carry chain and (G + (G|P) + cin) ^ G ^ (G|P) is the
+ * carry into every digit.
+ */
+
+#include <signal.h>
+#include <errno.h>
+
+#define R196_ONES 0x0101010101010101ULL
+#define R196_HIGH 0x8080808080808080ULL
+
+/* bit i of the index -> 1 in byte i */
+static uint64_t R196_Spread[256];
+
+static void r196_spread_init(void)
+{
+  unsigned i, j;
+  for (i = 0; i < 256; i++) {
+    R196_Spread[i] = 0;
+    for (j = 0; j < 8; j++)
+      if (i & (1 << j))
+        R196_Spread[i] |= (uint64_t)1 << (j * 8);
+  }
+}
+
+/* top bit of each byte -> 8-bit mask */
+#define R196_GATHER(x) (unsigned)(((((x) >> 7) & R196_ONES) * 0x0102040810204080ULL) >> 56)
+
+/*
+ * the kernels work on digits [lo, hi) of the result, given the carry into
+ * digit 'lo'; they return the carry out of digit hi-1 and set *diff if any
+ * digit they read differs from its mirror. that's so the threaded version
+ * further down can hand each thread a slice; everyone else wants the
+ * whole number, see r196_finish()
+ */
+
+/**
+ * digits [lo, hi) of src + Rev(src), one at a time
+ */
+static unsigned r196_obvious_range(char *dst, const char *src, size_t len,
+                                   size_t lo, size_t hi, unsigned cin, int *diff)
+{
+  size_t i = lo;
+  int d = 0;
+  while (i < hi) {
+    unsigned s = src[i] + src[len-1-i] + cin;
+    d |= src[i] ^ src[len-1-i];
+    cin = s >= 10;
+    dst[i++] = (char)(s - 10 * cin);
+  }
+  *diff |= d;
+  return cin;
+}
+
+/**
+ * digits [lo, hi) of src + Rev(src), 8 at a time in a uint64_t
+ */
+static unsigned r196_w64_range(char *dst, const char *src, size_t len,
+                               size_t lo, size_t hi, unsigned cin, int *diff)
+{
+  uint64_t d = 0;
+  size_t i = lo;
+  while (i + 8 <= hi) {
+    uint64_t a = *(uint64_t *)(src+i),
+             b = bswap64(*(uint64_t *)(src+len-8-i)),
+             s, z, r;
+    unsigned g, gp, t;
+    d |= a ^ b;
+    s = a + b; /* no byte exceeds 18, so no byte carries into the next */
+    z = s ^ (R196_ONES * 9);
+    g  = R196_GATHER(s + R196_ONES * (128 - 10)); /* s >= 10 */
+    gp = g | R196_GATHER(~(((z & ~R196_HIGH) + ~R196_HIGH) | z)); /* s == 9 */
+    t = g + gp + cin;
+    cin = t >> 8;
+    r = s + R196_Spread[(t ^ g ^ gp) & 0xFF];
+    r -= ((((r + R196_ONES * (128 - 10)) & R196_HIGH) >> 7) * 10);
+    *(uint64_t *)(dst+i) = r;
+    i += 8;
+  }
+  *diff |= d != 0;
+  return r196_obvious_range(dst, src, len, i, hi, cin, diff);
+}
+
+#ifdef CAN_SIMD
+/**
+ * digits [lo, hi) of src + Rev(src), 32 at a time in a ymm register
+ */
+__attribute__((target("avx2")))
+static unsigned r196_avx2_range(char *dst, const char *src, size_t len,
+                                size_t lo, size_t hi, unsigned cin, int *diff)
+{
+  const __m128i rev16 = _mm_loadu_si128((const __m128i *)(Rev64+48));
+  const __m256i rev = _mm256_broadcastsi128_si256(rev16),
+                nine = _mm256_set1_epi8(9),
+                ten = _mm256_set1_epi8(10),
+                /* byte i of the carry mask lives in byte i/8 of the dword */
+                sel = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0,
+                                       1, 1, 1, 1, 1, 1, 1, 1,
+                                       2, 2, 2, 2, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 3, 3, 3, 3),
+                bit = _mm256_set1_epi64x((long long)0x8040201008040201ULL);
+  __m256i d = _mm256_setzero_si256();
+  size_t i = lo;
+  while (i + 32 <= hi) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src+i)),
+            b = _mm256_loadu_si256((const __m256i *)(src+len-32-i)),
+            s, c, r;
+    uint32_t g, gp;
+    uint64_t t;
+    b = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(b, rev), 0x4E);
+    d = _mm256_or_si256(d, _mm256_xor_si256(a, b));
+    s = _mm256_add_epi8(a, b);
+    g  = (uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(s, nine));
+    gp = g | (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(s, nine));
+    t = (uint64_t)g + gp + cin;
+    cin = (unsigned)(t >> 32);
+    /* carry bits -> 0xFF bytes */
+    c = _mm256_shuffle_epi8(_mm256_set1_epi32((int)(uint32_t)(t ^ g ^ gp)), sel);
+    c = _mm256_cmpeq_epi8(_mm256_and_si256(c, bit), bit);
+    r = _mm256_sub_epi8(s, c);
+    r = _mm256_sub_epi8(r, _mm256_and_si256(_mm256_cmpgt_epi8(r, nine), ten));
+    _mm256_storeu_si256((__m256i *)(dst+i), r);
+    i += 32;
+  }
+  *diff |= !_mm256_testz_si256(d, d);
+  return r196_obvious_range(dst, src, len, i, hi, cin, diff);
+}
+#endif
+
+/**
+ * the carry out of the top digit becomes a new digit
+ */
+static size_t r196_finish(char *dst, size_t len, unsigned cout)
+{
+  if (cout)
+    dst[len++] = 1;
+  return len;
+}
+
+/**
+ * dst = src + Rev(src), one digit at a time; the reference.
+ * dst must have room for len+1 digits. sets *pal if src was a palindrome.
+ * returns the length of dst
+ */
+size_t r196_obvious(char *dst, const char *src, size_t len, int *pal)
+{
+  int diff = 0;
+  len = r196_finish(dst, len, r196_obvious_range(dst, src, len, 0, len, 0, &diff));
+  *pal = !diff;
+  return len;
+}
+
+/**
+ * dst = src + Rev(src), 8 digits per uint64_t
+ */
+size_t r196_w64(char *dst, const char *src, size_t len, int *pal)
+{
+  int diff = 0;
+  len = r196_finish(dst, len, r196_w64_range(dst, src, len, 0, len, 0, &diff));
+  *pal = !diff;
+  return len;
+}
+
+#ifdef CAN_SIMD
+/**
+ * dst = src + Rev(src), 32 digits per ymm register
+ */
+size_t r196_avx2(char *dst, const char *src, size_t len, int *pal)
+{
+  int diff = 0;
+  len = r196_finish(dst, len, r196_avx2_range(dst, src, len, 0, len, 0, &diff));
+  *pal = !diff;
+  return len;
+}
+#endif
+
+static unsigned (*R196_range)(char *, const char *, size_t, size_t, size_t,
+                              unsigned, int *) = r196_w64_range;
+
+#ifndef WIN32
+/*
+ * threads.
+ *
+ * one core can't keep up with memory once the number is millions of digits
+ * long, so cut it up. the low half of the result is split into one slice
+ * per thread and each thread also takes the mirror image of its slice in
+ * the high half; those two slices read exactly the same source bytes (one
+ * forwards, one backwards), so between them they touch 1/Nth of the number.
+ *
+ * every slice is computed as if no carry came into it, and all a slice has
+ * to report back is its carry out. once they're all done, walking the
+ * slices bottom to top tells us which ones really did get a carry; those get
+ * 1 added, which stops at the first digit that isn't a 9, i.e. almost always
+ * the first one. that walk is serial but only O(threads) in practice.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define R196_MAXTHREADS 64
+#define R196_MT_MIN (256*1024) /* fewer digits than this and threads don't pay */
+
+struct r196_slice {
+  size_t lo, hi;
+  unsigned cout; /* carry out, assuming none came in */
+  int diff;
+};
+
+static struct {
+  unsigned threads;
+  int quit;
+  pthread_t tid[R196_MAXTHREADS];
+  pthread_barrier_t go,
+                    done;
+  char *dst;
+  const char *src;
+  size_t len;
+  struct r196_slice slice[2 * R196_MAXTHREADS]; /* bottom to top */
+} R196_Pool;
+
+/**
+ * thread 'k' does slice k and its mirror
+ */
+static void r196_pool_work(unsigned k)
+{
+  struct r196_slice *lo = R196_Pool.slice + k,
+                    *hi = R196_Pool.slice + 2 * R196_Pool.threads - 1 - k;
+  lo->diff = hi->diff = 0;
+  lo->cout = R196_range(R196_Pool.dst, R196_Pool.src, R196_Pool.len,
+                        lo->lo, lo->hi, 0, &lo->diff);
+  hi->cout = R196_range(R196_Pool.dst, R196_Pool.src, R196_Pool.len,
+                        hi->lo, hi->hi, 0, &hi->diff);
+}
+
+static void * r196_pool_thread(void *arg)
+{
+  unsigned k = (unsigned)(size_t)arg;
+  for (;;) {
+    pthread_barrier_wait(&R196_Pool.go);
+    if (R196_Pool.quit)
+      break;
+    r196_pool_work(k);
+    pthread_barrier_wait(&R196_Pool.done);
+  }
+  return NULL;
+}
+
+/**
+ * start 'threads'-1 workers; the calling thread is the last one
+ */
+static void r196_pool_start(unsigned threads)
+{
+  unsigned k;
+  if (threads > R196_MAXTHREADS)
+    threads = R196_MAXTHREADS;
+  if (threads < 1)
+    threads = 1;
+  R196_Pool.threads = threads;
+  R196_Pool.quit = 0;
+  pthread_barrier_init(&R196_Pool.go, NULL, threads);
+  pthread_barrier_init(&R196_Pool.done, NULL, threads);
+  for (k = 1; k < threads; k++)
+    if (0 != pthread_create(R196_Pool.tid + k, NULL, r196_pool_thread, (void *)(size_t)k)) {
+      perror("pthread_create");
+      exit(EXIT_FAILURE);
+    }
+}
+
+static void r196_pool_stop(void)
+{
+  unsigned k;
+  R196_Pool.quit = 1;
+  pthread_barrier_wait(&R196_Pool.go);
+  for (k = 1; k < R196_Pool.threads; k++)
+    pthread_join(R196_Pool.tid[k], NULL);
+  pthread_barrier_destroy(&R196_Pool.go);
+  pthread_barrier_destroy(&R196_Pool.done);
+  R196_Pool.threads = 0;
+}
+
+/**
+ * add 1 to digits [lo, hi); returns the carry out of the top
+ */
+static unsigned r196_increment(char *dst, size_t lo, size_t hi)
+{
+  while (lo < hi && 9 == dst[lo])
+    dst[lo++] = 0;
+  if (lo == hi)
+    return 1;
+  dst[lo]++;
+  return 0;
+}
+
+/**
+ * dst = src + Rev(src) across the thread pool, or on this thread alone if
+ * the number is too short to be worth it or there is no pool
+ */
+size_t r196_mt(char *dst, const char *src, size_t len, int *pal)
+{
+  unsigned n = R196_Pool.threads,
+           k,
+           carry = 0;
+  size_t half = (len + 1) / 2;
+  int diff = 0;
+  if (n < 2 || len < R196_MT_MIN) {
+    len = r196_finish(dst, len, R196_range(dst, src, len, 0, len, 0, &diff));
+    *pal = !diff;
+    return len;
+  }
+  for (k = 0; k < n; k++) {
+    struct r196_slice *lo = R196_Pool.slice + k,
+                      *hi = R196_Pool.slice + 2 * n - 1 - k;
+    lo->lo = half * k / n;
+    lo->hi = half * (k + 1) / n;
+    hi->lo = len - lo->hi < half ? half : len - lo->hi; /* odd len: middle digit is low's */
+    hi->hi = len - lo->lo;
+  }
+  R196_Pool.dst = dst;
+  R196_Pool.src = src;
+  R196_Pool.len = len;
+  pthread_barrier_wait(&R196_Pool.go);
+  r196_pool_work(0);
+  pthread_barrier_wait(&R196_Pool.done);
+  /* carry lookahead, bottom to top */
+  for (k = 0; k < 2 * n; k++) {
+    struct r196_slice *s = R196_Pool.slice + k;
+    diff |= s->diff;
+    carry = s->cout | (carry ? r196_increment(dst, s->lo, s->hi) : 0);
+  }
+  *pal = !diff;
+  return r196_finish(dst, len, carry);
+}
+#endif /* WIN32 */
+
+static size_t (*R196_add)(char *, const char *, size_t, int *) = r196_w64;
+
+static void r196_init(void)
+{
+  r196_spread_init();
+#ifdef CAN_SIMD
+  if (simd_supported(SIMD_AVX2)) {
+    R196_add = r196_avx2;
+    R196_range = r196_avx2_range;
+  }
+#endif
+}
+
+/**
+ * the state of a search
+ */
+typedef struct {
+  unsigned long long iter; /* reverse-and-adds done so far */
+  size_t len,   /* digits in 'd' */
+         alloc; /* digits 'd' and 't' have room for */
+  char *d,      /* the number, least significant digit first */
+       *t;      /* where the next one goes */
+} r196;
+
+static void r196_reserve(r196 *r, size_t len)
+{
+  if (len > r->alloc) {
+    size_t alloc = r->alloc ? r->alloc : 1024;
+    while (alloc < len)
+      alloc *= 2;
+    r->d = realloc(r->d, alloc);
+    r->t = realloc(r->t, alloc);
+    assert(r->d);
+    assert(r->t);
+    r->alloc = alloc;
+  }
+}
+
+/**
+ * start from the decimal number 'num'
+ */
+static void r196_set(r196 *r, const char *num)
+{
+  size_t len = strlen(num),
+         i;
+  r->iter = 0;
+  r196_reserve(r, len + 1);
+  for (i = 0; i < len; i++) {
+    assert(num[len-1-i] >= '0' && num[len-1-i] <= '9');
+    r->d[i] = num[len-1-i] - '0';
+  }
+  r->len = len;
+}
+
+static void r196_free(r196 *r)
+{
+  free(r->d);
+  free(r->t);
+  r->d = r->t = NULL;
+  r->len = r->alloc = 0;
+}
+
+/**
+ * one reverse-and-add; returns non-zero if the number we had was a
+ * palindrome, in which case nothing changes
+ */
+static int r196_step(r196 *r)
+{
+  char *tmp;
+  size_t len;
+  int pal;
+  r196_reserve(r, r->len + 1);
+  len = R196_add(r->t, r->d, r->len, &pal);
+  if (pal)
+    return 1;
+  tmp = r->d, r->d = r->t, r->t = tmp;
+  r->len = len;
+  r->iter++;
+  return 0;
+}
+
+/*
+ * checkpoint file: a fixed header and then the digits packed two to a byte,
+ * BCD, least significant first.
+ * it's written to "<file>.tmp" and renamed over the old one, so a crash
+ * mid-write leaves the previous checkpoint intact
+ */
+#define R196_MAGIC   "R196"
+#define R196_VERSION 1
+
+struct r196_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t iter,
+           len;
+};
+
+static int r196_save(const r196 *r, const char *path)
+{
+  char tmp[4096];
+  struct r196_header h;
+  FILE *f;
+  size_t i;
+  int ok;
+  snprintf(tmp, sizeof tmp, "%s.tmp", path);
+  if (NULL == (f = fopen(tmp, "wb"))) {
+    perror(tmp);
+    return 0;
+  }
+  memcpy(h.magic, R196_MAGIC, sizeof h.magic);
+  h.version = R196_VERSION;
+  h.iter = r->iter;
+  h.len = r->len;
+  ok = 1 == fwrite(&h, sizeof h, 1, f);
+  for (i = 0; ok && i < r->len; i += 2) {
+    int c = r->d[i] | (i + 1 < r->len ? r->d[i+1] << 4 : 0);
+    ok = EOF != putc(c, f);
+  }
+  ok = (0 == fclose(f)) && ok;
+  if (ok && 0 != rename(tmp, path)) {
+    perror(path);
+    ok = 0;
+  }
+  return ok;
+}
+
+/**
+ * resume from a checkpoint; returns 0 if there isn't a usable one
+ */
+static int r196_load(r196 *r, const char *path)
+{
+  struct r196_header h;
+  FILE *f = fopen(path, "rb");
+  size_t i;
+  if (NULL == f) {
+    if (ENOENT != errno)
+      perror(path);
+    return 0;
+  }
+  if (1 != fread(&h, sizeof h, 1, f) ||
+      0 != memcmp(h.magic, R196_MAGIC, sizeof h.magic) ||
+      R196_VERSION != h.version) {
+    fprintf(stderr, "%s: not a checkpoint\n", path);
+    fclose(f);
+    return 0;
+  }
+  r196_reserve(r, (size_t)h.len + 1);
+  for (i = 0; i < h.len; i += 2) {
+    int c = getc(f);
+    if (EOF == c || (c & 0xF) > 9 || (c >> 4) > 9) {
+      fprintf(stderr, "%s: truncated or corrupt\n", path);
+      fclose(f);
+      return 0;
+    }
+    r->d[i] = c & 0xF;
+    if (i + 1 < h.len)
+      r->d[i+1] = c >> 4;
+  }
+  fclose(f);
+  r->iter = h.iter;
+  r->len = (size_t)h.len;
+  return 1;
+}
+
+static double now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
 }
 
+static volatile sig_atomic_t R196_Stop = 0;
+
+static void r196_sigint(int sig)
+{
+  (void)sig;
+  R196_Stop = 1;
+}
+
+#define R196_REPORT     10 /* seconds between progress lines */
+#define R196_CHECKPOINT 600 /* seconds between checkpoints */
+
+/**
+ * usage: strrev 196 [number [checkpoint-file [max-digits [threads]]]]
+ *
+ * reverse-and-add 'number' (default 196) until it's a palindrome, it has
+ * more than max-digits digits, or we get a SIGINT. if checkpoint-file exists
+ * we pick up where it left off rather than starting from 'number'.
+ * threads defaults to one per online CPU.
+ */
+static int r196_main(int argc, char *argv[])
+{
+  const char *num = argc > 1 ? argv[1] : "196",
+             *ckpt = argc > 2 && *argv[2] ? argv[2] : NULL;
+  size_t maxlen = argc > 3 ? (size_t)strtoull(argv[3], NULL, 10) : (size_t)-2;
+  r196 r = { 0, 0, 0, NULL, NULL };
+  double start = now(),
+         last = start,
+         saved = start,
+         digits = 0; /* digits processed since 'last' */
+  int pal = 0;
+#ifndef WIN32
+  long threads = argc > 4 ? atol(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  r196_init();
+#ifndef WIN32
+  if (threads > 1) {
+    r196_pool_start((unsigned)threads);
+    R196_add = r196_mt;
+  }
+#endif
+  if (!ckpt || !r196_load(&r, ckpt))
+    r196_set(&r, num);
+  else
+    printf("resuming at iteration %llu, %lu digits\n",
+      r.iter, (unsigned long)r.len);
+  signal(SIGINT, r196_sigint);
+  while (!R196_Stop && r.len <= maxlen) {
+    double t;
+    digits += r.len;
+    if ((pal = r196_step(&r)))
+      break;
+    if (0 == (r.iter & 0xFF) && (t = now()) - last >= R196_REPORT) {
+      printf("iteration %llu: %lu digits, %.3g digits/sec\n",
+        r.iter, (unsigned long)r.len, digits / (t - last));
+      fflush(stdout);
+      last = t;
+      digits = 0;
+      if (ckpt && t - saved >= R196_CHECKPOINT) {
+        r196_save(&r, ckpt);
+        saved = t;
+      }
+    }
+  }
+  if (pal) {
+    size_t i = r.len;
+    printf("palindrome after %llu iterations: ", r.iter);
+    if (r.len <= 1000)
+      while (i--)
+        putchar('0' + r.d[i]);
+    else
+      printf("(%lu digits)", (unsigned long)r.len);
+    putchar('\n');
+  } else {
+    printf("stopped at iteration %llu, %lu digits, %.1f sec\n",
+      r.iter, (unsigned long)r.len, now() - start);
+  }
+  if (ckpt)
+    r196_save(&r, ckpt);
+  r196_free(&r);
+#ifndef WIN32
+  if (R196_Pool.threads)
+    r196_pool_stop();
+#endif
+  return 0;
+}
+
+/**
+ * test a reverse-and-add kernel against known sequences and against
+ * r196_obvious
+ */
+static void test_r196(size_t (*f)(char *, const char *, size_t, int *))
+{
+  static const char * const Seq196[] = {
+    "196", "887", "1675", "7436", "13783", "52514", "94039", "187088",
+    "1067869", "10755470", "18211171"
+  };
+  char a[1024], b[1024], c[1024];
+  size_t len, i, n;
+  int pal, pal2;
+  /* 196, as far as mathworld lists it */
+  for (i = 0; i + 1 < sizeof Seq196 / sizeof Seq196[0]; i++) {
+    len = strlen(Seq196[i]);
+    for (n = 0; n < len; n++)
+      a[n] = Seq196[i][len-1-n] - '0';
+    n = f(b, a, len, &pal);
+    assert(!pal);
+    assert(n == strlen(Seq196[i+1]));
+    for (len = 0; len < n; len++)
+      assert(b[len] == Seq196[i+1][n-1-len] - '0');
+  }
+  /* 89 is the famous slow one: 24 steps to 8813200023188 */
+  a[0] = 9, a[1] = 8, len = 2;
+  for (i = 0; ; i++) {
+    n = f(b, a, len, &pal);
+    if (pal)
+      break;
+    memcpy(a, b, n);
+    len = n;
+  }
+  assert(24 == i);
+  assert(13 == len);
+  for (n = 0; n < len; n++)
+    assert(a[len-1-n] == "8813200023188"[n] - '0');
+  /* and everything else, especially carries across block boundaries */
+  for (len = 0; len < 600; len++) {
+    for (n = 0; n < len; n++)
+      a[n] = (char)(len % 3 ? rand() % 10 : 9 - (rand() % 10 == 0)); /* lots of 9s */
+    memset(b, 0x7F, sizeof b);
+    memset(c, 0x7F, sizeof c);
+    n = r196_obvious(c, a, len, &pal);
+    assert(n == f(b, a, len, &pal2));
+    assert(pal == pal2);
+    assert(0 == memcmp(b, c, n));
+    assert(0x7F == b[n]);
+  }
+  for (len = 1; len < 200; len++) { /* palindromes */
+    for (n = 0; n < (len + 1) / 2; n++)
+      a[n] = a[len-1-n] = (char)(rand() % 10);
+    f(b, a, len, &pal);
+    assert(pal);
+  }
+}
+
+#define R196_BENCHLEN (MAXLEN/8) /* cost grows with the square of this */
+
+static r196 Run_r196;
+static double Run_digits; /* digits processed by the last trial */
+
+/**
+ * one trial: run 196 out to R196_BENCHLEN digits
+ */
+static void trial_r196(void *unused)
+{
+  (void)unused;
+  Run_digits = 0;
+  r196_set(&Run_r196, "196");
+  while (Run_r196.len < R196_BENCHLEN) {
+    int pal;
+    Run_digits += Run_r196.len;
+    pal = r196_step(&Run_r196);
+    assert(!pal);
+  }
+  bench_escape(Run_r196.d);
+}
+
+/**
+ * time a reverse-and-add kernel running 196 out to R196_BENCHLEN digits
+ */
+static void run_r196(const char *name, size_t (*f)(char *, const char *, size_t, int *))
+{
+  test_r196(f);
+  R196_add = f;
+  trial_r196(NULL); /* how much work is a trial? */
+  bench_run(name, trial_r196, NULL, Run_digits);
+  r196_free(&Run_r196);
+}
+
+#ifndef WIN32
+
+#define R196_MT_BENCHLEN (8*1024*1024)
+#define R196_MT_REPS 16
+
+/**
+ * r196_mt against the single-threaded kernel on a number whose slices are
+ * mostly runs of digit sums of 9, so carries have to cross from one slice
+ * into the next, sometimes through several of them
+ */
+static void test_r196_mt(r196 *r)
+{
+  size_t len = R196_MT_MIN * 3 + 7,
+         i, n, m;
+  char *ref;
+  int pal, pal2;
+  r196_reserve(r, len + 1);
+  for (i = 0; i < len / 2; i++) {
+    r->d[i] = (char)(rand() % 10);
+    r->d[len-1-i] = (char)(9 - r->d[i]);
+    if (rand() % 100000 == 0) /* now and then, a generate */
+      r->d[len-1-i] += r->d[len-1-i] < 9;
+  }
+  r->d[len/2] = 4;
+  r->d[0] = r->d[len-1] = 5; /* and a carry in at the bottom */
+  n = r196_mt(r->t, r->d, len, &pal);
+  ref = malloc(len + 1);
+  assert(ref);
+  m = r196_obvious(ref, r->d, len, &pal2);
+  assert(n == m);
+  assert(pal == pal2);
+  assert(0 == memcmp(r->t, ref, n));
+  free(ref);
+}
+
+static char *Run_number; /* the R196_MT_BENCHLEN digits each trial starts from */
+
+/**
+ * one trial: R196_MT_REPS reverse-and-adds of Run_number
+ */
+static void trial_r196_mt(void *unused)
+{
+  unsigned i;
+  (void)unused;
+  memcpy(Run_r196.d, Run_number, R196_MT_BENCHLEN);
+  Run_r196.len = R196_MT_BENCHLEN;
+  for (i = 0; i < R196_MT_REPS; i++) {
+    int pal = r196_step(&Run_r196);
+    assert(!pal);
+  }
+  bench_escape(Run_r196.d);
+}
+
+/**
+ * time r196_mt on an R196_MT_BENCHLEN-digit number using 1 to 'maxthreads'
+ * threads
+ */
+static void run_r196_mt(unsigned maxthreads)
+{
+  size_t (*add)(char *, const char *, size_t, int *) = R196_add;
+  unsigned n, i;
+  R196_add = r196_mt;
+  Run_number = malloc(R196_MT_BENCHLEN);
+  assert(Run_number);
+  for (i = 0; i < R196_MT_BENCHLEN; i++)
+    Run_number[i] = (char)(rand() % 10);
+  for (n = 1; n <= maxthreads && n <= R196_MAXTHREADS; n++) {
+    char name[32];
+    r196_pool_start(n);
+    test_r196_mt(&Run_r196);
+    r196_reserve(&Run_r196, R196_MT_BENCHLEN + R196_MT_REPS + 1);
+    snprintf(name, sizeof name, "%u threads", n);
+    bench_run(name, trial_r196_mt, NULL, (double)R196_MT_BENCHLEN * R196_MT_REPS);
+    r196_pool_stop();
+  }
+  r196_free(&Run_r196);
+  free(Run_number);
+  R196_add = add;
+}
+
+#endif /* WIN32 */
+
 /* Stringification */
 #define S(str)  S_(str)
 #define S_(str)  #str
@@ -1812,11 +3082,19 @@ static void run(const char *name, void (*f)(char *, const char *, unsigned))
 /* handy macro so i can get the function name as a string and a symbol
  * from the same input, saves me typing and protects against human error */
 #define V(f) run(S(f), f)
+#define VI(f) run_inplace(S(f), f)
 
-int main(void)
+int main(int argc, char *argv[])
 {
-  printf("%28s %5s %7s\n", "function", "sec", "speedup");
+#ifdef CAN_SIMD
+  unsigned i;
+#endif
+  if (argc > 1 && 0 == strcmp(argv[1], "196"))
+    return r196_main(argc - 1, argv + 1);
   srand(time(NULL));
+  bench_init(1, 5);
+  bench_section("function", "MB/s");
+  simd_init();
   V(obvious);
   V(obvious); /* run twice to get the CPU warmed up */
   V(byte4_w32);
@@ -1849,6 +3127,21 @@ int main(void)
   V(byte256_w128);
 #endif
   V(byte512_w64);
+#ifdef CAN_SIMD
+  for (i = 0; i < sizeof Simd / sizeof Simd[0]; i++)
+    if (simd_supported(Simd[i].feat))
+      run(Simd[i].name, Simd[i].f);
+#endif
+  V(byte_simd);
+  VI(inplace_obvious);
+  VI(inplace_w64);
+  VI(inplace_w64x4);
+#ifdef CAN_SIMD
+  for (i = 0; i < sizeof Simd / sizeof Simd[0]; i++)
+    if (Simd[i].fi && simd_supported(Simd[i].feat))
+      run_inplace(Simd[i].iname, Simd[i].fi);
+#endif
+  VI(inplace_simd);
   V(obvious_prefetch);
   V(obvious_check);
   V(obvious_pointer);
@@ -1869,6 +3162,18 @@ int main(void)
   V(byte8_unroll);
   V(byte8_subloop);
   V(obvious);
+  r196_init();
+  bench_section("196", "digits/s");
+  run_r196("r196_obvious", r196_obvious);
+  run_r196("r196_w64", r196_w64);
+#ifdef CAN_SIMD
+  if (simd_supported(SIMD_AVX2))
+    run_r196("r196_avx2", r196_avx2);
+#endif
+#ifndef WIN32
+  bench_section("196 threads", "digits/s");
+  run_r196_mt((unsigned)sysconf(_SC_NPROCESSORS_ONLN));
+#endif
   return 0;
 }
 
@@ -5,11 +5,41 @@
  * Start simple and see what happens...
  * Later: Hmmm, seems to actually work. A terrific way to turn 1 char into 3 pointers...
  * TODO: add remove, add ability to iterate through all full strings that prefix a given string...
+ * Later still: each complete string gets its own '\0' child. Pointing them all back at
+ * the top node meant adding "hell" after "he" walked top's siblings and hung 'l' off it.
+ *
+ * For big dictionaries that are built once and then only searched, trie_freeze() packs
+ * a struct trie into LOUDS (level-order unary degree sequence): nodes numbered breadth
+ * first, each one's child count written as that many 1 bits and a 0,
+ *
+ *   he, hell, hello, hi   ->   10 | 10   | 110 | 10 | 0 | 10 | 10 | 0
+ *                                     root   h     e    i   l    l    o
+ *
+ * so a node's children are the consecutive ids  select0(v+1)-v .. select0(v+2)-v-1,
+ * plus an array of their labels (as indexes into the alphabet, usually 1 byte) and a bit
+ * per node for "a string ends here". ~1.4 bytes a node rather than a malloc()ed 24.
+ *
+ * Those arrays are all there is to it, so trie_frozen_save() writes them to a file as
+ * they are and trie_frozen_map() uses them in place from an mmap() of it: a worker is
+ * ready as soon as the header and a checksum are checked, and they all share the pages.
  */
 
+#ifdef BENCH
+#include "bench.h" /* first; it wants _GNU_SOURCE */
+#endif
+#ifndef _GNU_SOURCE
+# define _POSIX_C_SOURCE 200809L /* fsync(), fileno() */
+#endif
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "trie1.h"
 
 static void do_trie_dump(const struct trie *top, const struct trie *t, unsigned level)
@@ -19,12 +49,10 @@ static void do_trie_dump(const struct trie *top, const struct trie *t, unsigned
 		printf("%.*s%p \\0\n", level, Indent, (void*)t);
 	else
 		printf("%.*s%p %lc\n", level, Indent, (void*)t, t->c);
-	if (t != top || level == 0) {
-		if (t->child)
-			do_trie_dump(top, t->child, level+1);
-		if (t->next)
-			do_trie_dump(top, t->next, level);
-	}
+	if (t->child)
+		do_trie_dump(top, t->child, level+1);
+	if (t->next && t != top)
+		do_trie_dump(top, t->next, level);
 }
 
 void trie_dump(const struct trie *t)
@@ -32,9 +60,49 @@ void trie_dump(const struct trie *t)
 	do_trie_dump(t, t, 0);
 }
 
-static struct trie * trie_alloc(const wchar_t c)
+/*
+ * nodes come out of blocks owned by the top node, each twice the size of the
+ * last up to TRIE_BLOCK_MAX, rather than a malloc() apiece; they're handed out
+ * in order so a fresh trie's nodes sit close together, trie_del()ed ones go
+ * on a free list for the next trie_add(), and trie_free() frees blocks.
+ */
+#define TRIE_BLOCK_MIN 64
+#define TRIE_BLOCK_MAX 65536
+
+struct trie_block {
+	struct trie_block *next;
+	size_t len,
+	       used;
+	struct trie node[];
+};
+
+struct trie_top {
+	struct trie top; /* first; what trie_new() gives out */
+	struct trie_block *blocks;
+	struct trie *free; /* linked through next */
+};
+
+#define TOP(t) ((struct trie_top *)(t))
+
+static struct trie * trie_alloc(struct trie_top *top, const wchar_t c)
 {
-	struct trie *t = malloc(sizeof *t);
+	struct trie *t = top->free;
+	if (t) {
+		top->free = t->next;
+	} else {
+		struct trie_block *b = top->blocks;
+		if (!b || b->used == b->len) {
+			size_t len = b ? b->len * 2 : TRIE_BLOCK_MIN;
+			if (len > TRIE_BLOCK_MAX)
+				len = TRIE_BLOCK_MAX;
+			b = malloc(sizeof *b + len * sizeof b->node[0]);
+			b->len = len;
+			b->used = 0;
+			b->next = top->blocks;
+			top->blocks = b;
+		}
+		t = &b->node[b->used++];
+	}
 	t->c = c;
 	t->next = NULL;
 	t->child = NULL;
@@ -42,37 +110,51 @@ static struct trie * trie_alloc(const wchar_t c)
 }
 
 /*
- * convenience function; all nodes should be malloc()ed anyway
+ * the top node; it owns every node added under it, so only ever pass it,
+ * not one of those, to the functions below
  */
 struct trie * trie_new(void)
 {
-	return trie_alloc(L'\0');
+	struct trie_top *top = malloc(sizeof *top);
+	top->top.c = L'\0';
+	top->top.next = NULL;
+	top->top.child = NULL;
+	top->blocks = NULL;
+	top->free = NULL;
+	return &top->top;
 }
 
 /*
- * release all memory held by trie and children, depth first
+ * release all memory held by trie and children, a block at a time
  */
-static void do_trie_free(struct trie *t)
+void trie_free(struct trie *t)
 {
-	if (t->next) do_trie_free(t->next);
-	if (t->c) {
-		if (t->child) do_trie_free(t->child);
-		free(t);
+	struct trie_block *b = TOP(t)->blocks;
+	while (b) {
+		struct trie_block *next = b->next;
+		free(b);
+		b = next;
 	}
+	free(TOP(t)); /* finally free top node */
 }
 
-void trie_free(struct trie *t)
+/*
+ * memory held in blocks, used or not
+ */
+size_t trie_bytes(const struct trie *t)
 {
-	if (t->next) do_trie_free(t->next);
-	if (t->child) do_trie_free(t->child);
-	if (!t->c) free(t); /* finally free top node */
+	const struct trie_block *b;
+	size_t bytes = sizeof(struct trie_top);
+	for (b = TOP(t)->blocks; b; b = b->next)
+		bytes += sizeof *b + b->len * sizeof b->node[0];
+	return bytes;
 }
 
-static struct trie * do_trie_find_or_add(struct trie *parent, const wchar_t c)
+static struct trie * do_trie_find_or_add(struct trie_top *top, struct trie *parent, const wchar_t c)
 {
 	struct trie *s = parent->child;
 	if (!parent->child)
-		return (parent->child = trie_alloc(c));
+		return (parent->child = trie_alloc(top, c));
 	while (s->c < c && s->next && s->next->c < c)
 		s = s->next;
 	if (s->c == c)
@@ -80,7 +162,7 @@ static struct trie * do_trie_find_or_add(struct trie *parent, const wchar_t c)
 	else if (s->next && s->next->c == c)
 		return s->next;
 	{
-		struct trie *n = trie_alloc(c);
+		struct trie *n = trie_alloc(top, c);
 		if (s->c > c) {
 			n->next = s;
 			if (s == parent->child)
@@ -95,10 +177,10 @@ static struct trie * do_trie_find_or_add(struct trie *parent, const wchar_t c)
 
 void trie_add(struct trie *t, const wchar_t *str)
 {
-	struct trie *top = t;
+	struct trie_top *top = TOP(t);
 	while (*str)
-		t = do_trie_find_or_add(t, *str++);
-	t->child = top; /* point all \0 at the same place. brilliant! */
+		t = do_trie_find_or_add(top, t, *str++);
+	do_trie_find_or_add(top, t, L'\0'); /* sorts first; marks a complete string */
 }
 
 int trie_find(const struct trie *t, const wchar_t *str)
@@ -112,57 +194,982 @@ int trie_find(const struct trie *t, const wchar_t *str)
 	return t && !t->c; /* didn't run out of nodes; ended on '\0' */
 }
 
+static int do_trie_del(struct trie_top *top, struct trie *t, const wchar_t *str)
+{
+	/* seek all the way down to the '\0', delete it... */
+	struct trie **link = &t->child;
+	while (*link && (*link)->c < *str)
+		link = &(*link)->next;
+	if (!*link || (*link)->c != *str)
+		return 0; /* not found */
+	if (*str && !do_trie_del(top, *link, str+1))
+		return 0;
+	/* string found, delete upwards anything nothing else hangs off */
+	if (!(*link)->child) {
+		struct trie *dead = *link;
+		*link = dead->next;
+		dead->next = top->free;
+		top->free = dead;
+	}
+	return 1;
+}
+
 /*
  * if a complete entry for str is found, recursively delete from the bottom up any
  * components not shared by another string
  */
 int trie_del(struct trie *t, const wchar_t *str)
 {
-	/* seek all the way down, delete end... */
-	if (*str) {
-		struct trie *parent = t;
-		t = t->child;
-		while (t && t->c < *str)
-			t = t->next;
-		if (!t || t->c != *str || !trie_del(t, str+1))
-			return 0; /* not found */
-		/* string found, attempt to delete upwards... */
-		if (!t->child || !t->child->c) {
-			/* remove references from parent or siblings */
-			if (parent->child == t) { /* first child */
-				parent->child = t->next;
-			} else { /* middle child */
-				struct trie *sib = parent->child;
-				while (sib->next != t)
-					sib = sib->next;
-				sib->next = sib->next->next;
+	return do_trie_del(TOP(t), t, str);
+}
+
+/*
+ * given 'str', iterate through it and t. at each character if we have a complete
+ * string in t, run f on it
+ */
+int trie_prefix_each(const struct trie *t, const wchar_t *str, trie_prefix_fn *f, void *arg)
+{
+	const wchar_t *orig = str;
+	int stop;
+	for (; *str; str++) {
+		for (t = t->child; t && t->c < *str; t = t->next)
+			;
+		if (!t || t->c != *str)
+			break;
+		/* full strings will have first child where !c */
+		if (t->child && !t->child->c && (stop = f(orig, (size_t)(str-orig+1), arg)))
+			return stop;
+	}
+	return 0;
+}
+
+static int prefix_print(const wchar_t *str, size_t len, void *arg)
+{
+	(void)arg;
+	printf("%.*ls\n", (int)len, str);
+	return 0;
+}
+
+void trie_prefix_all_strings(const struct trie *t, const wchar_t *str)
+{
+	trie_prefix_each(t, str, prefix_print, NULL);
+}
+
+/************************* frozen ****/
+
+#define TRIE_SEL0 256 /* select0 directory: where every 256th 0 bit is */
+
+struct trie_frozen {
+	size_t nodes;      /* root is 0 */
+	uint64_t *louds;   /* 2*nodes+1 bits: "10", then each node's degree in unary */
+	uint32_t *sel0;    /* position of 0 bit number k*TRIE_SEL0 + 1 */
+	uint64_t *term;    /* a bit per node: a complete string ends here */
+	unsigned lwidth;   /* bytes per label: 1, 2 or 4 */
+	void *label;       /* per node, in alphabet order among siblings */
+	size_t nalpha;
+	wchar_t *alpha;    /* label -> char, sorted */
+	uint32_t low[256]; /* char < 256 -> label, ~0 if not in alpha */
+	void *map;         /* trie_frozen_map()ed: everything above points in here */
+	size_t maplen;
+};
+
+static int bit(const uint64_t *b, size_t i)
+{
+	return (int)(b[i / 64] >> (i % 64) & 1);
+}
+
+static void setbit(uint64_t *b, size_t i)
+{
+	b[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/*
+ * position of the k'th (from 1) 0 bit in louds
+ */
+static size_t select0(const struct trie_frozen *f, size_t k)
+{
+	size_t pos = f->sel0[(k - 1) / TRIE_SEL0],
+	       w = pos / 64;
+	unsigned left = (unsigned)((k - 1) % TRIE_SEL0); /* zeros still to skip after pos */
+	uint64_t z = ~f->louds[w] & (~(uint64_t)0 << (pos % 64));
+	unsigned n;
+	while (left >= (n = (unsigned)__builtin_popcountll(z))) {
+		left -= n;
+		z = ~f->louds[++w];
+	}
+	while (left--)
+		z &= z - 1;
+	return w * 64 + (unsigned)__builtin_ctzll(z);
+}
+
+static uint32_t label_at(const struct trie_frozen *f, size_t v)
+{
+	switch (f->lwidth) {
+	case 1: return ((const uint8_t *)f->label)[v];
+	case 2: return ((const uint16_t *)f->label)[v];
+	default: return ((const uint32_t *)f->label)[v];
+	}
+}
+
+/*
+ * char -> label, ~0 if it appears nowhere in the trie
+ */
+static uint32_t label_of(const struct trie_frozen *f, wchar_t c)
+{
+	size_t lo = 0,
+	       hi = f->nalpha;
+	if (c >= 0 && c < 256)
+		return f->low[c];
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (f->alpha[mid] < c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < f->nalpha && f->alpha[lo] == c ? (uint32_t)lo : ~(uint32_t)0;
+}
+
+/*
+ * the child of v labelled l, 0 if there isn't one (0 is the root, never a child)
+ */
+static size_t frozen_child(const struct trie_frozen *f, size_t v, uint32_t l)
+{
+	size_t p = select0(f, v + 1),
+	       lo = p - v,
+	       hi;
+	/* the next 0 is almost always in the same word */
+	for (hi = p + 1; bit(f->louds, hi); hi++)
+		;
+	hi = hi - v - 1;
+	while (hi - lo > 8) {
+		size_t mid = (lo + hi) / 2;
+		if (label_at(f, mid) < l)
+			lo = mid + 1;
+		else
+			hi = mid + 1; /* mid may be it */
+	}
+	for (; lo < hi; lo++) {
+		uint32_t x = label_at(f, lo);
+		if (x >= l)
+			return x == l ? lo : 0;
+	}
+	return 0;
+}
+
+static int alpha_cmp(const void *a, const void *b)
+{
+	wchar_t x = *(const wchar_t *)a,
+	        y = *(const wchar_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * count the nodes that aren't '\0' markers, and collect every char used
+ */
+static void do_trie_census(const struct trie *t, size_t *nodes, wchar_t **alpha, size_t *nalpha, size_t *alloc)
+{
+	for (; t; t = t->next) {
+		if (!t->c)
+			continue;
+		++*nodes;
+		if (!*nalpha || !bsearch(&t->c, *alpha, *nalpha, sizeof **alpha, alpha_cmp)) {
+			size_t i = *nalpha;
+			if (*nalpha == *alloc) {
+				*alloc = *alloc ? *alloc * 2 : 64;
+				*alpha = realloc(*alpha, *alloc * sizeof **alpha);
+			}
+			while (i && (*alpha)[i-1] > t->c) {
+				(*alpha)[i] = (*alpha)[i-1];
+				i--;
 			}
-			free(t);
+			(*alpha)[i] = t->c;
+			++*nalpha;
 		}
+		if (t->child)
+			do_trie_census(t->child, nodes, alpha, nalpha, alloc);
 	}
-	return 1;
 }
 
 /*
- * given 'str', iterate through it and t. at each character if we have a complete
- * string in t, print it
- * TODO: what i really want to do is run a callback
+ * build the LOUDS form of t; t is untouched and can be freed afterwards
  */
-void trie_prefix_all_strings(const struct trie *t, const wchar_t *str)
+struct trie_frozen * trie_freeze(const struct trie *t)
 {
-	const wchar_t *orig = str;
-	if (*str)
-		t = t->child;
+	struct trie_frozen *f = calloc(1, sizeof *f);
+	const struct trie **queue;
+	size_t alloc = 0,
+	       nbits,
+	       head = 0,
+	       tail = 0,
+	       pos = 0,
+	       zeros = 0,
+	       i;
+	f->nodes = 1;
+	if (t->child)
+		do_trie_census(t->child, &f->nodes, &f->alpha, &f->nalpha, &alloc);
+	nbits = 2 * f->nodes + 1;
+	assert(nbits < UINT32_MAX);
+	f->lwidth = f->nalpha <= 0x100 ? 1 : f->nalpha <= 0x10000 ? 2 : 4;
+	f->louds = calloc(nbits / 64 + 2, sizeof *f->louds); /* +1 so the end-of-run scan can't run off */
+	f->sel0 = calloc((f->nodes + 1) / TRIE_SEL0 + 1, sizeof *f->sel0); /* the last may not get written; it still gets saved */
+	f->term = calloc(f->nodes / 64 + 1, sizeof *f->term);
+	f->label = calloc(f->nodes, f->lwidth);
+	for (i = 0; i < 256; i++)
+		f->low[i] = ~(uint32_t)0;
+	for (i = 0; i < f->nalpha && f->alpha[i] < 256; i++)
+		if (f->alpha[i] >= 0)
+			f->low[f->alpha[i]] = (uint32_t)i;
+	queue = malloc(f->nodes * sizeof *queue);
+	queue[tail++] = t;
+	setbit(f->louds, pos++); /* super-root: "10" */
+	f->sel0[zeros++ / TRIE_SEL0] = (uint32_t)pos++;
+	while (head < tail) {
+		const struct trie *n = queue[head],
+		                  *c;
+		for (c = n->child; c; c = c->next) {
+			if (!c->c) {
+				setbit(f->term, head);
+				continue;
+			}
+			switch (f->lwidth) {
+			case 1: ((uint8_t *)f->label)[tail] = (uint8_t)label_of(f, c->c); break;
+			case 2: ((uint16_t *)f->label)[tail] = (uint16_t)label_of(f, c->c); break;
+			default: ((uint32_t *)f->label)[tail] = label_of(f, c->c); break;
+			}
+			queue[tail++] = c;
+			setbit(f->louds, pos++);
+		}
+		if (0 == zeros % TRIE_SEL0)
+			f->sel0[zeros / TRIE_SEL0] = (uint32_t)pos;
+		zeros++;
+		pos++;
+		head++;
+	}
+	assert(pos == nbits && tail == f->nodes);
+	free(queue);
+	return f;
+}
+
+void trie_frozen_free(struct trie_frozen *f)
+{
+	if (f->map) {
+		munmap(f->map, f->maplen);
+		if (sizeof(wchar_t) != sizeof(uint32_t))
+			free(f->alpha);
+		free(f);
+		return;
+	}
+	free(f->louds);
+	free(f->sel0);
+	free(f->term);
+	free(f->label);
+	free(f->alpha);
+	free(f);
+}
+
+size_t trie_frozen_bytes(const struct trie_frozen *f)
+{
+	return sizeof *f
+		+ ((2 * f->nodes + 1) / 64 + 2) * sizeof *f->louds
+		+ ((f->nodes + 1) / TRIE_SEL0 + 1) * sizeof *f->sel0
+		+ (f->nodes / 64 + 1) * sizeof *f->term
+		+ f->nodes * f->lwidth
+		+ f->nalpha * sizeof *f->alpha;
+}
+
+/*
+ * same answers as trie_find(), including "" always being there
+ */
+int trie_frozen_find(const struct trie_frozen *f, const wchar_t *str)
+{
+	size_t v = 0;
+	if (!*str)
+		return 1;
 	do {
-		while (t && t->c < *str)
-			t = t->next;
-		/* full strings will have first child where !c */
-		if (t && t->child && !t->child->c)
-			printf("%.*ls\n", (int)(str-orig+1), orig);
-	} while (t && *str && (t->c == *str++) && (t = t->child));
+		uint32_t l = label_of(f, *str);
+		if (l == ~(uint32_t)0 || !(v = frozen_child(f, v, l)))
+			return 0;
+	} while (*++str);
+	return bit(f->term, v);
+}
+
+/*
+ * same as trie_prefix_each()
+ */
+int trie_frozen_prefix_each(const struct trie_frozen *f, const wchar_t *str, trie_prefix_fn *fn, void *arg)
+{
+	const wchar_t *orig = str;
+	size_t v = 0;
+	int stop;
+	for (; *str; str++) {
+		uint32_t l = label_of(f, *str);
+		if (l == ~(uint32_t)0 || !(v = frozen_child(f, v, l)))
+			break;
+		if (bit(f->term, v) && (stop = fn(orig, (size_t)(str-orig+1), arg)))
+			return stop;
+	}
+	return 0;
 }
 
+void trie_frozen_prefix_all_strings(const struct trie_frozen *f, const wchar_t *str)
+{
+	trie_frozen_prefix_each(f, str, prefix_print, NULL);
+}
+
+/************************* on disk ****/
+
+/*
+ * a frozen trie is a few flat arrays, so the file is those arrays as they
+ * are in memory, each at an offset the header gives, and trie_frozen_map()
+ * points a struct trie_frozen into an mmap() of it: no parsing, nothing
+ * copied, and every process mapping the file shares its pages.
+ *
+ *   header | louds | sel0 | term | label | alpha   (each TRIE_FILE_ALIGNed)
+ *
+ * numbers are in the writer's byte order, and a reader with the other one
+ * says so rather than byte-swap. alpha is written as 32-bit chars whatever
+ * wchar_t is. the header carries a CRC-32C of itself and one of the rest;
+ * they catch a truncated or damaged file, not a malicious one.
+ */
+#define TRIE_FILE_MAGIC    "trie1lds"
+#define TRIE_FILE_VERSION  1
+#define TRIE_FILE_ORDER    0x01020304
+#define TRIE_FILE_ALIGN    64
+#define TRIE_FILE_SECTIONS 5 /* louds, sel0, term, label, alpha */
+
+struct trie_file {
+	char magic[8];
+	uint32_t version,
+	         order;      /* TRIE_FILE_ORDER, as the writer stored it */
+	uint64_t size,       /* the whole file */
+	         nodes,
+	         nalpha;
+	uint32_t lwidth,
+	         sel0;       /* TRIE_SEL0 it was built with */
+	uint64_t off[TRIE_FILE_SECTIONS],
+	         len[TRIE_FILE_SECTIONS];
+	uint32_t crc,        /* of everything after the header */
+	         hcrc;       /* of the header, with this 0 */
+};
+
+#define ALIGN_UP(n, a) (((n) + (a) - 1) / (a) * (a))
+
+/*
+ * bytes in each array of a frozen trie this shape
+ */
+static void frozen_lens(size_t nodes, size_t nalpha, unsigned lwidth, size_t len[TRIE_FILE_SECTIONS])
+{
+	len[0] = ((2 * nodes + 1) / 64 + 2) * sizeof(uint64_t);
+	len[1] = ((nodes + 1) / TRIE_SEL0 + 1) * sizeof(uint32_t);
+	len[2] = (nodes / 64 + 1) * sizeof(uint64_t);
+	len[3] = nodes * lwidth;
+	len[4] = nalpha * sizeof(uint32_t);
+}
+
+/*
+ * CRC-32C (Castagnoli); SSE4.2 has an instruction for it
+ */
+static uint32_t crc32c_obvious(uint32_t crc, const unsigned char *p, size_t len)
+{
+	static uint32_t Table[256];
+	if (!Table[1]) {
+		uint32_t i,
+		         k,
+		         c;
+		for (i = 0; i < 256; i++) {
+			for (c = i, k = 0; k < 8; k++)
+				c = c >> 1 ^ (0x82F63B78 & -(c & 1));
+			Table[i] = c;
+		}
+	}
+	while (len--)
+		crc = crc >> 8 ^ Table[(crc ^ *p++) & 0xFF];
+	return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(WIN32)
+# define CAN_SSE42
+# include <immintrin.h>
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint64_t c = crc;
+	for (; len >= 8; len -= 8, p += 8) {
+		uint64_t w;
+		memcpy(&w, p, sizeof w);
+		c = _mm_crc32_u64(c, w);
+	}
+	return crc32c_obvious((uint32_t)c, p, len);
+}
+#endif
+
+static uint32_t crc32c(uint32_t crc, const void *p, size_t len)
+{
+#ifdef CAN_SSE42
+	if (__builtin_cpu_supports("sse4.2"))
+		return ~crc32c_sse42(~crc, p, len);
+#endif
+	return ~crc32c_obvious(~crc, p, len);
+}
+
+/*
+ * the arrays of f as they go in the file; alpha made 32-bit if need be
+ */
+static void frozen_sections(const struct trie_frozen *f, const void *sec[TRIE_FILE_SECTIONS], uint32_t **alpha32)
+{
+	*alpha32 = NULL;
+	sec[0] = f->louds;
+	sec[1] = f->sel0;
+	sec[2] = f->term;
+	sec[3] = f->label;
+	sec[4] = f->alpha;
+	if (sizeof(wchar_t) != sizeof(uint32_t) && f->nalpha) {
+		size_t i;
+		*alpha32 = malloc(f->nalpha * sizeof **alpha32);
+		for (i = 0; i < f->nalpha; i++)
+			(*alpha32)[i] = (uint32_t)f->alpha[i];
+		sec[4] = *alpha32;
+	}
+}
+
+/*
+ * the sections and the padding after each, to fp if it isn't NULL; returns
+ * their CRC-32C, or sets *err
+ */
+static uint32_t frozen_write(const struct trie_file *h, const void * const sec[], FILE *fp, int *err)
+{
+	static const unsigned char Zero[TRIE_FILE_ALIGN];
+	uint64_t pos = ALIGN_UP(sizeof *h, TRIE_FILE_ALIGN);
+	uint32_t crc = 0;
+	unsigned i;
+	for (i = 0; i <= TRIE_FILE_SECTIONS; i++) {
+		uint64_t to = i < TRIE_FILE_SECTIONS ? h->off[i] : h->size;
+		size_t pad = (size_t)(to - pos);
+		crc = crc32c(crc, Zero, pad);
+		if (fp && fwrite(Zero, 1, pad, fp) != pad)
+			*err = 1;
+		if (i == TRIE_FILE_SECTIONS)
+			break;
+		crc = crc32c(crc, sec[i], (size_t)h->len[i]);
+		if (fp && fwrite(sec[i], 1, (size_t)h->len[i], fp) != h->len[i])
+			*err = 1;
+		pos = to + h->len[i];
+	}
+	return crc;
+}
+
+/*
+ * write f to path, by way of path.tmp and rename(), so a process that has
+ * the old file mapped keeps it intact. 0 or -1 and errno
+ */
+int trie_frozen_save(const struct trie_frozen *f, const char *path)
+{
+	struct trie_file h;
+	unsigned char head[ALIGN_UP(sizeof h, TRIE_FILE_ALIGN)];
+	const void *sec[TRIE_FILE_SECTIONS];
+	size_t len[TRIE_FILE_SECTIONS];
+	uint64_t pos;
+	uint32_t *alpha32;
+	char *tmp = malloc(strlen(path) + sizeof ".tmp");
+	FILE *fp;
+	unsigned i;
+	int err = 0;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, TRIE_FILE_MAGIC, sizeof h.magic);
+	h.version = TRIE_FILE_VERSION;
+	h.order = TRIE_FILE_ORDER;
+	h.nodes = f->nodes;
+	h.nalpha = f->nalpha;
+	h.lwidth = f->lwidth;
+	h.sel0 = TRIE_SEL0;
+	frozen_lens(f->nodes, f->nalpha, f->lwidth, len);
+	pos = ALIGN_UP(sizeof h, TRIE_FILE_ALIGN);
+	for (i = 0; i < TRIE_FILE_SECTIONS; i++) {
+		h.off[i] = pos;
+		h.len[i] = len[i];
+		pos = ALIGN_UP(pos + len[i], TRIE_FILE_ALIGN);
+	}
+	h.size = pos;
+	frozen_sections(f, sec, &alpha32);
+	h.crc = frozen_write(&h, sec, NULL, &err);
+	h.hcrc = crc32c(0, &h, sizeof h);
+	strcat(strcpy(tmp, path), ".tmp");
+	if (!(fp = fopen(tmp, "wb"))) {
+		free(alpha32);
+		free(tmp);
+		return -1;
+	}
+	memset(head, 0, sizeof head);
+	memcpy(head, &h, sizeof h);
+	if (fwrite(head, sizeof head, 1, fp) != 1)
+		err = 1;
+	frozen_write(&h, sec, fp, &err);
+	if (fflush(fp) || fsync(fileno(fp)))
+		err = 1;
+	if (fclose(fp))
+		err = 1;
+	if (!err && rename(tmp, path))
+		err = 1;
+	if (err) {
+		int e = errno;
+		remove(tmp);
+		errno = e;
+	}
+	free(alpha32);
+	free(tmp);
+	return err ? -1 : 0;
+}
+
+/*
+ * is this a file of ours we can use as it is; EINVAL if it isn't ours or
+ * is from another version or byte order, EBADMSG if it's damaged
+ */
+static int frozen_file_ok(const struct trie_file *h, const unsigned char *map, size_t size, int flags)
+{
+	struct trie_file c = *h;
+	size_t len[TRIE_FILE_SECTIONS];
+	unsigned i;
+	errno = EINVAL;
+	if (memcmp(h->magic, TRIE_FILE_MAGIC, sizeof h->magic)
+	 || h->version != TRIE_FILE_VERSION
+	 || h->order != TRIE_FILE_ORDER)
+		return 0;
+	errno = EBADMSG;
+	c.hcrc = 0;
+	if (crc32c(0, &c, sizeof c) != h->hcrc)
+		return 0;
+	if (h->size != size
+	 || h->sel0 != TRIE_SEL0
+	 || (h->lwidth != 1 && h->lwidth != 2 && h->lwidth != 4)
+	 || !h->nodes || h->nodes >= UINT32_MAX / 2
+	 || h->nalpha > h->nodes)
+		return 0;
+	frozen_lens((size_t)h->nodes, (size_t)h->nalpha, h->lwidth, len);
+	for (i = 0; i < TRIE_FILE_SECTIONS; i++)
+		if (h->len[i] != len[i]
+		 || h->off[i] % sizeof(uint64_t)
+		 || h->off[i] < sizeof *h
+		 || h->off[i] > size
+		 || h->len[i] > size - h->off[i])
+			return 0;
+	if (!(flags & TRIE_MAP_NOCRC)
+	 && crc32c(0, map + ALIGN_UP(sizeof *h, TRIE_FILE_ALIGN), size - ALIGN_UP(sizeof *h, TRIE_FILE_ALIGN)) != h->crc)
+		return 0;
+	return 1;
+}
+
+/*
+ * a frozen trie straight out of a trie_frozen_save()d file, good until
+ * trie_frozen_free(); NULL and errno if it can't be had
+ */
+struct trie_frozen * trie_frozen_map(const char *path, int flags)
+{
+	struct trie_frozen *f;
+	struct trie_file h;
+	struct stat st;
+	unsigned char *map;
+	size_t i;
+	int fd = open(path, O_RDONLY),
+	    e;
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		e = errno;
+		close(fd);
+		errno = e;
+		return NULL;
+	}
+	if ((uint64_t)st.st_size < ALIGN_UP(sizeof h, TRIE_FILE_ALIGN)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	e = errno;
+	close(fd);
+	if (MAP_FAILED == map) {
+		errno = e;
+		return NULL;
+	}
+	memcpy(&h, map, sizeof h);
+	if (!frozen_file_ok(&h, map, (size_t)st.st_size, flags)) {
+		e = errno;
+		munmap(map, (size_t)st.st_size);
+		errno = e;
+		return NULL;
+	}
+	f = calloc(1, sizeof *f);
+	f->map = map;
+	f->maplen = (size_t)st.st_size;
+	f->nodes = (size_t)h.nodes;
+	f->nalpha = (size_t)h.nalpha;
+	f->lwidth = h.lwidth;
+	f->louds = (uint64_t *)(map + h.off[0]);
+	f->sel0 = (uint32_t *)(map + h.off[1]);
+	f->term = (uint64_t *)(map + h.off[2]);
+	f->label = map + h.off[3];
+	if (sizeof(wchar_t) == sizeof(uint32_t)) {
+		f->alpha = (wchar_t *)(map + h.off[4]);
+	} else {
+		f->alpha = malloc(f->nalpha * sizeof *f->alpha);
+		for (i = 0; i < f->nalpha; i++)
+			f->alpha[i] = (wchar_t)((const uint32_t *)(map + h.off[4]))[i];
+	}
+	for (i = 0; i < 256; i++)
+		f->low[i] = ~(uint32_t)0;
+	for (i = 0; i < f->nalpha && f->alpha[i] < 256; i++)
+		if (f->alpha[i] >= 0)
+			f->low[f->alpha[i]] = (uint32_t)i;
+	return f;
+}
+
+/************************* aho-corasick ****/
+
+/*
+ * per node of the frozen trie: where to go when the next char has no child
+ * (the node for the longest proper suffix that's also in the trie), the
+ * nearest such suffix that's a complete string, and depth. node ids are
+ * already breadth first, so building fail in id order always finds a
+ * node's suffix done before it
+ */
+struct trie_ac {
+	const struct trie_frozen *f;
+	uint32_t *fail,
+	         *out,  /* 0 if none */
+	         *depth;
+};
+
+struct trie_ac * trie_ac_new(const struct trie_frozen *f)
+{
+	struct trie_ac *ac = malloc(sizeof *ac);
+	size_t v;
+	ac->f = f;
+	ac->fail = calloc(f->nodes, sizeof *ac->fail);
+	ac->out = calloc(f->nodes, sizeof *ac->out);
+	ac->depth = calloc(f->nodes, sizeof *ac->depth);
+	for (v = 0; v < f->nodes; v++) {
+		size_t u = select0(f, v + 1) - v,
+		       end = select0(f, v + 2) - v - 1;
+		for (; u < end; u++) {
+			uint32_t l = label_at(f, u);
+			size_t w = ac->fail[v],
+			       x = 0;
+			if (v) {
+				while (!(x = frozen_child(f, w, l)) && w)
+					w = ac->fail[w];
+			}
+			ac->fail[u] = (uint32_t)x;
+			ac->out[u] = bit(f->term, x) ? (uint32_t)x : ac->out[x];
+			ac->depth[u] = ac->depth[v] + 1;
+		}
+	}
+	return ac;
+}
+
+void trie_ac_free(struct trie_ac *ac)
+{
+	free(ac->fail);
+	free(ac->out);
+	free(ac->depth);
+	free(ac);
+}
+
+/*
+ * feed the next 'len' chars of the text; calls fn for each string ending at
+ * each char, longest first. start with TRIE_AC_STATE_INIT
+ * @return 0, or fn's return if it said stop (s is just past that char)
+ */
+int trie_ac_scan(const struct trie_ac *ac, struct trie_ac_state *s, const wchar_t *text, size_t len,
+	trie_ac_fn *fn, void *arg)
+{
+	const struct trie_frozen *f = ac->f;
+	size_t v = s->node,
+	       i;
+	int stop = 0;
+	for (i = 0; i < len && !stop; i++) {
+		uint32_t l = label_of(f, text[i]);
+		size_t x;
+		if (l == ~(uint32_t)0) {
+			v = 0;
+		} else {
+			while (!(x = frozen_child(f, v, l)) && v)
+				v = ac->fail[v];
+			v = x;
+		}
+		for (x = bit(f->term, v) ? v : ac->out[v]; x && !stop; x = ac->out[x])
+			stop = fn(s->pos + i + 1, ac->depth[x], arg);
+	}
+	s->node = v;
+	s->pos += i;
+	return stop;
+}
+
+#if defined(DEBUG) || defined(BENCH)
+/*
+ * n random words over 'letters', 1-12 long and mostly 5-9
+ */
+static wchar_t ** random_words(size_t n, const wchar_t *letters)
+{
+	size_t nletters = wcslen(letters),
+	       i;
+	wchar_t **w = malloc(n * sizeof *w);
+	for (i = 0; i < n; i++) {
+		size_t len = 1 + (size_t)(rand() % 4 + rand() % 4 + rand() % 4 + rand() % 3),
+		       j;
+		w[i] = malloc((len + 1) * sizeof **w);
+		for (j = 0; j < len; j++)
+			w[i][j] = letters[rand() % nletters];
+		w[i][len] = L'\0';
+	}
+	return w;
+}
+
+static void free_words(wchar_t **w, size_t n)
+{
+	while (n--)
+		free(w[n]);
+	free(w);
+}
+#endif
+
 #ifdef DEBUG
+/*
+ * the frozen trie answers like the one it came from, for words and non-words,
+ * with a small alphabet and one that needs wide labels
+ */
+static void test_frozen(void)
+{
+	static const wchar_t * const Letters[] = { L"abcde", L"abcdefghijklmnopqrstuvwxyz\x3b1\x3b2\x3b3\x4e00" };
+	const size_t n = 20000;
+	wchar_t wide[300];
+	unsigned l,
+	         i;
+	for (i = 0; i < 299; i++)
+		wide[i] = (wchar_t)(0x100 + i);
+	wide[299] = L'\0';
+	printf("test_frozen... ");
+	for (l = 0; l < 3; l++) {
+		const wchar_t *letters = l < 2 ? Letters[l] : wide;
+		wchar_t **in = random_words(n, letters),
+		        **out = random_words(n, letters);
+		struct trie *t = trie_new();
+		struct trie_frozen *f;
+		size_t j;
+		for (j = 0; j < n; j++)
+			trie_add(t, in[j]);
+		f = trie_freeze(t);
+		for (j = 0; j < n; j++) {
+			assert(trie_frozen_find(f, in[j]));
+			assert(trie_find(t, out[j]) == trie_frozen_find(f, out[j]));
+		}
+		for (j = 0; j < n / 2; j++)
+			assert(trie_del(t, in[j]) || !trie_find(t, in[j]));
+		trie_frozen_free(f);
+		f = trie_freeze(t);
+		for (j = 0; j < n; j++) {
+			assert(trie_find(t, in[j]) == trie_frozen_find(f, in[j]));
+			assert(trie_find(t, out[j]) == trie_frozen_find(f, out[j]));
+		}
+		trie_frozen_free(f);
+		trie_free(t);
+		free_words(in, n);
+		free_words(out, n);
+	}
+	printf("OK.\n");
+}
+
+/*
+ * a saved and mapped frozen trie answers like the one saved; a damaged or
+ * foreign file is turned away
+ */
+static void test_file(void)
+{
+	static const wchar_t * const Letters[] = { L"abcde", L"abcdefghijklmnopqrstuvwxyz\x3b1\x3b2\x3b3\x4e00" };
+	const size_t n = 20000;
+	char path[] = "/tmp/trie1-test-XXXXXX";
+	unsigned char buf[1000];
+	unsigned l,
+	         i;
+	int fd;
+	printf("test_file... ");
+	assert(0xE3069283 == crc32c(0, "123456789", 9));
+	for (i = 0; i < sizeof buf; i++)
+		buf[i] = (unsigned char)rand();
+	for (i = 0; i < 40; i++) /* the fast one agrees, at every alignment and length */
+		assert(crc32c(0, buf + i, sizeof buf - 3 * i) == ~crc32c_obvious(~0u, buf + i, sizeof buf - 3 * i));
+	assert((fd = mkstemp(path)) >= 0);
+	close(fd);
+	for (l = 0; l < 2; l++) {
+		wchar_t **in = random_words(n, Letters[l]),
+		        **out = random_words(n, Letters[l]);
+		struct trie *t = trie_new();
+		struct trie_frozen *f,
+		                   *m;
+		struct trie_file h;
+		FILE *fp;
+		size_t j;
+		long size;
+		for (j = 0; j < n; j++)
+			trie_add(t, in[j]);
+		f = trie_freeze(t);
+		assert(0 == trie_frozen_save(f, path));
+		assert((m = trie_frozen_map(path, 0)));
+		assert(trie_frozen_bytes(f) == trie_frozen_bytes(m));
+		for (j = 0; j < n; j++) {
+			assert(trie_frozen_find(m, in[j]));
+			assert(trie_frozen_find(f, out[j]) == trie_frozen_find(m, out[j]));
+		}
+		trie_frozen_free(m);
+		/* one flipped bit in the body; found unless told not to look */
+		assert((fp = fopen(path, "r+b")));
+		assert(1 == fread(&h, sizeof h, 1, fp));
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, (long)h.off[3], SEEK_SET);
+		j = (size_t)fgetc(fp);
+		fseek(fp, (long)h.off[3], SEEK_SET);
+		fputc((int)(j ^ 0x10), fp);
+		fclose(fp);
+		errno = 0;
+		assert(!trie_frozen_map(path, 0) && EBADMSG == errno);
+		assert((m = trie_frozen_map(path, TRIE_MAP_NOCRC)));
+		trie_frozen_free(m);
+		/* cut short */
+		assert(0 == trie_frozen_save(f, path));
+		assert(0 == truncate(path, size - 1));
+		assert(!trie_frozen_map(path, TRIE_MAP_NOCRC) && EBADMSG == errno);
+		/* another version */
+		assert(0 == trie_frozen_save(f, path));
+		assert((fp = fopen(path, "r+b")));
+		fseek(fp, (long)offsetof(struct trie_file, version), SEEK_SET);
+		fputc(TRIE_FILE_VERSION + 1, fp);
+		fclose(fp);
+		assert(!trie_frozen_map(path, 0) && EINVAL == errno);
+		trie_frozen_free(f);
+		trie_free(t);
+		free_words(in, n);
+		free_words(out, n);
+	}
+	{ /* 255 nodes: sel0's last entry has no 0 bit to point at, and is saved anyway */
+		struct trie *t = trie_new();
+		struct trie_frozen *f;
+		wchar_t w[2] = { 0, 0 };
+		for (i = 0; i < 254; i++) {
+			w[0] = (wchar_t)(0x100 + i);
+			trie_add(t, w);
+		}
+		f = trie_freeze(t);
+		assert(255 == f->nodes && 0 == f->sel0[1]);
+		trie_frozen_free(f);
+		trie_free(t);
+	}
+	remove(path);
+	assert(!trie_frozen_map(path, 0) && ENOENT == errno);
+	printf("OK.\n");
+}
+
+struct matches {
+	size_t n,
+	       at; /* brute force: where the prefix started */
+	struct { size_t end, len; } m[4096];
+};
+
+static int collect_prefix(const wchar_t *str, size_t len, void *arg)
+{
+	struct matches *m = arg;
+	(void)str;
+	assert(m->n < sizeof m->m / sizeof m->m[0]);
+	m->m[m->n].end = m->at + len;
+	m->m[m->n++].len = len;
+	return 0;
+}
+
+static int collect_ac(size_t end, size_t len, void *arg)
+{
+	struct matches *m = arg;
+	assert(m->n < sizeof m->m / sizeof m->m[0]);
+	m->m[m->n].end = end;
+	m->m[m->n++].len = len;
+	return 0;
+}
+
+static int cmp_match(const void *a, const void *b)
+{
+	const size_t *x = a,
+	             *y = b;
+	return x[0] != y[0] ? (x[0] > y[0]) - (x[0] < y[0]) : (x[1] < y[1]) - (x[1] > y[1]);
+}
+
+static int stop_at_2(const wchar_t *str, size_t len, void *arg)
+{
+	(void)str, (void)arg;
+	return len >= 2 ? 7 : 0;
+}
+
+/*
+ * one Aho-Corasick pass, fed in uneven pieces, finds exactly what trying
+ * every offset of the text does
+ */
+static void test_ac(void)
+{
+	static struct matches brute,
+	                      ac;
+	static const wchar_t * const W[] = { L"he", L"she", L"his", L"hers", L"e", L"sh", L"hishe", NULL };
+	const wchar_t *text = L"ushershishehishers x hhe";
+	size_t len = wcslen(text),
+	       i;
+	unsigned round;
+	printf("test_ac... ");
+	for (round = 0; round < 50; round++) {
+		struct trie *t = trie_new();
+		struct trie_frozen *f;
+		struct trie_ac *a;
+		struct trie_ac_state st = TRIE_AC_STATE_INIT;
+		wchar_t **rw = NULL,
+		        rtext[400];
+		if (round) { /* random dictionaries over a small alphabet, so plenty overlap */
+			rw = random_words(200, L"abc");
+			for (i = 0; i < 200; i++)
+				rw[i][rand() % wcslen(rw[i]) + 1] = L'\0'; /* shorter */
+			for (i = 0; i < 200; i++)
+				trie_add(t, rw[i]);
+			for (i = 0; i + 1 < sizeof rtext / sizeof rtext[0]; i++)
+				rtext[i] = L"abcd"[rand() % 4];
+			rtext[i] = L'\0';
+			text = rtext;
+			len = wcslen(text);
+		} else {
+			for (i = 0; W[i]; i++)
+				trie_add(t, W[i]);
+		}
+		f = trie_freeze(t);
+		a = trie_ac_new(f);
+		brute.n = ac.n = 0;
+		for (brute.at = 0; brute.at < len; brute.at++)
+			trie_frozen_prefix_each(f, text + brute.at, collect_prefix, &brute);
+		for (i = 0; i < len; i += 1 + i % 5)
+			assert(0 == trie_ac_scan(a, &st, text + i, (i + 1 + i % 5 > len ? len - i : 1 + i % 5), collect_ac, &ac));
+		assert(st.pos == len);
+		assert(brute.n == ac.n);
+		qsort(brute.m, brute.n, sizeof brute.m[0], cmp_match);
+		qsort(ac.m, ac.n, sizeof ac.m[0], cmp_match);
+		assert(0 == memcmp(brute.m, ac.m, ac.n * sizeof ac.m[0]));
+		if (!round) {
+			assert(21 == ac.n); /* counted independently */
+			assert(7 == trie_prefix_each(t, L"hers", stop_at_2, NULL));
+			assert(7 == trie_frozen_prefix_each(f, L"hers", stop_at_2, NULL));
+		}
+		trie_ac_free(a);
+		trie_frozen_free(f);
+		trie_free(t);
+		if (rw)
+			free_words(rw, 200);
+	}
+	printf("OK.\n");
+}
+
 int main(void)
 {
 	struct trie *t = trie_new();
@@ -190,8 +1197,228 @@ int main(void)
 	trie_add(t, L"hello");
 	trie_prefix_all_strings(t, L"hello");
 	trie_prefix_all_strings(t, L"foobar");
-	free(t);
+	{
+		struct trie_frozen *f = trie_freeze(t);
+		trie_frozen_prefix_all_strings(f, L"hello");
+		assert( trie_frozen_find(f, L""));
+		assert(!trie_frozen_find(f, L"h"));
+		assert( trie_frozen_find(f, L"he"));
+		assert(!trie_frozen_find(f, L"hel"));
+		assert( trie_frozen_find(f, L"hello"));
+		assert(!trie_frozen_find(f, L"helloo"));
+		assert(!trie_frozen_find(f, L"x"));
+		trie_frozen_free(f);
+	}
+	trie_free(t);
+	test_frozen();
+	test_file();
+	test_ac();
 	return 0;
 }
 #endif
 
+#ifdef BENCH
+/*
+ * trie_add()+trie_free() speed; lookups/s, half hits and half misses, and
+ * bytes held, for struct trie vs its frozen form; and every match at every
+ * offset of a random text, trying each offset vs Aho-Corasick
+ *
+ *   cc -O3 -DBENCH trie1.c && ./a.out [words] [n]
+ *
+ * words is one per line (e.g. /usr/share/dict/words); otherwise n random ones
+ */
+#include <locale.h>
+
+static struct trie *T;
+static struct trie_frozen *F;
+static wchar_t **Probe,
+               **Words;
+static size_t NProbe,
+              NWords;
+
+static wchar_t *Text;
+static size_t NText;
+static struct trie_ac *AC;
+
+static int count_prefix(const wchar_t *str, size_t len, void *arg)
+{
+	(void)str, (void)len;
+	++*(size_t *)arg;
+	return 0;
+}
+
+static int count_ac(size_t end, size_t len, void *arg)
+{
+	(void)end, (void)len;
+	++*(size_t *)arg;
+	return 0;
+}
+
+static void trial_scan_restart(void *arg)
+{
+	size_t i,
+	       n = 0;
+	(void)arg;
+	for (i = 0; i < NText; i++)
+		trie_frozen_prefix_each(F, Text + i, count_prefix, &n);
+	BENCH_USE(n);
+}
+
+static void trial_scan_ac(void *arg)
+{
+	struct trie_ac_state st = TRIE_AC_STATE_INIT;
+	size_t n = 0;
+	(void)arg;
+	trie_ac_scan(AC, &st, Text, NText, count_ac, &n);
+	BENCH_USE(n);
+}
+
+static void trial_build(void *arg)
+{
+	struct trie *t = trie_new();
+	size_t i;
+	(void)arg;
+	for (i = 0; i < NWords; i++)
+		trie_add(t, Words[i]);
+	trie_free(t);
+}
+
+static void trial_find(void *arg)
+{
+	size_t i,
+	       hits = 0;
+	(void)arg;
+	for (i = 0; i < NProbe; i++)
+		hits += trie_find(T, Probe[i]);
+	BENCH_USE(hits);
+}
+
+static void trial_frozen_find(void *arg)
+{
+	size_t i,
+	       hits = 0;
+	(void)arg;
+	for (i = 0; i < NProbe; i++)
+		hits += trie_frozen_find(F, Probe[i]);
+	BENCH_USE(hits);
+}
+
+static char Path[64];
+
+/*
+ * from words to something trie_frozen_find() can use, the two ways there
+ */
+static void trial_build_freeze(void *arg)
+{
+	struct trie *t = trie_new();
+	struct trie_frozen *f;
+	size_t i;
+	(void)arg;
+	for (i = 0; i < NWords; i++)
+		trie_add(t, Words[i]);
+	f = trie_freeze(t);
+	trie_free(t);
+	BENCH_USE(trie_frozen_find(f, Probe[0]));
+	trie_frozen_free(f);
+}
+
+static void trial_map(void *arg)
+{
+	struct trie_frozen *f = trie_frozen_map(Path, *(int *)arg);
+	BENCH_USE(trie_frozen_find(f, Probe[0]));
+	trie_frozen_free(f);
+}
+
+static wchar_t ** read_words(const char *path, size_t *n)
+{
+	FILE *fp = fopen(path, "r");
+	wchar_t line[256],
+	        **w = NULL;
+	size_t alloc = 0;
+	*n = 0;
+	if (!fp) {
+		perror(path);
+		exit(1);
+	}
+	while (fgetws(line, sizeof line / sizeof line[0], fp)) {
+		size_t len = wcslen(line);
+		while (len && (line[len-1] == L'\n' || line[len-1] == L'\r'))
+			line[--len] = L'\0';
+		if (!len)
+			continue;
+		if (*n == alloc)
+			w = realloc(w, (alloc = alloc ? alloc * 2 : 1024) * sizeof *w);
+		w[*n] = malloc((len + 1) * sizeof **w);
+		wmemcpy(w[*n], line, len + 1);
+		++*n;
+	}
+	fclose(fp);
+	return w;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 500000,
+	       i;
+	wchar_t **words,
+	        **miss;
+	setlocale(LC_ALL, "");
+	srand(1);
+	if (argc > 1 && strcmp(argv[1], "-"))
+		words = read_words(argv[1], &n);
+	else
+		words = random_words(n, L"abcdefghijklmnopqrstuvwxyz");
+	miss = random_words(n, L"abcdefghijklmnopqrstuvwxyz");
+	T = trie_new();
+	for (i = 0; i < n; i++)
+		trie_add(T, words[i]);
+	F = trie_freeze(T);
+	/* interleave hits and (probable) misses */
+	NProbe = 2 * n;
+	Probe = malloc(NProbe * sizeof *Probe);
+	for (i = 0; i < n; i++) {
+		Probe[2*i] = words[(i * 7919) % n];
+		Probe[2*i+1] = miss[i];
+	}
+	bench_init(1, 7);
+	bench_note("%lu words; struct trie %lu bytes, frozen %lu bytes (%.1fx smaller)\n",
+		(unsigned long)n, (unsigned long)trie_bytes(T), (unsigned long)trie_frozen_bytes(F),
+		(double)trie_bytes(T) / trie_frozen_bytes(F));
+	Words = words;
+	NWords = n;
+	bench_section("trie_add", "words/s");
+	bench_run("struct trie", trial_build, NULL, (double)n);
+	bench_section("trie_find", "lookups/s");
+	bench_run("struct trie", trial_find, NULL, (double)NProbe);
+	bench_run("frozen", trial_frozen_find, NULL, (double)NProbe);
+	snprintf(Path, sizeof Path, "/tmp/trie1-bench-%ld", (long)getpid());
+	if (trie_frozen_save(F, Path)) {
+		perror(Path);
+	} else {
+		static int check = 0,
+		           nocrc = TRIE_MAP_NOCRC;
+		bench_section("startup (file in page cache)", NULL);
+		bench_run("trie_add+trie_freeze", trial_build_freeze, NULL, 0);
+		bench_run("trie_frozen_map", trial_map, &check, 0);
+		bench_run("trie_frozen_map NOCRC", trial_map, &nocrc, 0);
+		remove(Path);
+	}
+	NText = 1 << 20;
+	Text = malloc((NText + 1) * sizeof *Text);
+	for (i = 0; i < NText; i++)
+		Text[i] = L"abcdefghijklmnopqrstuvwxyz "[rand() % 27];
+	Text[NText] = L'\0';
+	AC = trie_ac_new(F);
+	bench_section("every match in text", "chars/s");
+	bench_run("each offset", trial_scan_restart, NULL, (double)NText);
+	bench_run("aho-corasick", trial_scan_ac, NULL, (double)NText);
+	trie_ac_free(AC);
+	free(Text);
+	trie_frozen_free(F);
+	trie_free(T);
+	free(Probe);
+	free_words(words, n);
+	free_words(miss, n);
+	return 0;
+}
+#endif
@@ -0,0 +1,82 @@
+
+/*
+ * string trie; see trie1.c
+ */
+
+#ifndef TRIE1_H
+#define TRIE1_H
+
+#include <stddef.h>
+#include <wchar.h>
+
+/*
+ * one node per character; siblings are kept sorted by c, and a complete
+ * string has a child with c == L'\0' at the front of its children
+ */
+struct trie {
+	wchar_t c;
+	struct trie *next,  /* sibling */
+	            *child; /* first child */
+};
+
+/*
+ * called with each match; return non-zero to stop, and that's returned
+ */
+typedef int trie_prefix_fn(const wchar_t *str, size_t len, void *arg);
+
+struct trie * trie_new(void);
+void trie_free(struct trie *);
+void trie_add(struct trie *, const wchar_t *);
+int  trie_find(const struct trie *, const wchar_t *);
+int  trie_del(struct trie *, const wchar_t *);
+void trie_prefix_all_strings(const struct trie *, const wchar_t *);
+int  trie_prefix_each(const struct trie *, const wchar_t *, trie_prefix_fn *, void *);
+void trie_dump(const struct trie *);
+size_t trie_bytes(const struct trie *);
+
+/*
+ * read-only LOUDS encoding of a struct trie; a couple of bits of shape and
+ * a byte or so of label per node, instead of a malloc()ed struct trie
+ */
+struct trie_frozen;
+
+struct trie_frozen * trie_freeze(const struct trie *);
+void trie_frozen_free(struct trie_frozen *);
+int  trie_frozen_find(const struct trie_frozen *, const wchar_t *);
+void trie_frozen_prefix_all_strings(const struct trie_frozen *, const wchar_t *);
+int  trie_frozen_prefix_each(const struct trie_frozen *, const wchar_t *, trie_prefix_fn *, void *);
+size_t trie_frozen_bytes(const struct trie_frozen *);
+
+/*
+ * a frozen trie in a file, used in place through mmap(); the header is
+ * always checked, the rest too unless TRIE_MAP_NOCRC
+ */
+#define TRIE_MAP_NOCRC 1
+
+int  trie_frozen_save(const struct trie_frozen *, const char *path);
+struct trie_frozen * trie_frozen_map(const char *path, int flags);
+
+/*
+ * Aho-Corasick over a frozen trie: every string in it found at every
+ * position of a text in one pass, which may be fed in pieces
+ */
+struct trie_ac;
+
+struct trie_ac_state {
+	size_t node, /* where we are in the trie */
+	       pos;  /* chars seen so far */
+};
+
+#define TRIE_AC_STATE_INIT { 0, 0 }
+
+/*
+ * a match is the 'len' chars ending just before offset 'end' of the whole text
+ */
+typedef int trie_ac_fn(size_t end, size_t len, void *arg);
+
+struct trie_ac * trie_ac_new(const struct trie_frozen *);
+void trie_ac_free(struct trie_ac *);
+int  trie_ac_scan(const struct trie_ac *, struct trie_ac_state *, const wchar_t *, size_t, trie_ac_fn *, void *);
+
+#endif
+
@@ -0,0 +1,426 @@
+
+/*
+ * trie1.c keys on wchar_t, so everything has to go through mbstowcs() first
+ * and every node spends 4 bytes on its char. this one keys on bytes and takes
+ * UTF-8 (or anything else) as it comes.
+ *
+ * instead of a sorted sibling list per level, each node has a 256-bit map of
+ * which bytes have a child and the children in byte order right after it;
+ * the child for byte b is child[base[b/64] + popcount(bits[b/64] below b)],
+ * so a step down is a bit test, a popcount and a load.
+ *
+ * a string found here ends on a byte the stored string ended on, so matches
+ * against valid UTF-8 never split a character.
+ *
+ * bench (against trie1.c, converting first):
+ *   cc -O3 -c trie1.c && cc -O3 -DBENCH trie8.c trie1.o
+ */
+
+#ifdef BENCH
+#include "bench.h" /* first; it wants _GNU_SOURCE */
+#endif
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trie8.h"
+
+static struct trie8_node * node_new(struct trie8 *t)
+{
+	struct trie8_node *n = calloc(1, TRIE8_NODE_SIZE(0));
+	t->nodes++;
+	t->bytes += TRIE8_NODE_SIZE(0);
+	return n;
+}
+
+static const struct trie8_node * child(const struct trie8_node *n, uint8_t c)
+{
+	return trie8_has_child(n, c) ? n->child[trie8_child_index(n, c)] : NULL;
+}
+
+/*
+ * the slot holding byte c's child of *slot, adding it if need be; growing
+ * *slot's child[] may move it, hence slots rather than nodes
+ */
+static struct trie8_node ** child_slot(struct trie8 *t, struct trie8_node **slot, uint8_t c)
+{
+	struct trie8_node *n = *slot;
+	unsigned i = trie8_child_index(n, c),
+	         w;
+	if (trie8_has_child(n, c))
+		return &n->child[i];
+	if (n->n == n->cap) {
+		unsigned cap = n->cap ? n->cap * 2u : 1u;
+		if (cap > 256)
+			cap = 256;
+		n = realloc(n, TRIE8_NODE_SIZE(cap));
+		t->bytes += TRIE8_NODE_SIZE(cap) - TRIE8_NODE_SIZE(n->cap);
+		n->cap = (uint16_t)cap;
+		*slot = n;
+	}
+	memmove(n->child + i + 1, n->child + i, (n->n - i) * sizeof n->child[0]);
+	n->child[i] = node_new(t);
+	n->n++;
+	n->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+	for (w = (c >> 6) + 1u; w < 4; w++)
+		n->base[w]++;
+	return &n->child[i];
+}
+
+struct trie8 * trie8_new(void)
+{
+	struct trie8 *t = malloc(sizeof *t);
+	t->nodes = 0;
+	t->bytes = sizeof *t;
+	t->root = node_new(t);
+	return t;
+}
+
+static void do_trie8_free(struct trie8_node *n)
+{
+	unsigned i;
+	for (i = 0; i < n->n; i++)
+		do_trie8_free(n->child[i]);
+	free(n);
+}
+
+void trie8_free(struct trie8 *t)
+{
+	do_trie8_free(t->root);
+	free(t);
+}
+
+void trie8_add_len(struct trie8 *t, const char *s, size_t len)
+{
+	struct trie8_node **slot = &t->root;
+	size_t i;
+	for (i = 0; i < len; i++)
+		slot = child_slot(t, slot, (uint8_t)s[i]);
+	(*slot)->term = 1;
+}
+
+void trie8_add(struct trie8 *t, const char *s)
+{
+	trie8_add_len(t, s, strlen(s));
+}
+
+int trie8_find_len(const struct trie8 *t, const char *s, size_t len)
+{
+	const struct trie8_node *n = t->root;
+	size_t i;
+	for (i = 0; i < len && n; i++)
+		n = child(n, (uint8_t)s[i]);
+	return n && n->term;
+}
+
+int trie8_find(const struct trie8 *t, const char *s)
+{
+	const struct trie8_node *n = t->root;
+	while (*s && n)
+		n = child(n, (uint8_t)*s++);
+	return n && n->term;
+}
+
+/*
+ * unmark s[0..len), and free any node on its way that's left with nothing
+ * below it
+ */
+static int do_trie8_del(struct trie8 *t, struct trie8_node *n, const uint8_t *s, size_t len)
+{
+	unsigned i,
+	         w;
+	struct trie8_node *c;
+	if (!len) {
+		if (!n->term)
+			return 0;
+		n->term = 0;
+		return 1;
+	}
+	if (!trie8_has_child(n, *s))
+		return 0;
+	i = trie8_child_index(n, *s);
+	c = n->child[i];
+	if (!do_trie8_del(t, c, s + 1, len - 1))
+		return 0;
+	if (!c->term && !c->n) {
+		t->nodes--;
+		t->bytes -= TRIE8_NODE_SIZE(c->cap);
+		free(c);
+		memmove(n->child + i, n->child + i + 1, (n->n - i - 1) * sizeof n->child[0]);
+		n->n--;
+		n->bits[*s >> 6] &= ~((uint64_t)1 << (*s & 63));
+		for (w = (*s >> 6) + 1u; w < 4; w++)
+			n->base[w]--;
+	}
+	return 1;
+}
+
+int trie8_del_len(struct trie8 *t, const char *s, size_t len)
+{
+	return do_trie8_del(t, t->root, (const uint8_t *)s, len);
+}
+
+int trie8_del(struct trie8 *t, const char *s)
+{
+	return trie8_del_len(t, s, strlen(s));
+}
+
+/*
+ * run f on every string in t that's a prefix of s[0..len)
+ */
+int trie8_prefix_each(const struct trie8 *t, const char *s, size_t len, trie8_prefix_fn *f, void *arg)
+{
+	const struct trie8_node *n = t->root;
+	size_t i;
+	int stop;
+	for (i = 0; i < len; i++) {
+		if (!(n = child(n, (uint8_t)s[i])))
+			break;
+		if (n->term && (stop = f(s, i + 1, arg)))
+			return stop;
+	}
+	return 0;
+}
+
+#if defined(DEBUG) || defined(BENCH)
+/*
+ * append code point c as UTF-8
+ */
+static size_t utf8(char *s, unsigned long c)
+{
+	if (c < 0x80) {
+		s[0] = (char)c;
+		return 1;
+	} else if (c < 0x800) {
+		s[0] = (char)(0xC0 | c >> 6);
+		s[1] = (char)(0x80 | (c & 0x3F));
+		return 2;
+	} else if (c < 0x10000) {
+		s[0] = (char)(0xE0 | c >> 12);
+		s[1] = (char)(0x80 | (c >> 6 & 0x3F));
+		s[2] = (char)(0x80 | (c & 0x3F));
+		return 3;
+	}
+	s[0] = (char)(0xF0 | c >> 18);
+	s[1] = (char)(0x80 | (c >> 12 & 0x3F));
+	s[2] = (char)(0x80 | (c >> 6 & 0x3F));
+	s[3] = (char)(0x80 | (c & 0x3F));
+	return 4;
+}
+
+/*
+ * n random UTF-8 words from the code points in 'letters', 1-12 chars
+ */
+static char ** random_words(size_t n, const unsigned long *letters, size_t nletters)
+{
+	char **w = malloc(n * sizeof *w);
+	size_t i;
+	for (i = 0; i < n; i++) {
+		size_t len = 1 + (size_t)(rand() % 4 + rand() % 4 + rand() % 4 + rand() % 3),
+		       j,
+		       k = 0;
+		w[i] = malloc(len * 4 + 1);
+		for (j = 0; j < len; j++)
+			k += utf8(w[i] + k, letters[rand() % nletters]);
+		w[i][k] = '\0';
+	}
+	return w;
+}
+
+static void free_words(char **w, size_t n)
+{
+	while (n--)
+		free(w[n]);
+	free(w);
+}
+#endif
+
+#ifdef DEBUG
+
+static int cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int count_prefix(const char *s, size_t len, void *arg)
+{
+	(void)s, (void)len;
+	++*(size_t *)arg;
+	return 0;
+}
+
+/*
+ * against a sorted array of the same words
+ */
+static void test_random(void)
+{
+	static const unsigned long Letters[] = {
+		'a', 'b', 'c', 'd', 0xE4, 0xF6, 0x3B1, 0x4E00, 0x4E01, 0x1F600
+	};
+	const size_t n = 20000,
+	             nletters = sizeof Letters / sizeof Letters[0];
+	char **in = random_words(n, Letters, nletters),
+	     **out = random_words(n, Letters, nletters),
+	     **sorted = malloc(n * sizeof *sorted);
+	struct trie8 *t = trie8_new();
+	size_t i,
+	       nodes;
+	printf("test_random... ");
+	for (i = 0; i < n; i++)
+		trie8_add(t, in[i]);
+	memcpy(sorted, in, n * sizeof *sorted);
+	qsort(sorted, n, sizeof *sorted, cmp_str);
+	for (i = 0; i < n; i++) {
+		assert(trie8_find(t, in[i]));
+		assert(!!bsearch(&out[i], sorted, n, sizeof *sorted, cmp_str) == trie8_find(t, out[i]));
+	}
+	/* every prefix match of out[i] is a stored word, and they all are */
+	for (i = 0; i < n; i++) {
+		size_t len = strlen(out[i]),
+		       k,
+		       expect = 0,
+		       got = 0;
+		for (k = 1; k <= len; k++) {
+			char c = out[i][k];
+			out[i][k] = '\0';
+			expect += !!bsearch(&out[i], sorted, n, sizeof *sorted, cmp_str);
+			out[i][k] = c;
+		}
+		trie8_prefix_each(t, out[i], len, count_prefix, &got);
+		assert(expect == got);
+	}
+	nodes = t->nodes;
+	for (i = 0; i < n; i++)
+		trie8_del(t, in[i]);
+	assert(1 == t->nodes); /* just the root */
+	for (i = 0; i < n; i++)
+		assert(!trie8_find(t, in[i]));
+	for (i = 0; i < n; i++)
+		trie8_add(t, in[i]);
+	assert(nodes == t->nodes);
+	trie8_free(t);
+	free(sorted);
+	free_words(in, n);
+	free_words(out, n);
+	printf("OK.\n");
+}
+
+int main(void)
+{
+	struct trie8 *t = trie8_new();
+	size_t n = 0;
+	printf("sizeof(struct trie8_node) = %lu\n", (unsigned long)sizeof(struct trie8_node));
+	trie8_add(t, "tea");
+	trie8_add(t, "ted");
+	trie8_add(t, "t\xC3\xA9");   /* té */
+	trie8_add(t, "\xE4\xB8\x80"); /* 一 */
+	assert(!trie8_find(t, ""));
+	assert(!trie8_find(t, "t"));
+	assert( trie8_find(t, "tea"));
+	assert( trie8_find(t, "t\xC3\xA9"));
+	assert(!trie8_find(t, "t\xC3"));
+	assert( trie8_find(t, "\xE4\xB8\x80"));
+	assert( trie8_find_len(t, "teapot", 3));
+	assert(!trie8_del_len(t, "teapot", 4));
+	assert( trie8_del_len(t, "teapot", 3));
+	trie8_add(t, "tea");
+	assert( trie8_del(t, "tea"));
+	assert(!trie8_del(t, "tea"));
+	assert(!trie8_find(t, "tea"));
+	assert( trie8_find(t, "ted"));
+	trie8_add(t, "te");
+	trie8_prefix_each(t, "tedious", 7, count_prefix, &n);
+	assert(2 == n);
+	trie8_free(t);
+	test_random();
+	return 0;
+}
+#endif
+
+#ifdef BENCH
+/*
+ * lookups/s of UTF-8 words, half hits and half misses: here directly, and
+ * through mbstowcs() into trie1
+ */
+#include <locale.h>
+#include <wchar.h>
+#include "trie1.h"
+
+static struct trie8 *T8;
+static struct trie *T1;
+static char **Probe;
+static size_t NProbe;
+
+static void trial_trie8(void *arg)
+{
+	size_t i,
+	       hits = 0;
+	(void)arg;
+	for (i = 0; i < NProbe; i++)
+		hits += trie8_find(T8, Probe[i]);
+	BENCH_USE(hits);
+}
+
+static void trial_trie1(void *arg)
+{
+	wchar_t w[64];
+	size_t i,
+	       hits = 0;
+	(void)arg;
+	for (i = 0; i < NProbe; i++) {
+		mbstowcs(w, Probe[i], sizeof w / sizeof w[0]);
+		hits += trie_find(T1, w);
+	}
+	BENCH_USE(hits);
+}
+
+int main(int argc, char *argv[])
+{
+	static const unsigned long Letters[] = {
+		'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm',
+		'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+		0xE4, 0xF6, 0xFC, 0xE9 /* äöüé */
+	};
+	const size_t nletters = sizeof Letters / sizeof Letters[0];
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000,
+	       i;
+	char **words,
+	     **miss;
+	wchar_t w[64];
+	if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "en_US.UTF-8")) {
+		fprintf(stderr, "need a UTF-8 locale for mbstowcs()\n");
+		return 1;
+	}
+	srand(1);
+	words = random_words(n, Letters, nletters);
+	miss = random_words(n, Letters, nletters);
+	T8 = trie8_new();
+	T1 = trie_new();
+	for (i = 0; i < n; i++) {
+		trie8_add(T8, words[i]);
+		mbstowcs(w, words[i], sizeof w / sizeof w[0]);
+		trie_add(T1, w);
+	}
+	NProbe = 2 * n;
+	Probe = malloc(NProbe * sizeof *Probe);
+	for (i = 0; i < n; i++) {
+		Probe[2*i] = words[(i * 7919) % n];
+		Probe[2*i+1] = miss[i];
+	}
+	bench_init(1, 7);
+	bench_note("%lu words; trie8 %lu nodes %lu bytes, trie1 %lu bytes\n",
+		(unsigned long)n, (unsigned long)T8->nodes, (unsigned long)T8->bytes,
+		(unsigned long)trie_bytes(T1));
+	bench_section("find UTF-8", "lookups/s");
+	bench_run("mbstowcs+trie_find", trial_trie1, NULL, (double)NProbe);
+	bench_run("trie8_find", trial_trie8, NULL, (double)NProbe);
+	trie8_free(T8);
+	trie_free(T1);
+	free(Probe);
+	free_words(words, n);
+	free_words(miss, n);
+	return 0;
+}
+#endif
+
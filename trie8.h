@@ -0,0 +1,64 @@
+
+/*
+ * byte-keyed string trie, for UTF-8 (or any bytes) as-is; see trie8.c
+ */
+
+#ifndef TRIE8_H
+#define TRIE8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * children are found through a 256-bit map of which bytes have one: the
+ * child for byte b is child[number of set bits below b], so no sibling walk.
+ * child[] grows in place, so nodes move; parents hold the only pointer
+ */
+struct trie8_node {
+	uint64_t bits[4];
+	uint8_t base[4];  /* set bits in bits[0..i-1] */
+	uint16_t n,       /* children */
+	         cap;     /* room in child[] */
+	uint8_t term;     /* a string ends here */
+	struct trie8_node *child[];
+};
+
+/*
+ * does n have a child for byte c, and where is/would it be in child[]
+ */
+static inline int trie8_has_child(const struct trie8_node *n, uint8_t c)
+{
+	return (int)(n->bits[c >> 6] >> (c & 63) & 1);
+}
+
+static inline unsigned trie8_child_index(const struct trie8_node *n, uint8_t c)
+{
+	uint64_t below = ((uint64_t)1 << (c & 63)) - 1;
+	return n->base[c >> 6] + (unsigned)__builtin_popcountll(n->bits[c >> 6] & below);
+}
+
+#define TRIE8_NODE_SIZE(cap) (sizeof(struct trie8_node) + (cap) * sizeof(struct trie8_node *))
+
+struct trie8 {
+	struct trie8_node *root;
+	size_t nodes,
+	       bytes;     /* held in nodes */
+};
+
+/*
+ * called with each match; return non-zero to stop, and that's returned
+ */
+typedef int trie8_prefix_fn(const char *str, size_t len, void *arg);
+
+struct trie8 * trie8_new(void);
+void trie8_free(struct trie8 *);
+void trie8_add(struct trie8 *, const char *);
+void trie8_add_len(struct trie8 *, const char *, size_t);
+int  trie8_find(const struct trie8 *, const char *);
+int  trie8_find_len(const struct trie8 *, const char *, size_t);
+int  trie8_del(struct trie8 *, const char *);
+int  trie8_del_len(struct trie8 *, const char *, size_t);
+int  trie8_prefix_each(const struct trie8 *, const char *, size_t, trie8_prefix_fn *, void *);
+
+#endif
+
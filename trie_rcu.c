@@ -0,0 +1,748 @@
+
+/*
+ * trie8 for a read-mostly trie shared by threads: lookups take no lock and
+ * never wait, however many there are and whatever the writer is doing.
+ *
+ * nodes are never changed once a reader could see them. a write copies the
+ * nodes on the path to the string it touches, from the bottom up, and swaps
+ * in the new root; a lookup runs on whichever root it loaded, old or new.
+ * bitmap nodes make that one node copy per level; with trie1's sibling lists
+ * it'd be every sibling before the one on the path, too.
+ *
+ * the nodes a write replaced are freed once no lookup can be in them
+ * (epochs): each reader thread has a slot, and a lookup puts the global
+ * epoch in it on the way in and clears it on the way out. a write retires
+ * the old path tagged with the epoch, then bumps it; a retired node goes
+ * once every busy slot shows a later epoch than its tag.
+ *
+ * writers take a mutex among themselves; readers are never held up by it.
+ *
+ * test:  cc -c trie8.c && cc -DDEBUG -pthread trie_rcu.c trie8.o
+ * bench: cc -O3 -c trie8.c && cc -O3 -DBENCH -pthread trie_rcu.c trie8.o
+ */
+
+#ifdef BENCH
+#include "bench.h" /* first; it wants _GNU_SOURCE */
+#endif
+#if !defined(_GNU_SOURCE) && !defined(_POSIX_C_SOURCE)
+# define _POSIX_C_SOURCE 200809L /* posix_memalign() */
+#endif
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trie8.h"
+#include "trie_rcu.h"
+
+/*
+ * a node with room for exactly n children; it's never grown, only copied
+ */
+static struct trie8_node * node_alloc(struct trie_rcu *t, unsigned n)
+{
+	struct trie8_node *m = calloc(1, TRIE8_NODE_SIZE(n));
+	m->cap = (uint16_t)n;
+	t->nodes++;
+	t->bytes += TRIE8_NODE_SIZE(n);
+	return m;
+}
+
+static struct trie8_node * node_copy(struct trie_rcu *t, const struct trie8_node *n)
+{
+	struct trie8_node *m = node_alloc(t, n->n);
+	memcpy(m, n, TRIE8_NODE_SIZE(n->n));
+	m->cap = n->n;
+	return m;
+}
+
+static void set_bit(struct trie8_node *n, uint8_t c)
+{
+	unsigned w;
+	n->bits[c >> 6] |= (uint64_t)1 << (c & 63);
+	for (w = (c >> 6) + 1u; w < 4; w++)
+		n->base[w]++;
+}
+
+static void clear_bit(struct trie8_node *n, uint8_t c)
+{
+	unsigned w;
+	n->bits[c >> 6] &= ~((uint64_t)1 << (c & 63));
+	for (w = (c >> 6) + 1u; w < 4; w++)
+		n->base[w]--;
+}
+
+/*
+ * copies of n with child c added for byte b, and with b's child taken out
+ */
+static struct trie8_node * node_insert(struct trie_rcu *t, const struct trie8_node *n, uint8_t b, struct trie8_node *c)
+{
+	unsigned i = trie8_child_index(n, b);
+	struct trie8_node *m = node_alloc(t, n->n + 1u);
+	memcpy(m, n, sizeof *m);
+	memcpy(m->child, n->child, i * sizeof n->child[0]);
+	memcpy(m->child + i + 1, n->child + i, (n->n - i) * sizeof n->child[0]);
+	m->child[i] = c;
+	m->n = m->cap = (uint16_t)(n->n + 1u);
+	set_bit(m, b);
+	return m;
+}
+
+static struct trie8_node * node_remove(struct trie_rcu *t, const struct trie8_node *n, uint8_t b)
+{
+	unsigned i = trie8_child_index(n, b);
+	struct trie8_node *m = node_alloc(t, n->n - 1u);
+	memcpy(m, n, sizeof *m);
+	memcpy(m->child, n->child, i * sizeof n->child[0]);
+	memcpy(m->child + i, n->child + i + 1, (n->n - i - 1) * sizeof n->child[0]);
+	m->n = m->cap = (uint16_t)(n->n - 1u);
+	clear_bit(m, b);
+	return m;
+}
+
+/*
+ * n is no longer reachable from the newest root, but lookups that started
+ * before may still be in it
+ */
+static void retire(struct trie_rcu *t, const struct trie8_node *n)
+{
+	if (t->nretired == t->maxretired) {
+		t->maxretired = t->maxretired ? t->maxretired * 2 : 64;
+		t->retired = realloc(t->retired, t->maxretired * sizeof t->retired[0]);
+	}
+	t->retired[t->nretired].node = (struct trie8_node *)n;
+	t->retired[t->nretired].epoch = t->epoch;
+	t->nretired++;
+	t->nodes--;
+	t->bytes -= TRIE8_NODE_SIZE(n->cap);
+}
+
+/*
+ * free what no lookup can still be in; retired[] is in epoch order. returns
+ * how many are left waiting
+ */
+static size_t reclaim(struct trie_rcu *t)
+{
+	uint64_t oldest = UINT64_MAX;
+	size_t i,
+	       k;
+	for (i = 0; i < TRIE_RCU_READERS; i++) {
+		uint64_t e = __atomic_load_n(&t->reader[i].epoch, __ATOMIC_SEQ_CST);
+		if (e && e < oldest)
+			oldest = e;
+	}
+	for (k = 0; k < t->nretired && t->retired[k].epoch < oldest; k++)
+		free(t->retired[k].node);
+	memmove(t->retired, t->retired + k, (t->nretired - k) * sizeof t->retired[0]);
+	t->nretired -= k;
+	return t->nretired;
+}
+
+/*
+ * the new root is complete before anyone can load it; retired nodes are
+ * tagged with the epoch before the bump, so any lookup that could have
+ * loaded the old root shows that epoch or an earlier one
+ */
+static void publish(struct trie_rcu *t, struct trie8_node *root)
+{
+	__atomic_store_n(&t->root, root, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&t->epoch, t->epoch + 1, __ATOMIC_SEQ_CST);
+	reclaim(t);
+}
+
+/*
+ * aligned to a cache line, or reader[]'s slots would each straddle two and
+ * share them with their neighbours
+ */
+struct trie_rcu * trie_rcu_new(void)
+{
+	struct trie_rcu *t;
+	if (posix_memalign((void **)&t, TRIE_RCU_CACHELINE, sizeof *t))
+		return NULL;
+	memset(t, 0, sizeof *t);
+	t->bytes = sizeof *t;
+	t->epoch = 1; /* 0 marks an idle reader */
+	pthread_mutex_init(&t->lock, NULL);
+	t->root = node_alloc(t, 0);
+	return t;
+}
+
+static void do_trie_rcu_free(struct trie8_node *n)
+{
+	unsigned i;
+	for (i = 0; i < n->n; i++)
+		do_trie_rcu_free(n->child[i]);
+	free(n);
+}
+
+/*
+ * no readers or writers may be left
+ */
+void trie_rcu_free(struct trie_rcu *t)
+{
+	size_t i;
+	do_trie_rcu_free(t->root);
+	for (i = 0; i < t->nretired; i++)
+		free(t->retired[i].node);
+	free(t->retired);
+	pthread_mutex_destroy(&t->lock);
+	free(t);
+}
+
+/*
+ * a reader slot for the calling thread, or NULL if all TRIE_RCU_READERS
+ * are taken
+ */
+struct trie_rcu_reader * trie_rcu_reader(struct trie_rcu *t)
+{
+	unsigned i;
+	for (i = 0; i < TRIE_RCU_READERS; i++) {
+		int unused = 0;
+		if (__atomic_compare_exchange_n(&t->reader[i].used, &unused, 1, 0,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			t->reader[i].t = t;
+			t->reader[i].epoch = 0;
+			return &t->reader[i];
+		}
+	}
+	return NULL;
+}
+
+void trie_rcu_reader_done(struct trie_rcu_reader *r)
+{
+	__atomic_store_n(&r->used, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * the epoch is in our slot before the root is loaded, so a writer that
+ * replaced the root we get sees us when it goes to free the old one
+ */
+static const struct trie8_node * enter(struct trie_rcu_reader *r)
+{
+	__atomic_store_n(&r->epoch, __atomic_load_n(&r->t->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&r->t->root, __ATOMIC_SEQ_CST);
+}
+
+static void leave(struct trie_rcu_reader *r)
+{
+	__atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+static const struct trie8_node * child(const struct trie8_node *n, uint8_t c)
+{
+	return trie8_has_child(n, c) ? n->child[trie8_child_index(n, c)] : NULL;
+}
+
+int trie_rcu_find_len(struct trie_rcu_reader *r, const char *s, size_t len)
+{
+	const struct trie8_node *n = enter(r);
+	size_t i;
+	int found;
+	for (i = 0; i < len && n; i++)
+		n = child(n, (uint8_t)s[i]);
+	found = n && n->term;
+	leave(r);
+	return found;
+}
+
+int trie_rcu_find(struct trie_rcu_reader *r, const char *s)
+{
+	const struct trie8_node *n = enter(r);
+	int found;
+	while (*s && n)
+		n = child(n, (uint8_t)*s++);
+	found = n && n->term;
+	leave(r);
+	return found;
+}
+
+/*
+ * run f on every string in t that's a prefix of s[0..len); f runs inside
+ * the lookup, so nothing is freed until it's all done
+ */
+int trie_rcu_prefix_each(struct trie_rcu_reader *r, const char *s, size_t len, trie8_prefix_fn *f, void *arg)
+{
+	const struct trie8_node *n = enter(r);
+	size_t i;
+	int stop = 0;
+	for (i = 0; i < len && !stop; i++) {
+		if (!(n = child(n, (uint8_t)s[i])))
+			break;
+		if (n->term)
+			stop = f(s, i + 1, arg);
+	}
+	leave(r);
+	return stop;
+}
+
+/*
+ * nodes for s[0..len), the last one ending a string
+ */
+static struct trie8_node * chain(struct trie_rcu *t, const uint8_t *s, size_t len)
+{
+	struct trie8_node *n = node_alloc(t, 0);
+	n->term = 1;
+	while (len--) {
+		struct trie8_node *p = node_alloc(t, 1);
+		p->child[0] = n;
+		p->n = 1;
+		set_bit(p, s[len]);
+		n = p;
+	}
+	return n;
+}
+
+/*
+ * a copy of n with s added, or NULL if it's already there
+ */
+static struct trie8_node * cow_add(struct trie_rcu *t, const struct trie8_node *n, const uint8_t *s, size_t len)
+{
+	struct trie8_node *m,
+	                  *c;
+	if (!len) {
+		if (n->term)
+			return NULL;
+		m = node_copy(t, n);
+		m->term = 1;
+	} else if (trie8_has_child(n, *s)) {
+		unsigned i = trie8_child_index(n, *s);
+		if (!(c = cow_add(t, n->child[i], s + 1, len - 1)))
+			return NULL;
+		m = node_copy(t, n);
+		m->child[i] = c;
+	} else {
+		m = node_insert(t, n, *s, chain(t, s + 1, len - 1));
+	}
+	retire(t, n);
+	return m;
+}
+
+/*
+ * a copy of n without s, or NULL if that leaves nothing; n itself if s
+ * isn't there, with *found = 0
+ */
+static struct trie8_node * cow_del(struct trie_rcu *t, const struct trie8_node *n, const uint8_t *s, int *found)
+{
+	struct trie8_node *m,
+	                  *c;
+	*found = 0;
+	if (!*s) {
+		if (!n->term)
+			return (struct trie8_node *)n;
+		*found = 1;
+		m = NULL;
+		if (n->n) {
+			m = node_copy(t, n);
+			m->term = 0;
+		}
+	} else {
+		unsigned i;
+		if (!trie8_has_child(n, *s))
+			return (struct trie8_node *)n;
+		i = trie8_child_index(n, *s);
+		c = cow_del(t, n->child[i], s + 1, found);
+		if (!*found)
+			return (struct trie8_node *)n;
+		if (c) {
+			m = node_copy(t, n);
+			m->child[i] = c;
+		} else if (n->n > 1 || n->term) {
+			m = node_remove(t, n, *s);
+		} else {
+			m = NULL;
+		}
+	}
+	retire(t, n);
+	return m;
+}
+
+/*
+ * returns 1 if s is new
+ */
+int trie_rcu_add_len(struct trie_rcu *t, const char *s, size_t len)
+{
+	struct trie8_node *root;
+	pthread_mutex_lock(&t->lock);
+	if ((root = cow_add(t, t->root, (const uint8_t *)s, len)))
+		publish(t, root);
+	pthread_mutex_unlock(&t->lock);
+	return !!root;
+}
+
+int trie_rcu_add(struct trie_rcu *t, const char *s)
+{
+	return trie_rcu_add_len(t, s, strlen(s));
+}
+
+int trie_rcu_del(struct trie_rcu *t, const char *s)
+{
+	struct trie8_node *root;
+	int found;
+	pthread_mutex_lock(&t->lock);
+	root = cow_del(t, t->root, (const uint8_t *)s, &found);
+	if (found)
+		publish(t, root ? root : node_alloc(t, 0));
+	pthread_mutex_unlock(&t->lock);
+	return found;
+}
+
+/*
+ * free what's been retired if the lookups that might be in it are done;
+ * writes do this as they go, but a writer gone quiet can call it. returns
+ * how many nodes are still waiting
+ */
+size_t trie_rcu_reclaim(struct trie_rcu *t)
+{
+	size_t left;
+	pthread_mutex_lock(&t->lock);
+	left = reclaim(t);
+	pthread_mutex_unlock(&t->lock);
+	return left;
+}
+
+#if defined(DEBUG) || defined(BENCH)
+/*
+ * n random lowercase words of 1-12 letters from the first 'letters' of the
+ * alphabet; few letters, many shared prefixes
+ */
+static char ** random_words(size_t n, int letters, unsigned *seed)
+{
+	char **w = malloc(n * sizeof *w);
+	size_t i;
+	for (i = 0; i < n; i++) {
+		size_t len = 1 + (size_t)(rand_r(seed) % 12),
+		       j;
+		w[i] = malloc(len + 1);
+		for (j = 0; j < len; j++)
+			w[i][j] = (char)('a' + rand_r(seed) % letters);
+		w[i][len] = '\0';
+	}
+	return w;
+}
+
+static void free_words(char **w, size_t n)
+{
+	while (n--)
+		free(w[n]);
+	free(w);
+}
+#endif
+
+#ifdef DEBUG
+
+/*
+ * the same adds and deletes as a trie8, one thread
+ */
+static void test_against_trie8(void)
+{
+	const size_t n = 20000;
+	unsigned seed = 1;
+	char **w = random_words(n, 6, &seed);
+	struct trie_rcu *t = trie_rcu_new();
+	struct trie_rcu_reader *r = trie_rcu_reader(t);
+	struct trie8 *t8 = trie8_new();
+	size_t i;
+	printf("test_against_trie8... ");
+	assert(0 == (uintptr_t)t % TRIE_RCU_CACHELINE);
+	assert(0 == (uintptr_t)&t->reader[0] % TRIE_RCU_CACHELINE);
+	for (i = 0; i < n; i++) {
+		int isnew = !trie8_find(t8, w[i]);
+		assert(isnew == trie_rcu_add(t, w[i]));
+		trie8_add(t8, w[i]);
+		if (i % 3 == 0) {
+			const char *d = w[rand_r(&seed) % (i + 1)];
+			assert(trie8_del(t8, d) == trie_rcu_del(t, d));
+		}
+	}
+	for (i = 0; i < n; i++)
+		assert(trie8_find(t8, w[i]) == trie_rcu_find(r, w[i]));
+	for (i = 0; i < n; i++) {
+		trie8_del(t8, w[i]);
+		trie_rcu_del(t, w[i]);
+	}
+	assert(1 == t->nodes);
+	assert(0 == trie_rcu_reclaim(t)); /* nobody inside a lookup */
+	trie_rcu_reader_done(r);
+	trie_rcu_free(t);
+	trie8_free(t8);
+	free_words(w, n);
+	printf("OK.\n");
+}
+
+/*
+ * readers look for words that are always there while a writer adds and
+ * deletes others around them; under -fsanitize=address any node freed too
+ * early shows up
+ */
+#define STRESS_READERS 4
+
+static struct trie_rcu *Stress;
+static char **Keep,
+            **Churn;
+static size_t NKeep,
+              NChurn;
+static int Stop;
+
+static int count_prefix(const char *s, size_t len, void *arg)
+{
+	(void)s, (void)len;
+	++*(size_t *)arg;
+	return 0;
+}
+
+static void * stress_reader(void *arg)
+{
+	struct trie_rcu_reader *r = trie_rcu_reader(Stress);
+	size_t i = 0,
+	       lookups = 0;
+	(void)arg;
+	assert(r);
+	while (!__atomic_load_n(&Stop, __ATOMIC_RELAXED)) {
+		size_t n = 0;
+		const char *s = Keep[i++ % NKeep];
+		assert(trie_rcu_find(r, s));
+		trie_rcu_find(r, Churn[i % NChurn]);
+		trie_rcu_prefix_each(r, s, strlen(s), count_prefix, &n);
+		assert(n >= 1);
+		lookups++;
+	}
+	trie_rcu_reader_done(r);
+	return (void *)lookups;
+}
+
+static void test_stress(void)
+{
+	pthread_t th[STRESS_READERS];
+	unsigned seed = 2;
+	size_t i,
+	       round,
+	       nodes;
+	printf("test_stress... ");
+	NKeep = 2000;
+	NChurn = 2000;
+	Keep = random_words(NKeep, 5, &seed);
+	Churn = random_words(NChurn, 5, &seed);
+	for (i = 0; i < NChurn; i++) { /* never a Keep word, and often below one */
+		size_t len = strlen(Keep[i]);
+		Churn[i] = realloc(Churn[i], len + 2);
+		memcpy(Churn[i], Keep[i], len);
+		Churn[i][len] = 'z';
+		Churn[i][len + 1] = '\0';
+	}
+	Stress = trie_rcu_new();
+	for (i = 0; i < NKeep; i++)
+		trie_rcu_add(Stress, Keep[i]);
+	nodes = Stress->nodes;
+	for (i = 0; i < STRESS_READERS; i++)
+		pthread_create(&th[i], NULL, stress_reader, NULL);
+	for (round = 0; round < 20; round++) {
+		for (i = 0; i < NChurn; i++)
+			trie_rcu_add(Stress, Churn[i]);
+		for (i = 0; i < NChurn; i++)
+			trie_rcu_del(Stress, Churn[i]);
+	}
+	__atomic_store_n(&Stop, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < STRESS_READERS; i++)
+		pthread_join(th[i], NULL);
+	assert(nodes == Stress->nodes);
+	assert(0 == trie_rcu_reclaim(Stress));
+	trie_rcu_free(Stress);
+	free_words(Keep, NKeep);
+	free_words(Churn, NChurn);
+	printf("OK.\n");
+}
+
+int main(void)
+{
+	struct trie_rcu *t = trie_rcu_new();
+	struct trie_rcu_reader *r = trie_rcu_reader(t);
+	size_t n = 0;
+	assert(r);
+	assert( trie_rcu_add(t, "tea"));
+	assert(!trie_rcu_add(t, "tea"));
+	assert( trie_rcu_add(t, "ted"));
+	assert( trie_rcu_add(t, "t\xC3\xA9"));
+	assert(!trie_rcu_find(r, ""));
+	assert(!trie_rcu_find(r, "t"));
+	assert( trie_rcu_find(r, "tea"));
+	assert( trie_rcu_find(r, "t\xC3\xA9"));
+	assert( trie_rcu_find_len(r, "teapot", 3));
+	assert( trie_rcu_del(t, "tea"));
+	assert(!trie_rcu_del(t, "tea"));
+	assert(!trie_rcu_find(r, "tea"));
+	assert( trie_rcu_find(r, "ted"));
+	assert( trie_rcu_add(t, "te"));
+	trie_rcu_prefix_each(r, "tedious", 7, count_prefix, &n);
+	assert(2 == n);
+	assert( trie_rcu_del(t, "te"));
+	assert( trie_rcu_del(t, "ted"));
+	assert( trie_rcu_del(t, "t\xC3\xA9"));
+	assert(1 == t->nodes);
+	trie_rcu_reader_done(r);
+	trie_rcu_free(t);
+	test_against_trie8();
+	test_stress();
+	return 0;
+}
+#endif
+
+#ifdef BENCH
+/*
+ * lookups/s from k reader threads while a writer adds and deletes a word
+ * every 100us: here, and against one trie8 behind a mutex
+ */
+#include <time.h>
+#include <unistd.h>
+
+static struct trie_rcu *TR;
+static struct trie8 *T8;
+static pthread_mutex_t T8_Lock = PTHREAD_MUTEX_INITIALIZER;
+static char **Probe,
+            **Churn;
+static size_t NProbe,
+              NChurn,
+              Writes;
+static int Stop;
+
+static void * reader_rcu(void *arg)
+{
+	struct trie_rcu_reader *r = trie_rcu_reader(TR);
+	size_t i,
+	       off = (size_t)arg * 7919,
+	       hits = 0;
+	for (i = 0; i < NProbe; i++)
+		hits += trie_rcu_find(r, Probe[(i + off) % NProbe]);
+	trie_rcu_reader_done(r);
+	BENCH_USE(hits);
+	return NULL;
+}
+
+static void * reader_mutex(void *arg)
+{
+	size_t i,
+	       off = (size_t)arg * 7919,
+	       hits = 0;
+	for (i = 0; i < NProbe; i++) {
+		pthread_mutex_lock(&T8_Lock);
+		hits += trie8_find(T8, Probe[(i + off) % NProbe]);
+		pthread_mutex_unlock(&T8_Lock);
+	}
+	BENCH_USE(hits);
+	return NULL;
+}
+
+static void * writer(void *arg)
+{
+	const struct timespec pause = { 0, 100000 };
+	size_t i = 0;
+	(void)arg;
+	while (!__atomic_load_n(&Stop, __ATOMIC_RELAXED)) {
+		const char *s = Churn[i++ % NChurn];
+		if (TR) {
+			trie_rcu_add(TR, s);
+			trie_rcu_del(TR, s);
+		} else {
+			pthread_mutex_lock(&T8_Lock);
+			trie8_add(T8, s);
+			trie8_del(T8, s);
+			pthread_mutex_unlock(&T8_Lock);
+		}
+		__atomic_fetch_add(&Writes, 2, __ATOMIC_RELAXED);
+		nanosleep(&pause, NULL);
+	}
+	return NULL;
+}
+
+struct readers {
+	size_t k;
+	void * (*fn)(void *);
+};
+
+static void trial_readers(void *arg)
+{
+	const struct readers *r = arg;
+	pthread_t th[TRIE_RCU_READERS];
+	size_t i;
+	for (i = 0; i < r->k; i++)
+		pthread_create(&th[i], NULL, r->fn, (void *)i);
+	for (i = 0; i < r->k; i++)
+		pthread_join(th[i], NULL);
+}
+
+/*
+ * k readers, with the writer running throughout
+ */
+static void run(const char *name, void * (*fn)(void *), size_t k)
+{
+	struct readers r;
+	pthread_t w;
+	r.k = k;
+	r.fn = fn;
+	Writes = 0;
+	Stop = 0;
+	pthread_create(&w, NULL, writer, NULL);
+	bench_run(name, trial_readers, &r, (double)(k * NProbe));
+	__atomic_store_n(&Stop, 1, __ATOMIC_RELAXED);
+	pthread_join(w, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000,
+	       maxk = argc > 2 ? strtoul(argv[2], NULL, 10) : 8,
+	       i,
+	       k;
+	unsigned seed = 1;
+	char **words,
+	     **miss;
+	if (maxk > TRIE_RCU_READERS)
+		maxk = TRIE_RCU_READERS;
+	words = random_words(n, 26, &seed);
+	miss = random_words(n, 26, &seed);
+	NChurn = 1000;
+	Churn = malloc(NChurn * sizeof *Churn);
+	for (i = 0; i < NChurn; i++) { /* below a real word, but never one */
+		const char *w = words[(i * 104729) % n];
+		size_t len = strlen(w);
+		Churn[i] = malloc(len + 2);
+		memcpy(Churn[i], w, len);
+		Churn[i][len] = '0';
+		Churn[i][len + 1] = '\0';
+	}
+	TR = trie_rcu_new();
+	T8 = trie8_new();
+	for (i = 0; i < n; i++) {
+		trie_rcu_add(TR, words[i]);
+		trie8_add(T8, words[i]);
+	}
+	NProbe = 2 * n;
+	Probe = malloc(NProbe * sizeof *Probe);
+	for (i = 0; i < n; i++) {
+		Probe[2*i] = words[(i * 7919) % n];
+		Probe[2*i+1] = miss[i];
+	}
+	bench_init(1, 5);
+	bench_note("%lu words, %ld cpus online; trie_rcu %lu nodes %lu bytes\n",
+		(unsigned long)n, sysconf(_SC_NPROCESSORS_ONLN),
+		(unsigned long)TR->nodes, (unsigned long)TR->bytes);
+	for (k = 1; k <= maxk; k *= 2) {
+		char title[64];
+		struct trie_rcu *tr = TR;
+		snprintf(title, sizeof title, "%lu reader%s + 1 writer", (unsigned long)k, k > 1 ? "s" : "");
+		bench_section(title, "lookups/s");
+		TR = NULL; /* the writer goes to T8 */
+		run("mutex+trie8_find", reader_mutex, k);
+		TR = tr;
+		run("trie_rcu_find", reader_rcu, k);
+		bench_note("%lu writes; %lu nodes waiting to be freed\n",
+			(unsigned long)Writes, (unsigned long)trie_rcu_reclaim(TR));
+	}
+	trie_rcu_free(TR);
+	trie8_free(T8);
+	free(Probe);
+	free_words(words, n);
+	free_words(miss, n);
+	free_words(Churn, NChurn);
+	return 0;
+}
+#endif
@@ -0,0 +1,57 @@
+
+/*
+ * trie8 for many reader threads and the odd writer; see trie_rcu.c
+ */
+
+#ifndef TRIE_RCU_H
+#define TRIE_RCU_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "trie8.h"
+
+#define TRIE_RCU_READERS   64
+#define TRIE_RCU_CACHELINE 64
+
+struct trie_rcu;
+
+/*
+ * one per reader thread, each on its own cache line so that entering and
+ * leaving a lookup doesn't bounce a line between readers
+ */
+struct trie_rcu_reader {
+	uint64_t epoch;       /* global epoch when this lookup began; 0: idle */
+	int used;
+	struct trie_rcu *t;
+} __attribute__((aligned(TRIE_RCU_CACHELINE)));
+
+struct trie_rcu {
+	struct trie8_node *root;  /* never changed once published */
+	uint64_t epoch;
+	pthread_mutex_t lock;     /* writers */
+	struct {
+		struct trie8_node *node;
+		uint64_t epoch;       /* unlinked during this epoch */
+	} *retired;
+	size_t nretired,
+	       maxretired,
+	       nodes,
+	       bytes;
+	struct trie_rcu_reader reader[TRIE_RCU_READERS];
+};
+
+struct trie_rcu * trie_rcu_new(void);
+void trie_rcu_free(struct trie_rcu *);
+struct trie_rcu_reader * trie_rcu_reader(struct trie_rcu *);
+void trie_rcu_reader_done(struct trie_rcu_reader *);
+int  trie_rcu_find(struct trie_rcu_reader *, const char *);
+int  trie_rcu_find_len(struct trie_rcu_reader *, const char *, size_t);
+int  trie_rcu_prefix_each(struct trie_rcu_reader *, const char *, size_t, trie8_prefix_fn *, void *);
+int  trie_rcu_add(struct trie_rcu *, const char *);
+int  trie_rcu_add_len(struct trie_rcu *, const char *, size_t);
+int  trie_rcu_del(struct trie_rcu *, const char *);
+size_t trie_rcu_reclaim(struct trie_rcu *);
+
+#endif
+
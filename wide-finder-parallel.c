@@ -1,77 +1,1131 @@
 /* ex: set ts=2 et: */
-/*  */
+/*
+ * Tim Bray's wide finder: the 10 most fetched ongoing articles in an access
+ * log, i.e. the commonest captures of
+ *
+ *   GET /ongoing/When/\d\d\dx/(\d\d\d\d/\d\d/\d\d/[^ .]+)
+ *
+ * the log is mmap()ed and cut at line ends into a run per worker thread.
+ * each worker counts into its own hash table, keyed by pointers into the
+ * map so nothing is copied, and the tables are added up once they're all
+ * done; nothing is shared while counting, so it goes as fast as there are
+ * cores to count and memory to feed them.
+ *
+ * what can't be mapped, or shouldn't be (a pipe, a log bigger than half of
+ * memory, or anything with -s), streams through a few buffers per worker
+ * instead; see stream_launch().
+ *
+ *   cc -O2 -pthread wide-finder-parallel.c
+ *   ./a.out [-s] [-p] access.log|- [workers]     (-p: pread, not io_uring)
+ *   zcat access.log.gz | ./a.out -
+ *
+ * bench (1 worker up to one per cpu, then mmap against streaming from a warm
+ * and a cold page cache, over a made-up log of 'mb' megabytes in 'dir'):
+ *   cc -O3 -pthread -DBENCH wide-finder-parallel.c && ./a.out [mb [dir]]
+ */
 
+#ifdef BENCH
+#include "bench.h" /* first; it wants _GNU_SOURCE */
+#endif
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* memmem() */
+#endif
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define WORKERS 4
+#define WORKERS 64 /* at most */
+#define TOP     10
 
 #ifndef O_LARGEFILE
 # define O_LARGEFILE 0
 #endif
 
-static int          Fd;
+static int          Fd = -1;
 static struct stat  Stat;
-static void        *Map;
-static int          ShmId;
-static unsigned     Workers = WORKERS;
+static const char  *Map;
+
+/*
+ * how many times each key came up; an open-addressed table, a power of 2
+ * big and at most half full, and key == NULL is an empty slot. with 'copy'
+ * each key is copied the first time it comes up, for when what it was found
+ * in won't be around
+ */
+typedef struct {
+  const char *key;
+  uint32_t len;
+  uint64_t hash,
+           n;
+} hit;
+
+typedef struct {
+  hit *slot;
+  size_t size,
+         used;
+  int copy;
+} counts;
+
+static uint64_t key_hash(const char *key, size_t len)
+{
+  uint64_t h = 0xCBF29CE484222325ull; /* FNV-1a */
+  while (len--) {
+    h ^= (unsigned char)*key++;
+    h *= 0x100000001B3ull;
+  }
+  return h;
+}
+
+/*
+ * key's slot: where it is, or the empty one it'd go in
+ */
+static hit * counts_slot(const counts *c, const char *key, uint32_t len, uint64_t hash)
+{
+  size_t j;
+  for (j = hash & (c->size - 1); c->slot[j].key; j = (j + 1) & (c->size - 1)) {
+    hit *h = c->slot + j;
+    if (h->hash == hash && h->len == len && !memcmp(h->key, key, len))
+      break;
+  }
+  return c->slot + j;
+}
+
+static void counts_grow(counts *c)
+{
+  hit *old = c->slot;
+  size_t i,
+         size = c->size;
+  c->size = size ? size * 2 : 1024;
+  c->slot = calloc(c->size, sizeof *c->slot);
+  for (i = 0; i < size; i++)
+    if (old[i].key)
+      *counts_slot(c, old[i].key, old[i].len, old[i].hash) = old[i];
+  free(old);
+}
+
+static void counts_add(counts *c, const char *key, uint32_t len, uint64_t hash, uint64_t n)
+{
+  hit *h;
+  if (2 * (c->used + 1) > c->size)
+    counts_grow(c);
+  h = counts_slot(c, key, len, hash);
+  if (!h->key) {
+    if (c->copy) {
+      char *k = malloc(len ? len : 1);
+      memcpy(k, key, len);
+      key = k;
+    }
+    h->key = key;
+    h->len = len;
+    h->hash = hash;
+    c->used++;
+  }
+  h->n += n;
+}
+
+static void counts_free(counts *c)
+{
+  size_t i;
+  if (c->copy)
+    for (i = 0; i < c->size; i++)
+      free((void *)c->slot[i].key);
+  free(c->slot);
+  c->slot = NULL;
+  c->size = c->used = 0;
+}
+
+#define NEEDLE "GET /ongoing/When/"
+
+/*
+ * just past NEEDLE, the rest of the pattern: its capture, or NULL. '0' in
+ * Shape is any digit
+ */
+static const char * article(const char *p, const char *end, uint32_t *len)
+{
+  static const char Shape[] = "000x/0000/00/00/";
+  const size_t shape = sizeof Shape - 1;
+  const char *q;
+  size_t i;
+  if ((size_t)(end - p) <= shape)
+    return NULL;
+  for (i = 0; i < shape; i++)
+    if ('0' == Shape[i] ? (unsigned)(p[i] - '0') > 9 : p[i] != Shape[i])
+      return NULL;
+  for (q = p + shape; q < end && ' ' != *q && '.' != *q && '\n' != *q; q++)
+    ;
+  if (q == p + shape || q == end || ' ' != *q)
+    return NULL;
+  *len = (uint32_t)(q - (p + 5));
+  return p + 5;
+}
+
+/*
+ * count every match in [p, end), which holds only whole lines
+ */
+static void count_run(counts *c, const char *p, const char *end)
+{
+  const size_t needle = sizeof NEEDLE - 1;
+  while ((p = memmem(p, (size_t)(end - p), NEEDLE, needle))) {
+    const char *key;
+    uint32_t len;
+    p += needle;
+    if ((key = article(p, end, &len))) {
+      counts_add(c, key, len, key_hash(key, len), 1);
+      p = key + len;
+    }
+  }
+}
+
+typedef struct {
+  const char *lo,
+             *hi;
+  counts c;
+} worker;
+
+static void * worker_run(void *arg)
+{
+  worker *w = arg;
+  count_run(&w->c, w->lo, w->hi);
+  return NULL;
+}
+
+static unsigned cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned)n : 1;
+}
 
 static void logfile_close(void)
 {
-  if (-1 == shmctl(ShmId, IPC_RMID, NULL))
-    perror("logfile_close shmctl");
+  if (Map && 0 != munmap((void *)Map, (size_t)Stat.st_size))
+    perror("logfile_close munmap");
+  Map = NULL;
   if (0 != close(Fd))
     perror("logfile_close close");
+  Fd = -1;
 }
 
+/*
+ * "-" is stdin
+ */
 static void logfile_open(const char *filename)
 {
-  Fd = open(filename, O_LARGFILE);
+  Fd = strcmp(filename, "-") ? open(filename, O_RDONLY | O_LARGEFILE) : STDIN_FILENO;
   if (0 > Fd) {
-    perror("open");
+    perror(filename);
     exit(EXIT_FAILURE);
   }
-  if (0 > stat(filename, &Stat)) {
-    perror("stat");
+  if (0 > fstat(Fd, &Stat)) {
+    perror("fstat");
     exit(EXIT_FAILURE);
   }
-  Map = mmap(NULL, (size_t)Stat.st_size, 0, PROT_READ, MAP_SHARED, Fd, 0);
-  if (NULL == Map) {
+  Map = NULL;
+}
+
+/*
+ * does 'bytes' fit in half of memory
+ */
+static int fits_memory(off_t bytes)
+{
+  long pages = sysconf(_SC_PHYS_PAGES),
+       size = sysconf(_SC_PAGESIZE);
+  return pages <= 0 || size <= 0 || (uint64_t)bytes <= (uint64_t)pages * (uint64_t)size / 2;
+}
+
+/*
+ * should it be mapped: is it a file, and not too big
+ */
+static int logfile_mappable(void)
+{
+  if (!S_ISREG(Stat.st_mode) || (uint64_t)Stat.st_size > SIZE_MAX)
+    return 0;
+  return fits_memory(Stat.st_size);
+}
+
+static void logfile_map(void)
+{
+  void *p;
+  if (!Stat.st_size)
+    return;
+  p = mmap(NULL, (size_t)Stat.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+  if (MAP_FAILED == p) {
     perror("mmap");
     exit(EXIT_FAILURE);
   }
-  ShmId = shmget((key_t)0, ShmBytes, IPC_CREAT);
-  if (-1 == ShmId) {
-    perror("shmget");
-    exit(EXIT_FAILURE);
+  madvise(p, (size_t)Stat.st_size, MADV_SEQUENTIAL);
+  Map = p;
+}
+
+/*
+ * count [p, p+len) with cnt workers, each a run of whole lines, into *total;
+ * this thread is the first worker
+ */
+static void workers_launch(const char *p, size_t len, unsigned cnt, counts *total)
+{
+  worker w[WORKERS];
+  pthread_t th[WORKERS];
+  int started[WORKERS];
+  size_t pos = 0,
+         i;
+  unsigned k;
+  if (cnt > WORKERS)
+    cnt = WORKERS;
+  if (!cnt)
+    cnt = 1;
+  memset(w, 0, sizeof w);
+  for (k = 0; k < cnt; k++) {
+    size_t hi = len / cnt * (k + 1);
+    const char *nl;
+    w[k].lo = p + pos;
+    if (k + 1 == cnt || hi <= pos)
+      hi = len;
+    else if ((nl = memchr(p + hi - 1, '\n', len - hi + 1)))
+      hi = (size_t)(nl - p) + 1;
+    else
+      hi = len;
+    w[k].hi = p + (pos = hi);
   }
-  ShmPtr = shmat(ShmId, ptr, 0);
-  if (NULL == ShmPtr) {
-    perror("shmat");
-    mem_close();
-    exit(EXIT_FAILURE);
+  for (k = 1; k < cnt; k++)
+    started[k] = !pthread_create(&th[k], NULL, worker_run, &w[k]);
+  worker_run(&w[0]);
+  for (k = 1; k < cnt; k++) {
+    if (started[k])
+      pthread_join(th[k], NULL);
+    else
+      worker_run(&w[k]);
+  }
+  for (k = 0; k < cnt; k++) {
+    for (i = 0; i < w[k].c.size; i++) {
+      const hit *h = w[k].c.slot + i;
+      if (h->key)
+        counts_add(total, h->key, h->len, h->hash, h->n);
+    }
+    counts_free(&w[k].c);
+  }
+}
+
+/*
+ * for what can't or shouldn't be mapped (a pipe, or a log bigger than half
+ * of memory) the log streams through a fixed set of buffers instead: this
+ * thread reads a chunk at a time into an empty one and queues it, the
+ * workers take full ones off the queue, count, and hand them back. memory
+ * is the same however big the log is, and a file too big to map has its
+ * pages dropped from the page cache as they're read, so it doesn't push
+ * everything else out.
+ *
+ * a buffer is twice a chunk: the read goes in the second half, at an
+ * aligned offset, and the unfinished last line of the chunk before is put
+ * just ahead of it, so workers only see whole lines. a line longer than a
+ * chunk is cut, and a match across the cut is missed.
+ *
+ * chunks come from a source, in order: read() for a pipe; pread() for a
+ * file; or for a file, when the kernel has it, io_uring with URING_DEPTH
+ * reads in flight so the disk always has a queue to work on, into buffers
+ * registered once so it needn't map and pin them for every read
+ */
+#define STREAM_CHUNK (4 << 20)
+#define URING_DEPTH  8
+#define STREAM_BUFS  (2 * WORKERS + URING_DEPTH) /* 2 per worker, and those being read into */
+
+#define STREAM_READ  0 /* read()/pread(), a chunk at a time */
+#define STREAM_URING 1 /* io_uring if we can, else STREAM_READ */
+
+typedef struct {
+  unsigned at[STREAM_BUFS],
+           head,
+           n;
+} ring;
+
+static void ring_push(ring *r, unsigned b)
+{
+  r->at[(r->head + r->n++) % STREAM_BUFS] = b;
+}
+
+static unsigned ring_pop(ring *r)
+{
+  unsigned b = r->at[r->head];
+  r->head = (r->head + 1) % STREAM_BUFS;
+  r->n--;
+  return b;
+}
+
+/*
+ * read() until there's len or there's no more; a pipe gives a little at a
+ * time. off < 0: from wherever fd is, else pread() from off
+ */
+static ssize_t read_full(int fd, char *p, size_t len, off_t off)
+{
+  size_t got = 0;
+  while (got < len) {
+    ssize_t rd = off < 0 ? read(fd, p + got, len - got)
+                         : pread(fd, p + got, len - got, off + (off_t)got);
+    if (rd < 0 && EINTR == errno)
+      continue;
+    if (rd < 0)
+      return -1;
+    if (!rd)
+      break;
+    got += (size_t)rd;
+  }
+  return (ssize_t)got;
+}
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  include <sys/uio.h>
+#  ifdef __NR_io_uring_setup
+#   define HAVE_URING
+#  endif
+# endif
+#endif
+
+#ifdef HAVE_URING
+/*
+ * just enough io_uring for reads, through the system calls themselves
+ * rather than liburing: a submission ring we fill and a completion ring we
+ * empty, both shared with the kernel
+ */
+typedef struct {
+  int fd,
+      fixed;        /* buffers registered: READ_FIXED */
+  unsigned *sq_tail,
+           *sq_mask,
+           *sq_array,
+           *cq_head,
+           *cq_tail,
+           *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq,
+       *cq;
+  size_t sq_len,
+         cq_len,
+         sqes_len;
+} uring;
+
+static int uring_open(uring *u, unsigned entries)
+{
+  struct io_uring_params p;
+  char *sq,
+       *cq;
+  memset(u, 0, sizeof *u);
+  memset(&p, 0, sizeof p);
+  u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0)
+    return 0; /* ENOSYS, or turned off */
+  u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (u->cq_len > u->sq_len)
+      u->sq_len = u->cq_len;
+    u->cq_len = 0;
+  }
+  u->sq = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  u->cq = u->cq_len ? mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING) : u->sq;
+  u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (MAP_FAILED == u->sq || MAP_FAILED == u->cq || MAP_FAILED == (void *)u->sqes) {
+    if (MAP_FAILED != u->sq)
+      munmap(u->sq, u->sq_len);
+    if (u->cq_len && MAP_FAILED != u->cq)
+      munmap(u->cq, u->cq_len);
+    if (MAP_FAILED != (void *)u->sqes)
+      munmap(u->sqes, u->sqes_len);
+    close(u->fd);
+    return 0;
+  }
+  sq = u->sq;
+  cq = u->cq;
+  u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p.sq_off.array);
+  u->cq_head = (unsigned *)(cq + p.cq_off.head);
+  u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 1;
+}
+
+static void uring_close(uring *u)
+{
+  munmap(u->sqes, u->sqes_len);
+  if (u->cq_len)
+    munmap(u->cq, u->cq_len);
+  munmap(u->sq, u->sq_len);
+  close(u->fd);
+}
+
+/*
+ * buffer k is iov[k] from now on; if the kernel won't pin that much (see
+ * RLIMIT_MEMLOCK) reads go to plain addresses instead
+ */
+static void uring_register(uring *u, struct iovec *iov, unsigned n)
+{
+  u->fixed = !syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+static int uring_read(uring *u, int fd, unsigned b, char *dst, size_t len, off_t off)
+{
+  unsigned tail = *u->sq_tail,
+           i = tail & *u->sq_mask;
+  struct io_uring_sqe *sqe = u->sqes + i;
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = u->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)dst;
+  sqe->len = (uint32_t)len;
+  sqe->off = (uint64_t)off;
+  sqe->buf_index = (uint16_t)b;
+  sqe->user_data = b;
+  u->sq_array[i] = i;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  while (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) < 0)
+    if (EINTR != errno && EAGAIN != errno && EBUSY != errno)
+      return 0;
+  return 1;
+}
+
+/*
+ * wait for at least one read to finish, and note what every finished one
+ * got, by buffer
+ */
+static int uring_reap(uring *u, ssize_t *got)
+{
+  unsigned head = *u->cq_head;
+  while (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    if (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && EINTR != errno)
+      return 0;
+  do {
+    const struct io_uring_cqe *cqe = u->cqes + (head & *u->cq_mask);
+    got[cqe->user_data] = cqe->res;
+    head++;
+  } while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE));
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  return 1;
+}
+#endif /* HAVE_URING */
+
+#define NOT_YET (-((ssize_t)1 << 40)) /* a read still in flight */
+
+typedef struct {
+  int fd,
+      regular,
+      eof,
+      uring;          /* reads go through u */
+  size_t chunk;
+  off_t off,          /* of the next read */
+        size;         /* a file's, when we started */
+  unsigned depth;     /* reads in flight, at most */
+  ring inflight;      /* buffers being read into, oldest first */
+  char *dst[STREAM_BUFS];
+  ssize_t got[STREAM_BUFS];
+  off_t at[STREAM_BUFS];
+#ifdef HAVE_URING
+  uring u;
+#endif
+} source;
+
+static const char *SourceName = "read";
+
+static void source_open(source *s, int fd, size_t chunk, int how, char **mem, unsigned nbuf)
+{
+  struct stat st;
+  memset(s, 0, sizeof *s);
+  s->fd = fd;
+  s->chunk = chunk;
+  s->depth = 1;
+  if (!fstat(fd, &st) && S_ISREG(st.st_mode)) {
+    s->regular = 1;
+    s->off = lseek(fd, 0, SEEK_CUR);
+    if (s->off < 0)
+      s->off = 0;
+    s->size = st.st_size;
+  }
+  SourceName = s->regular ? "pread" : "read";
+#ifdef HAVE_URING
+  if (s->regular && STREAM_URING == how && uring_open(&s->u, URING_DEPTH)) {
+    struct iovec iov[STREAM_BUFS];
+    unsigned k;
+    for (k = 0; k < nbuf; k++) {
+      iov[k].iov_base = mem[k] + chunk;
+      iov[k].iov_len = chunk;
+    }
+    uring_register(&s->u, iov, nbuf);
+    s->uring = 1;
+    s->depth = URING_DEPTH;
+    SourceName = s->u.fixed ? "io_uring, registered buffers" : "io_uring";
+  }
+#else
+  (void)how, (void)mem, (void)nbuf;
+#endif
+}
+
+static void source_close(source *s)
+{
+#ifdef HAVE_URING
+  if (s->uring)
+    uring_close(&s->u);
+#endif
+  (void)s;
+}
+
+/*
+ * is there more to start reading; a file is read as far as it went when we
+ * started, anything else until a read comes up short
+ */
+static int source_more(const source *s)
+{
+  return !s->eof && (!s->regular || s->off < s->size);
+}
+
+/*
+ * start reading the next chunk into buffer b, at dst
+ */
+static void source_start(source *s, unsigned b, char *dst)
+{
+  s->dst[b] = dst;
+  s->at[b] = s->off;
+  ring_push(&s->inflight, b);
+#ifdef HAVE_URING
+  if (s->uring) {
+    s->got[b] = NOT_YET;
+    if (uring_read(&s->u, s->fd, b, dst, s->chunk, s->off)) {
+      s->off += (off_t)s->chunk;
+      return;
+    }
+    s->got[b] = -1; /* errno is why */
+    return;
+  }
+#endif
+  s->got[b] = read_full(s->fd, dst, s->chunk, s->regular ? s->off : -1);
+  s->off += (off_t)s->chunk;
+}
+
+/*
+ * the oldest read: its buffer, and what it got or -1; a short read from a
+ * file that isn't at its end is finished here
+ */
+static ssize_t source_wait(source *s, unsigned *b)
+{
+  ssize_t got;
+  *b = s->inflight.at[s->inflight.head];
+#ifdef HAVE_URING
+  while (NOT_YET == s->got[*b])
+    if (!uring_reap(&s->u, s->got))
+      return -1;
+  if (s->got[*b] < 0 && s->got[*b] != -1) {
+    errno = (int)-s->got[*b];
+    s->got[*b] = -1;
+  }
+#endif
+  ring_pop(&s->inflight);
+  got = s->got[*b];
+  if (got >= 0 && (size_t)got < s->chunk && s->regular && s->at[*b] + got < s->size) {
+    ssize_t more = read_full(s->fd, s->dst[*b] + got, s->chunk - (size_t)got, s->at[*b] + got);
+    got = more < 0 ? -1 : got + more;
+  }
+  if (got < 0 || (size_t)got < s->chunk)
+    s->eof = 1;
+  return got;
+}
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t filled,
+                 emptied;
+  ring full,
+       empty;
+  int done;           /* nothing more will be filled */
+  struct {
+    char *mem;
+    const char *lo,   /* whole lines */
+               *hi;
+  } buf[STREAM_BUFS];
+} stream;
+
+typedef struct {
+  stream *s;
+  counts c;
+} stream_worker;
+
+static void * stream_run(void *arg)
+{
+  stream_worker *w = arg;
+  stream *s = w->s;
+  pthread_mutex_lock(&s->lock);
+  for (;;) {
+    unsigned b;
+    while (!s->full.n && !s->done)
+      pthread_cond_wait(&s->filled, &s->lock);
+    if (!s->full.n)
+      break;
+    b = ring_pop(&s->full);
+    pthread_mutex_unlock(&s->lock);
+    count_run(&w->c, s->buf[b].lo, s->buf[b].hi);
+    pthread_mutex_lock(&s->lock);
+    ring_push(&s->empty, b);
+    pthread_cond_signal(&s->emptied);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+/*
+ * count what's read from fd with cnt workers, through 2 buffers each of 2
+ * chunks and one per read in flight, into *total; chunk a multiple of the
+ * page size, and 'how' STREAM_READ or STREAM_URING. 0 on a read error
+ */
+static int stream_launch(int fd, unsigned cnt, size_t chunk, int how, counts *total)
+{
+  stream s;
+  source src;
+  stream_worker w[WORKERS];
+  pthread_t th[WORKERS];
+  char *carry = malloc(chunk),
+       *mem[STREAM_BUFS];
+  size_t ncarry = 0,
+         i;
+  unsigned nbuf,
+           started = 0,
+           k;
+  int drop,
+      ok = 1;
+  if (cnt > WORKERS)
+    cnt = WORKERS;
+  if (!cnt)
+    cnt = 1;
+  nbuf = 2 * cnt + (STREAM_URING == how ? URING_DEPTH : 1);
+  memset(&s, 0, sizeof s);
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.filled, NULL);
+  pthread_cond_init(&s.emptied, NULL);
+  for (k = 0; k < nbuf; k++) {
+    if (posix_memalign((void **)&mem[k], 4096, 2 * chunk)) {
+      perror("posix_memalign");
+      exit(EXIT_FAILURE);
+    }
+    s.buf[k].mem = mem[k];
+    ring_push(&s.empty, k);
+  }
+  source_open(&src, fd, chunk, how, mem, nbuf);
+  drop = src.regular && !fits_memory(src.size);
+  if (src.regular)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  memset(w, 0, sizeof w);
+  for (k = 0; k < cnt; k++) {
+    w[k].s = &s;
+    w[k].c.copy = 1;
+    if (pthread_create(&th[k], NULL, stream_run, &w[k]))
+      break;
+    started++;
+  }
+  for (;;) {
+    char *end;
+    const char *nl;
+    ssize_t got;
+    unsigned b;
+    /* keep as many reads in flight as we can, waiting for a buffer only when none are */
+    while (src.inflight.n < src.depth && source_more(&src)) {
+      pthread_mutex_lock(&s.lock);
+      while (!s.empty.n && !src.inflight.n)
+        pthread_cond_wait(&s.emptied, &s.lock);
+      b = s.empty.n ? ring_pop(&s.empty) : ~0u;
+      pthread_mutex_unlock(&s.lock);
+      if (~0u == b)
+        break;
+      source_start(&src, b, s.buf[b].mem + chunk);
+    }
+    if (!src.inflight.n)
+      break;
+    if ((got = source_wait(&src, &b)) < 0) {
+      perror("read");
+      ok = 0;
+      got = 0;
+    }
+    end = s.buf[b].mem + chunk + got;
+    memcpy(s.buf[b].mem + chunk - ncarry, carry, ncarry);
+    s.buf[b].lo = s.buf[b].mem + chunk - ncarry;
+    if ((size_t)got < chunk || (!src.inflight.n && !source_more(&src)) ||
+        !(nl = memrchr(s.buf[b].mem + chunk, '\n', (size_t)got)))
+      s.buf[b].hi = end; /* all of it: the end, or a line longer than a chunk */
+    else
+      s.buf[b].hi = nl + 1;
+    ncarry = (size_t)(end - s.buf[b].hi);
+    memcpy(carry, s.buf[b].hi, ncarry);
+    if (drop)
+      posix_fadvise(fd, src.at[b], got, POSIX_FADV_DONTNEED);
+    if (!started) { /* no threads; count it here */
+      count_run(&w[0].c, s.buf[b].lo, s.buf[b].hi);
+      ring_push(&s.empty, b);
+      continue;
+    }
+    pthread_mutex_lock(&s.lock);
+    ring_push(&s.full, b);
+    pthread_cond_signal(&s.filled);
+    pthread_mutex_unlock(&s.lock);
+  }
+  pthread_mutex_lock(&s.lock);
+  s.done = 1;
+  pthread_cond_broadcast(&s.filled);
+  pthread_mutex_unlock(&s.lock);
+  for (k = 0; k < started; k++)
+    pthread_join(th[k], NULL);
+  source_close(&src);
+  total->copy = 1;
+  for (k = 0; k < cnt; k++) {
+    for (i = 0; i < w[k].c.size; i++) {
+      const hit *h = w[k].c.slot + i;
+      if (h->key)
+        counts_add(total, h->key, h->len, h->hash, h->n);
+    }
+    counts_free(&w[k].c);
   }
+  for (k = 0; k < nbuf; k++)
+    free(mem[k]);
+  pthread_cond_destroy(&s.emptied);
+  pthread_cond_destroy(&s.filled);
+  pthread_mutex_destroy(&s.lock);
+  free(carry);
+  return ok;
 }
 
-static void workers_launch(unsigned cnt)
+static int hit_cmp(const void *va, const void *vb)
 {
-  
+  const hit *a = va,
+            *b = vb;
+  int c;
+  if (a->n != b->n)
+    return a->n < b->n ? 1 : -1;
+  c = memcmp(a->key, b->key, a->len < b->len ? a->len : b->len);
+  return c ? c : (int)a->len - (int)b->len;
 }
 
+/*
+ * c's keys, most hits first, packed to the front of its table; it's not a
+ * hash table any more, only something to read and counts_free()
+ */
+static size_t counts_sort(counts *c)
+{
+  size_t i,
+         n = 0;
+  for (i = 0; i < c->size; i++)
+    if (c->slot[i].key)
+      c->slot[n++] = c->slot[i];
+  qsort(c->slot, n, sizeof *c->slot, hit_cmp);
+  c->used = c->size = n;
+  return n;
+}
+
+#if !defined(DEBUG) && !defined(BENCH)
 int main(int argc, char *argv[])
 {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s filename [#workers]\n", argv[0]);
+  counts total = { NULL, 0, 0, 0 };
+  size_t i,
+         n;
+  unsigned workers;
+  int stream = 0,
+      how = STREAM_URING,
+      ok = 1,
+      a;
+  for (a = 1; a < argc && '-' == argv[a][0] && argv[a][1]; a++) {
+    if (!strcmp(argv[a], "-s")) {
+      stream = 1;
+    } else if (!strcmp(argv[a], "-p")) {
+      how = STREAM_READ;
+    } else {
+      a = argc;
+      break;
+    }
+  }
+  if (a >= argc) {
+    fprintf(stderr, "Usage: %s [-s] [-p] filename|- [#workers]\n", argv[0]);
     exit(EXIT_FAILURE);
   }
-  Workers = atoi(argv[2]);
-  assert(Workers 
-	return 0;
+  if (a + 1 < argc) {
+    workers = (unsigned)atoi(argv[a + 1]);
+    if (workers < 1 || workers > WORKERS) {
+      fprintf(stderr, "#workers: 1 to %u\n", WORKERS);
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    workers = cpus() < WORKERS ? cpus() : WORKERS; /* all of them, or as many as go */
+  }
+  logfile_open(argv[a]);
+  if (!stream && logfile_mappable()) {
+    logfile_map();
+    workers_launch(Map, (size_t)Stat.st_size, workers, &total);
+  } else {
+    ok = stream_launch(Fd, workers, STREAM_CHUNK, how, &total);
+  }
+  n = counts_sort(&total);
+  for (i = 0; i < n && i < TOP; i++)
+    printf("%lu: %.*s\n", (unsigned long)total.slot[i].n, (int)total.slot[i].len, total.slot[i].key);
+  counts_free(&total);
+  logfile_close();
+  return ok ? 0 : EXIT_FAILURE;
+}
+#endif
+
+#if defined(DEBUG) || defined(BENCH)
+/*
+ * a made-up access log of about 'bytes': one line in 4 fetches one of
+ * 'articles' articles, and the rest are everything else a log has. with
+ * 'tricky' some lines almost match
+ */
+static void log_make(const char *path, size_t bytes, unsigned articles, int tricky)
+{
+  static const char * const Other[] = {
+    "GET /ongoing/ongoing.atom HTTP/1.1",
+    "GET /ongoing/When/200x/2006/10/01/Some-Thing.png HTTP/1.1",
+    "GET /ongoing/picInfo.xml?o=http://www.tbray.org/ HTTP/1.1",
+    "HEAD /ongoing/When/200x/2007/01/05/Head-Request HTTP/1.1",
+    "GET /robots.txt HTTP/1.0",
+  };
+  static const char * const Tricky[] = {
+    "GET /ongoing/When/20x/2006/10/01/Too-Short-Decade HTTP/1.1",
+    "GET /ongoing/When/200x/2006/1/01/One-Digit-Month HTTP/1.1",
+    "GET /ongoing/When/200x/2006/10/01/ HTTP/1.1",
+    "GET /ongoing/When/200x/2006/10/01/No-Space-After",
+    "GET /ongoing/When/GET /ongoing/When/200x/2006/10/01/Second-Try HTTP/1.1",
+    "GET /ongoing/When/200y/2006/10/01/Not-x HTTP/1.1",
+  };
+  FILE *f = fopen(path, "w");
+  size_t written = 0;
+  unsigned long line = 0;
+  assert(f);
+  while (written < bytes) {
+    int r = rand(),
+        len;
+    const char *req;
+    char buf[128];
+    if (r % 4 == 0) {
+      unsigned a = (unsigned)(r / 4) % articles;
+      sprintf(buf, "GET /ongoing/When/%03ux/%04u/%02u/%02u/Article-%u HTTP/1.1",
+        200 + a % 2, 2003 + a % 5, 1 + a % 12, 1 + a % 28, a);
+      req = buf;
+    } else if (tricky && r % 4 == 1) {
+      req = Tricky[(unsigned)(r / 4) % (sizeof Tricky / sizeof Tricky[0])];
+    } else {
+      req = Other[(unsigned)(r / 4) % (sizeof Other / sizeof Other[0])];
+    }
+    len = fprintf(f, "10.%lu.%lu.%lu - - [01/Oct/2006:06:%02lu:%02lu -0700] \"%s\" 200 %d \"-\" \"Mozilla/5.0\"",
+      line >> 16 & 255, line >> 8 & 255, line & 255, line / 60 % 60, line % 60, req, 1000 + r % 50000);
+    written += (size_t)len;
+    line++;
+    if (written < bytes || !tricky) { /* tricky: no '\n' at the very end */
+      fputc('\n', f);
+      written++;
+    }
+  }
+  fclose(f);
+}
+#endif
+
+#ifdef DEBUG
+#include <regex.h>
+
+/*
+ * the same log, a line at a time, with the pattern as written
+ */
+static void count_regex(const char *p, size_t len, counts *c)
+{
+  regex_t re;
+  regmatch_t m[2];
+  char line[512];
+  const char *end = p + len;
+  int ok = regcomp(&re, "GET /ongoing/When/[0-9][0-9][0-9]x/([0-9][0-9][0-9][0-9]/[0-9][0-9]/[0-9][0-9]/[^ .]+) ",
+                   REG_EXTENDED);
+  assert(0 == ok);
+  while (p < end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p)),
+               *eol = nl ? nl : end;
+    size_t n = (size_t)(eol - p);
+    assert(n < sizeof line);
+    memcpy(line, p, n);
+    line[n] = '\0';
+    if (0 == regexec(&re, line, 2, m, 0)) {
+      const char *key = p + m[1].rm_so;
+      uint32_t klen = (uint32_t)(m[1].rm_eo - m[1].rm_so);
+      counts_add(c, key, klen, key_hash(key, klen), 1);
+    }
+    p = eol + 1;
+  }
+  regfree(&re);
+}
+
+static void check(counts *want, size_t n, counts *got)
+{
+  size_t i;
+  assert(n == counts_sort(got));
+  for (i = 0; i < n; i++)
+    assert(0 == hit_cmp(want->slot + i, got->slot + i));
+  counts_free(got);
+  printf("OK.\n");
+}
+
+int main(void)
+{
+  static const size_t Chunk[] = { 4096, 65536 };
+  char path[] = "/tmp/wide-finder-XXXXXX",
+       cmd[64];
+  int fd = mkstemp(path);
+  counts want = { NULL, 0, 0, 0 };
+  size_t n,
+         c;
+  unsigned k;
+  int how;
+  FILE *pipe;
+  assert(fd >= 0);
+  close(fd);
+  srand(1);
+  log_make(path, 4 << 20, 5000, 1);
+  logfile_open(path);
+  assert(logfile_mappable());
+  logfile_map();
+  printf("regex... ");
+  count_regex(Map, (size_t)Stat.st_size, &want);
+  n = counts_sort(&want);
+  printf("%lu articles\n", (unsigned long)n);
+  for (k = 1; k <= 9 || (k <= cpus() && k <= WORKERS); k++) {
+    counts got = { NULL, 0, 0, 0 };
+    printf("%u workers... ", k);
+    workers_launch(Map, (size_t)Stat.st_size, k, &got);
+    check(&want, n, &got);
+  }
+  for (how = STREAM_READ; how <= STREAM_URING; how++) {
+    for (c = 0; c < sizeof Chunk / sizeof Chunk[0]; c++) {
+      for (k = 1; k <= 8; k *= 2) {
+        counts got = { NULL, 0, 0, 0 };
+        lseek(Fd, 0, SEEK_SET);
+        assert(stream_launch(Fd, k, Chunk[c], how, &got));
+        printf("stream %lu-byte chunks by %s, %u workers... ", (unsigned long)Chunk[c], SourceName, k);
+        check(&want, n, &got);
+      }
+    }
+    for (k = 1; k <= 3; k += 2) {
+      counts got = { NULL, 0, 0, 0 };
+      sprintf(cmd, "cat %s", path);
+      pipe = popen(cmd, "r");
+      assert(pipe);
+      assert(stream_launch(fileno(pipe), k, 4096, how, &got));
+      pclose(pipe);
+      printf("stream from a pipe by %s, %u workers... ", SourceName, k);
+      check(&want, n, &got);
+    }
+  }
+  counts_free(&want);
+  logfile_close();
+  unlink(path);
+  return 0;
 }
+#endif
+
+#ifdef BENCH
+static unsigned long Found,
+                     Most;
+
+static void trial_workers(void *arg)
+{
+  counts total = { NULL, 0, 0, 0 };
+  workers_launch(Map, (size_t)Stat.st_size, *(unsigned *)arg, &total);
+  Found = (unsigned long)counts_sort(&total);
+  Most = Found ? (unsigned long)total.slot[0].n : 0;
+  counts_free(&total);
+}
+
+/*
+ * the whole thing with every cpu: mapped (and unmapped after), or streamed
+ * one way or the other, from the page cache or with the log dropped from
+ * it first
+ */
+#define MAPPED -1
+
+typedef struct {
+  int how,
+      cold;
+  unsigned workers;
+} route;
 
+static void trial_route(void *arg)
+{
+  const route *a = arg;
+  counts total = { NULL, 0, 0, 0 };
+  size_t len = (size_t)Stat.st_size;
+  if (a->cold)
+    posix_fadvise(Fd, 0, 0, POSIX_FADV_DONTNEED);
+  if (MAPPED == a->how) {
+    void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, Fd, 0);
+    assert(MAP_FAILED != p);
+    madvise(p, len, MADV_SEQUENTIAL);
+    workers_launch(p, len, a->workers, &total);
+    munmap(p, len);
+  } else {
+    lseek(Fd, 0, SEEK_SET);
+    stream_launch(Fd, a->workers, STREAM_CHUNK, a->how, &total);
+  }
+  counts_free(&total);
+}
+
+int main(int argc, char *argv[])
+{
+  static const char * const Cache[] = { "warm cache", "cold cache" };
+  char path[256];
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+  unsigned k[WORKERS],
+           nk = 0,
+           all = cpus(),
+           i;
+  int fd,
+      cold;
+  snprintf(path, sizeof path, "%s/wide-finder-XXXXXX", argc > 2 ? argv[2] : "/var/tmp");
+  fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  srand(1);
+  log_make(path, mb << 20, 20000, 0);
+  logfile_open(path);
+  fsync(Fd); /* dirty pages don't drop */
+  if (!logfile_mappable())
+    bench_note("more than half of memory; mapping it anyway\n");
+  logfile_map();
+  for (i = 1; i < all && i < WORKERS; i *= 2)
+    k[nk++] = i;
+  k[nk++] = all < WORKERS ? all : WORKERS;
+  bench_init(1, 7);
+  bench_section("count", "MB/s");
+  for (i = 0; i < nk; i++) {
+    char name[32];
+    sprintf(name, "%u worker%s", k[i], k[i] > 1 ? "s" : "");
+    bench_run(name, trial_workers, &k[i], (double)mb);
+  }
+  bench_note("%lu MB, %lu articles, the most fetched %lu times, %u cpus\n",
+    (unsigned long)mb, Found, Most, all);
+  munmap((void *)Map, (size_t)Stat.st_size); /* or its pages can't be dropped */
+  Map = NULL;
+  for (cold = 0; cold < 2; cold++) {
+    route mapped = { MAPPED, 0, 0 },
+         byread = { STREAM_READ, 0, 0 },
+         byuring = { STREAM_URING, 0, 0 };
+    mapped.cold = byread.cold = byuring.cold = cold;
+    mapped.workers = byread.workers = byuring.workers = all;
+    bench_section(Cache[cold], "MB/s");
+    bench_run("mmap", trial_route, &mapped, (double)mb);
+    bench_run("pread", trial_route, &byread, (double)mb);
+    bench_run("io_uring", trial_route, &byuring, (double)mb);
+  }
+  bench_note("io_uring reads: %s, %u in flight\n", SourceName, URING_DEPTH);
+  logfile_close();
+  unlink(path);
+  return 0;
+}
+#endif
@@ -2,73 +2,145 @@
 /*
  * "descramble" single word entries, matching them against a
  * "dictionary" of possible answers
+ *
+ * words with the same letters share a signature: the sum of a random 64-bit
+ * key per letter, which doesn't care about order. the dictionary is one
+ * block of text, a table of word offsets grouped by signature, and an
+ * open-addressed hash table from signature to its group, so a lookup is a
+ * hash of the query and a probe or two rather than a bsearch() over
+ * 580-byte records.
+ *
+ * "+letters" finds every word those letters make and "*letters" every
+ * phrase that uses all of them. those go by letter counts (a-z, case
+ * folded): each distinct count is a letterset, longest first, with a bit
+ * mask of its letters kept apart so a scan rules out most sets 8 at a time
+ * before comparing counts 32 bytes at a time. phrases are a backtracking
+ * search over only the sets that fit, cut short by length.
+ *
+ * the dictionary file is mmap()ed and used where it lies: a word is an
+ * offset into it and ends at its line end, so nothing is copied. lines are
+ * found 32 bytes at a time, by as many threads as there are CPUs for a big
+ * enough file, each taking a run of whole lines, and the table is sized
+ * from their count before anything goes in it.
+ *
+ * given files, or a pipe rather than a terminal, there's no banner or
+ * prompt: each line is answered on one line, the query then its answers
+ * tab-separated, in the order asked. up to a megabyte of lines is read at
+ * once, shared out among threads, and written back in a few big write()s;
+ * whatever has come by the time input stops coming is answered straight
+ * away, so a slow stream or a coprocess isn't kept waiting.
+ *
+ *   cc -O2 -pthread word-descramble.c
+ *   ./a.out [-d dict] [-j threads] [file|- ...]
+ *
+ * test:
+ *   cc -pthread -DDEBUG word-descramble.c && ./a.out
+ *
+ * bench (against the records it replaced):
+ *   cc -O3 -pthread -DBENCH word-descramble.c && ./a.out [words]
  */
 
+#ifdef BENCH
+#include "bench.h" /* first; it wants _GNU_SOURCE */
+#endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* MAP_POPULATE */
+#elif !defined(_GNU_SOURCE)
+# define _POSIX_C_SOURCE 200809L
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <assert.h>
 
-#define DICT_FILE "/usr/share/dict/words"
-
-#undef DEBUG
+#ifndef DICT_FILE
+# define DICT_FILE "/usr/share/dict/words"
+#endif
 
+/*
+ * words with the same letters; n == 0 is an empty slot
+ */
 typedef struct {
-  int len, /* total amount of letters */
-	    letcnt[128];
-  char orig[64];
-} word;
+  uint64_t sig;
+  uint32_t first, /* index into Words of the first of them */
+           n;
+} anagrams;
+
+static const char *Text = NULL;  /* the dictionary file */
+static size_t TextLen = 0;
+static int TextMapped = 0;       /* else a copy, to free() */
+static uint32_t *Words = NULL;   /* offsets into Text, grouped by signature */
+static long DictLen = 0;
+static anagrams *Table = NULL;   /* a power of 2 of them */
+static size_t TableSize = 0,
+              Groups = 0;
+static uint64_t Key[256];        /* per letter */
 
-static word *Dict = NULL;
-static long DictAlloc = 0,
-            DictLen = 0;
+/*
+ * a query ends at its '\0', a dictionary word at its line end
+ */
+#define WORD_END(c) ('\0' == (c) || '\n' == (c) || '\r' == (c))
+
+static int word_len(const char *w)
+{
+  const char *p = w;
+  while (!WORD_END(*p))
+    p++;
+  return (int)(p - w);
+}
 
 static void dict_dump(void)
 {
   long i = 0;
   while (i < DictLen)
-    printf("#%3ld %s\n", ++i, Dict[i].orig);
+    printf("#%3ld %.*s\n", i + 1, word_len(Text + Words[i]), Text + Words[i]), i++;
 }
 
-static void word_compile(word *w, char *txt)
+static void key_init(void)
 {
-  /* initialize */
-  w->len = 0;
-  memset(w->letcnt, 0, sizeof w->letcnt);
-  strcpy(w->orig, txt); /* FIXME: will overflow buffer */
-  /* build profile */
-  while (*txt) {
-    assert(*txt < sizeof w->letcnt / sizeof w->letcnt[0]);
-    w->letcnt[*txt]++;
-    w->len++;
-    txt++;
+  uint64_t x = 0x9E3779B97F4A7C15ull;
+  unsigned i;
+  for (i = 0; i < 256; i++) { /* splitmix64 */
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    Key[i] = z ^ (z >> 31);
   }
 }
 
-static int word_cmp(const void *va, const void *vb)
+static uint64_t word_sig(const char *txt)
 {
-  const word *a = va,
-             *b = vb;
-  int c = a->len - b->len;
-  if (c)
-    c = memcmp(a->letcnt, b->letcnt, sizeof a->letcnt);
-  return c;
+  uint64_t sig = 0;
+  while (!WORD_END(*txt))
+    sig += Key[(unsigned char)*txt++];
+  return sig;
 }
 
-static void dict_space(void)
+/*
+ * is b a rearrangement of a; signatures can collide, letters can't
+ */
+static int word_same(const char *a, const char *b)
 {
-  if (DictLen == DictAlloc) {
-    size_t num = DictLen ? DictLen * 2 : 64,
-           bytes = num * sizeof *Dict;
-    void *tmp = realloc(Dict, bytes);
-#ifdef DEBUG
-    printf("num=%u bytes=%u tmp=%p\n", (unsigned)num, (unsigned)bytes, tmp);
-#endif
-    assert(tmp);
-    Dict = tmp;
-    DictAlloc = num;
-  }
-  assert(DictLen < DictAlloc);
+  int cnt[256];
+  const char *p;
+  for (p = a; !WORD_END(*p); p++)
+    cnt[(unsigned char)*p] = 0;
+  for (p = b; !WORD_END(*p); p++)
+    cnt[(unsigned char)*p] = 0;
+  for (p = a; !WORD_END(*p); p++)
+    cnt[(unsigned char)*p]++;
+  for (p = b; !WORD_END(*p); p++)
+    if (--cnt[(unsigned char)*p] < 0)
+      return 0;
+  return p - b == word_len(a);
 }
 
 static int input_legit(const char *line)
@@ -84,61 +156,1102 @@ static void input_trim(char *line)
   strcspn(line, "\r\n")[line] = '\0';
 }
 
-static void dict_add(char *line)
+/*
+ * the slot for txt's letters: its group, or the empty slot it'd go in
+ */
+static anagrams * dict_slot(uint64_t sig, const char *txt, const uint32_t *words)
 {
-  dict_space();
-  input_trim(line);
-  word_compile(Dict + DictLen++, line);
+  size_t mask = TableSize - 1,
+         i = (size_t)sig & mask;
+  while (Table[i].n && !(Table[i].sig == sig && word_same(Text + words[Table[i].first], txt)))
+    i = (i + 1) & mask;
+  return Table + i;
 }
 
-static void dict_load(const char *filename)
+/*
+ * group Words by signature, keeping dictionary order within each group;
+ * sigs, if not NULL, are the words' signatures
+ */
+static void dict_index(const uint64_t *sigs)
 {
-  char line[256];
-  FILE *f = fopen(filename, "r");
-  printf("Loading '%s'... ", filename);
-  if (NULL == f) {
-    perror("fopen");
+  uint32_t *slot = malloc(DictLen * sizeof *slot),
+           *grouped = malloc(DictLen * sizeof *grouped),
+           *at;
+  size_t i,
+         pos = 0;
+  free(Table);
+  for (TableSize = 64; TableSize < (size_t)DictLen * 2; TableSize *= 2)
+    ;
+  Table = calloc(TableSize, sizeof *Table);
+  Groups = 0;
+  for (i = 0; i < (size_t)DictLen; i++) {
+    const char *txt = Text + Words[i];
+    uint64_t sig = sigs ? sigs[i] : word_sig(txt);
+    anagrams *a = dict_slot(sig, txt, Words);
+    if (!a->n) {
+      a->sig = sig;
+      a->first = (uint32_t)i; /* for now, the word that stands for it */
+      Groups++;
+    }
+    a->n++;
+    slot[i] = (uint32_t)(a - Table);
+  }
+  at = calloc(TableSize, sizeof *at);
+  for (i = 0; i < TableSize; i++) {
+    at[i] = (uint32_t)pos;
+    Table[i].first = (uint32_t)pos;
+    pos += Table[i].n;
+  }
+  for (i = 0; i < (size_t)DictLen; i++)
+    grouped[at[slot[i]]++] = Words[i];
+  free(Words);
+  Words = grouped;
+  free(at);
+  free(slot);
+}
+
+static const anagrams * dict_find(const char *txt)
+{
+  const anagrams *a;
+  if (!TableSize)
+    return NULL;
+  a = dict_slot(word_sig(txt), txt, Words);
+  return a->n ? a : NULL;
+}
+
+/*
+ * for "which words can these letters make" and "which phrases use exactly
+ * these letters", letters are a-z, case folded, and anything else in a word
+ * is ignored: "Ann's" is a, n, n, s. each distinct count of them in the
+ * dictionary is a letterset, with the anagram groups that fold to it; sets
+ * are longest first, so a search can stop early once they're too short
+ */
+#define LETTERS 32 /* 26, rounded up to a vector */
+
+typedef struct {
+  uint8_t cnt[LETTERS];
+  uint32_t len,   /* letters */
+           first, /* into SetGroups */
+           n;
+} letterset;
+
+static letterset *Sets = NULL;
+static uint32_t *SetMask = NULL,   /* a bit per letter a set has; apart, to test 8 at once */
+                *SetGroups = NULL; /* indexes into Table, by set */
+static size_t NSets = 0;
+static struct {
+  uint64_t sig;
+  uint32_t set;                    /* +1; 0 is empty */
+} *SetHash = NULL;                 /* counts -> set, a power of 2 of them */
+static size_t SetHashSize = 0;
+
+/*
+ * 0 if txt has a non-ASCII byte or 255 of some letter
+ */
+static int letters_count(const char *txt, uint8_t *cnt, uint32_t *mask, uint32_t *len)
+{
+  memset(cnt, 0, LETTERS);
+  *mask = 0;
+  *len = 0;
+  for (; !WORD_END(*txt); txt++) {
+    unsigned c = (unsigned char)*txt;
+    if (c & 0x80)
+      return 0;
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    if (c < 'a' || c > 'z')
+      continue;
+    c -= 'a';
+    if (255 == cnt[c])
+      return 0;
+    cnt[c]++;
+    *mask |= 1u << c;
+    ++*len;
+  }
+  return 1;
+}
+
+static uint64_t letters_sig(const uint8_t *cnt)
+{
+  uint64_t sig = 0;
+  unsigned i;
+  for (i = 0; i < 26; i++)
+    sig += cnt[i] * Key['a' + i];
+  return sig;
+}
+
+static uint32_t letters_mask(const uint8_t *cnt)
+{
+  uint32_t mask = 0;
+  unsigned i;
+  for (i = 0; i < 26; i++)
+    if (cnt[i])
+      mask |= 1u << i;
+  return mask;
+}
+
+/*
+ * which of the sets 'in' (all of them if NULL) fit in 'have'; mask is
+ * have's letters, so most that don't are out before counts are compared
+ */
+static size_t sets_fit_obvious(const uint8_t *have, uint32_t mask, const uint32_t *in, size_t n, uint32_t *out)
+{
+  size_t i,
+         m = 0;
+  for (i = 0; i < n; i++) {
+    uint32_t s = in ? in[i] : (uint32_t)i;
+    unsigned k;
+    if (SetMask[s] & ~mask)
+      continue;
+    for (k = 0; k < 26 && Sets[s].cnt[k] <= have[k]; k++)
+      ;
+    if (26 == k)
+      out[m++] = s;
+  }
+  return m;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(WIN32)
+# define CAN_SIMD
+#endif
+
+#ifdef CAN_SIMD
+
+#include <immintrin.h>
+
+/*
+ * need <= have in every byte: max(need, have) == have
+ */
+__attribute__((target("sse2")))
+static int fits_sse2(const uint8_t *need, const uint8_t *have)
+{
+  const __m128i h0 = _mm_loadu_si128((const __m128i *)have),
+                h1 = _mm_loadu_si128((const __m128i *)(have + 16)),
+                c0 = _mm_loadu_si128((const __m128i *)need),
+                c1 = _mm_loadu_si128((const __m128i *)(need + 16));
+  return 0xFFFF == _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(c0, h0), h0),
+                                                   _mm_cmpeq_epi8(_mm_max_epu8(c1, h1), h1)));
+}
+
+__attribute__((target("avx2")))
+static int fits_avx2(const uint8_t *need, const uint8_t *have)
+{
+  const __m256i h = _mm256_loadu_si256((const __m256i *)have),
+                c = _mm256_loadu_si256((const __m256i *)need);
+  return -1 == _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(c, h), h));
+}
+
+/*
+ * over all of them, the masks are tested 4 or 8 at a time
+ */
+__attribute__((target("sse2")))
+static size_t sets_fit_sse2(const uint8_t *have, uint32_t mask, const uint32_t *in, size_t n, uint32_t *out)
+{
+  const __m128i notmask = _mm_set1_epi32((int)~mask),
+                zero = _mm_setzero_si128();
+  size_t i = 0,
+         m = 0;
+  if (in) {
+    for (; i < n; i++)
+      if (!(SetMask[in[i]] & ~mask) && fits_sse2(Sets[in[i]].cnt, have))
+        out[m++] = in[i];
+    return m;
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_and_si128(_mm_loadu_si128((const __m128i *)(SetMask + i)), notmask);
+    unsigned ok = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(x, zero)));
+    while (ok) {
+      uint32_t s = (uint32_t)(i + (unsigned)__builtin_ctz(ok));
+      ok &= ok - 1;
+      if (fits_sse2(Sets[s].cnt, have))
+        out[m++] = s;
+    }
+  }
+  for (; i < n; i++)
+    if (!(SetMask[i] & ~mask) && fits_sse2(Sets[i].cnt, have))
+      out[m++] = (uint32_t)i;
+  return m;
+}
+
+__attribute__((target("avx2")))
+static size_t sets_fit_avx2(const uint8_t *have, uint32_t mask, const uint32_t *in, size_t n, uint32_t *out)
+{
+  const __m256i notmask = _mm256_set1_epi32((int)~mask),
+                zero = _mm256_setzero_si256();
+  size_t i = 0,
+         m = 0;
+  if (in) {
+    for (; i < n; i++)
+      if (!(SetMask[in[i]] & ~mask) && fits_avx2(Sets[in[i]].cnt, have))
+        out[m++] = in[i];
+    return m;
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(SetMask + i)), notmask);
+    unsigned ok = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, zero)));
+    while (ok) {
+      uint32_t s = (uint32_t)(i + (unsigned)__builtin_ctz(ok));
+      ok &= ok - 1;
+      if (fits_avx2(Sets[s].cnt, have))
+        out[m++] = s;
+    }
+  }
+  for (; i < n; i++)
+    if (!(SetMask[i] & ~mask) && fits_avx2(Sets[i].cnt, have))
+      out[m++] = (uint32_t)i;
+  return m;
+}
+
+#endif /* CAN_SIMD */
+
+static size_t (*SetsFit)(const uint8_t *, uint32_t, const uint32_t *, size_t, uint32_t *) = sets_fit_obvious;
+
+static void sets_fit_init(void)
+{
+#ifdef CAN_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    SetsFit = sets_fit_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    SetsFit = sets_fit_sse2;
+#endif
+}
+
+static int set_cmp(const void *va, const void *vb)
+{
+  const letterset *a = va,
+                  *b = vb;
+  if (a->len != b->len)
+    return a->len > b->len ? -1 : 1;
+  return memcmp(a->cnt, b->cnt, sizeof a->cnt);
+}
+
+/*
+ * fold Table's groups into lettersets
+ */
+static void sets_index(void)
+{
+  uint32_t *setof = malloc(TableSize * sizeof *setof),
+           *renum,
+           *at;
+  size_t i,
+         pos = 0;
+  Sets = realloc(Sets, (Groups + 1) * sizeof *Sets);
+  NSets = 0;
+  free(SetHash);
+  for (SetHashSize = 64; SetHashSize < Groups * 2; SetHashSize *= 2)
+    ;
+  SetHash = calloc(SetHashSize, sizeof *SetHash);
+  for (i = 0; i < TableSize; i++) {
+    uint8_t cnt[LETTERS];
+    uint32_t mask,
+             len;
+    uint64_t sig;
+    size_t j;
+    setof[i] = ~(uint32_t)0;
+    if (!Table[i].n || !letters_count(Text + Words[Table[i].first], cnt, &mask, &len) || !len)
+      continue;
+    sig = letters_sig(cnt);
+    for (j = sig & (SetHashSize - 1); SetHash[j].set; j = (j + 1) & (SetHashSize - 1))
+      if (SetHash[j].sig == sig && !memcmp(Sets[SetHash[j].set - 1].cnt, cnt, LETTERS))
+        break;
+    if (!SetHash[j].set) {
+      memcpy(Sets[NSets].cnt, cnt, LETTERS);
+      Sets[NSets].len = len;
+      Sets[NSets].first = (uint32_t)NSets; /* for now, where it was before sorting */
+      Sets[NSets].n = 0;
+      SetHash[j].sig = sig;
+      SetHash[j].set = (uint32_t)++NSets;
+    }
+    setof[i] = SetHash[j].set - 1;
+    Sets[setof[i]].n++;
+  }
+  qsort(Sets, NSets, sizeof *Sets, set_cmp);
+  renum = malloc((NSets + 1) * sizeof *renum);
+  at = malloc((NSets + 1) * sizeof *at);
+  SetMask = realloc(SetMask, (NSets + 1) * sizeof *SetMask);
+  for (i = 0; i < NSets; i++) {
+    renum[Sets[i].first] = (uint32_t)i;
+    at[i] = Sets[i].first = (uint32_t)pos;
+    pos += Sets[i].n;
+    SetMask[i] = letters_mask(Sets[i].cnt);
+  }
+  for (i = 0; i < SetHashSize; i++)
+    if (SetHash[i].set)
+      SetHash[i].set = renum[SetHash[i].set - 1] + 1;
+  SetGroups = realloc(SetGroups, (pos + 1) * sizeof *SetGroups);
+  for (i = 0; i < TableSize; i++)
+    if (setof[i] != ~(uint32_t)0)
+      SetGroups[at[renum[setof[i]]]++] = (uint32_t)i;
+  free(at);
+  free(renum);
+  free(setof);
+  sets_fit_init();
+}
+
+/*
+ * the set with exactly these letters, ~0 if none
+ */
+static uint32_t set_find(const uint8_t *cnt)
+{
+  uint64_t sig = letters_sig(cnt);
+  size_t j;
+  for (j = sig & (SetHashSize - 1); SetHash[j].set; j = (j + 1) & (SetHashSize - 1))
+    if (SetHash[j].sig == sig && !memcmp(Sets[SetHash[j].set - 1].cnt, cnt, 26))
+      return SetHash[j].set - 1;
+  return ~(uint32_t)0;
+}
+
+/*
+ * every letterset that can be made from txt's letters, longest first, into
+ * out[], which has room for NSets + 1
+ */
+static size_t dict_sub(const char *txt, uint32_t *out)
+{
+  uint8_t have[LETTERS];
+  uint32_t mask,
+           len;
+  if (!letters_count(txt, have, &mask, &len))
+    return 0;
+  return SetsFit(have, mask, NULL, NSets, out);
+}
+
+/*
+ * a phrase is one set per word, in set order so each combination comes up
+ * once; return non-zero to stop
+ */
+typedef int phrase_fn(const uint32_t *sets, unsigned n, void *arg);
+
+#define PHRASE_MAXWORDS 8
+
+typedef struct {
+  uint8_t left[LETTERS];          /* not used yet */
+  uint32_t nleft,
+           *cand[PHRASE_MAXWORDS], /* sets that still fit, per word */
+           pick[PHRASE_MAXWORDS];
+  unsigned maxwords;
+  phrase_fn *fn;
+  void *arg;
+} phrase;
+
+/*
+ * first of cand[lo..hi) with no more than len letters; cand is longest first
+ */
+static size_t sets_at_most(const uint32_t *cand, size_t lo, size_t hi, uint32_t len)
+{
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (Sets[cand[mid]].len > len)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * try each candidate that could still be word 'depth', then what fits in
+ * what it leaves, from it on. sets are longest first, so once the words
+ * left, all this long, can't use up the letters left, none after can; the
+ * next word's candidates are only those between what's left and what's
+ * left shared among the words after this; and the last word, if it comes
+ * to that, has to be exactly what's left
+ */
+static int phrase_search(phrase *p, size_t ncand, unsigned depth)
+{
+  const uint32_t *cand = p->cand[depth];
+  unsigned words = p->maxwords - depth; /* this one and any after it */
+  size_t k;
+  int stop = 0;
+  for (k = 0; k < ncand && !stop; k++) {
+    const letterset *s = Sets + cand[k];
+    unsigned j;
+    if (s->len * words < p->nleft)
+      break;
+    p->pick[depth] = cand[k];
+    for (j = 0; j < 26; j++)
+      p->left[j] -= s->cnt[j];
+    p->nleft -= s->len;
+    if (!p->nleft) {
+      stop = p->fn(p->pick, depth + 1, p->arg);
+    } else if (2 == words) {
+      uint32_t last = set_find(p->left);
+      if (last != ~(uint32_t)0 && last >= cand[k]) {
+        p->pick[depth + 1] = last;
+        stop = p->fn(p->pick, depth + 2, p->arg);
+      }
+    } else if (words > 2) {
+      size_t lo = sets_at_most(cand, k, ncand, p->nleft),
+             hi = sets_at_most(cand, lo, ncand, (p->nleft + words - 2) / (words - 1) - 1),
+             m = SetsFit(p->left, letters_mask(p->left), cand + lo, hi - lo, p->cand[depth + 1]);
+      if (m)
+        stop = phrase_search(p, m, depth + 1);
+    }
+    p->nleft += s->len;
+    for (j = 0; j < 26; j++)
+      p->left[j] += s->cnt[j];
+  }
+  return stop;
+}
+
+/*
+ * every way to use up all of txt's letters in 1..maxwords words; each
+ * word's candidates go in cand[], which has room for maxwords * (NSets + 1)
+ */
+static int dict_phrases(const char *txt, unsigned maxwords, uint32_t *cand, phrase_fn *fn, void *arg)
+{
+  phrase p;
+  uint32_t mask;
+  size_t n;
+  unsigned i;
+  if (!letters_count(txt, p.left, &mask, &p.nleft) || !p.nleft)
+    return 0;
+  if (maxwords > PHRASE_MAXWORDS)
+    maxwords = PHRASE_MAXWORDS;
+  p.maxwords = maxwords;
+  p.fn = fn;
+  p.arg = arg;
+  for (i = 0; i < maxwords; i++)
+    p.cand[i] = cand + i * (NSets + 1);
+  n = SetsFit(p.left, mask, NULL, NSets, p.cand[0]);
+  return phrase_search(&p, n, 0);
+}
+
+/*
+ * answers go in a buffer rather than straight out, so a thread can make
+ * them for a run of queries and have them written, in order, all at once
+ */
+typedef struct {
+  char *p;
+  size_t len,
+         alloc;
+} outbuf;
+
+static void out_put(outbuf *o, const char *s, size_t len)
+{
+  if (!len)
+    return;
+  if (o->len + len > o->alloc) {
+    o->alloc = o->alloc * 2 > o->len + len ? o->alloc * 2 : o->len + len + 4096;
+    o->p = realloc(o->p, o->alloc);
+  }
+  memcpy(o->p + o->len, s, len);
+  o->len += len;
+}
+
+static void out_str(outbuf *o, const char *s)
+{
+  out_put(o, s, strlen(s));
+}
+
+static void out_word(outbuf *o, const char *w)
+{
+  out_put(o, w, (size_t)word_len(w));
+}
+
+/*
+ * the words of a set, sep between them
+ */
+static void set_put(outbuf *o, uint32_t s, const char *sep)
+{
+  const letterset *set = Sets + s;
+  uint32_t g,
+           i,
+           k = 0;
+  for (g = set->first; g < set->first + set->n; g++) {
+    const anagrams *a = Table + SetGroups[g];
+    for (i = 0; i < a->n; i++) {
+      if (k++)
+        out_str(o, sep);
+      out_word(o, Text + Words[a->first + i]);
+    }
+  }
+}
+
+/*
+ * the dictionary's lines, found by one thread per chunk of the file; a
+ * chunk starts at the start of a line and ends just after a '\n'
+ */
+#define LOAD_THREADS 64
+#define LOAD_CHUNK   (1 << 20) /* at least, a thread */
+
+typedef struct {
+  size_t lo,
+         hi,
+         n,
+         alloc;
+  uint32_t *off;
+  uint64_t *sig;
+} chunk;
+
+static void chunk_line(chunk *c, size_t start)
+{
+  if (!input_legit(Text + start))
+    return;
+  if (c->n == c->alloc) {
+    c->alloc = c->alloc ? c->alloc * 2 : (c->hi - c->lo) / 8 + 16;
+    c->off = realloc(c->off, c->alloc * sizeof *c->off);
+    c->sig = realloc(c->sig, c->alloc * sizeof *c->sig);
+    assert(c->off && c->sig);
+  }
+  c->off[c->n] = (uint32_t)start;
+  c->sig[c->n++] = word_sig(Text + start);
+}
+
+/*
+ * the lines from start on
+ */
+static void chunk_rest(chunk *c, size_t start)
+{
+  const char *e;
+  while (start < c->hi && (e = memchr(Text + start, '\n', c->hi - start))) {
+    chunk_line(c, start);
+    start = (size_t)(e - Text) + 1;
+  }
+}
+
+static void chunk_scan_obvious(chunk *c)
+{
+  chunk_rest(c, c->lo);
+}
+
+#ifdef CAN_SIMD
+
+__attribute__((target("sse2")))
+static void chunk_scan_sse2(chunk *c)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t start = c->lo,
+         i;
+  for (i = c->lo; i + 16 <= c->hi; i += 16) {
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Text + i)), nl));
+    while (m) {
+      chunk_line(c, start);
+      start = i + (unsigned)__builtin_ctz(m) + 1;
+      m &= m - 1;
+    }
+  }
+  chunk_rest(c, start);
+}
+
+__attribute__((target("avx2")))
+static void chunk_scan_avx2(chunk *c)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t start = c->lo,
+         i;
+  for (i = c->lo; i + 32 <= c->hi; i += 32) {
+    unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Text + i)), nl));
+    while (m) {
+      chunk_line(c, start);
+      start = i + (unsigned)__builtin_ctz(m) + 1;
+      m &= m - 1;
+    }
+  }
+  chunk_rest(c, start);
+}
+
+#endif /* CAN_SIMD */
+
+static void (*ChunkScan)(chunk *) = chunk_scan_obvious;
+
+static void * chunk_thread(void *arg)
+{
+  ChunkScan(arg);
+  return NULL;
+}
+
+/*
+ * the file, mapped, or read into memory if it can't be or doesn't end in a
+ * '\n' (so every word is followed by one); 0 if neither works. a pipe or
+ * the like says nothing of its size, so it's read to its end
+ */
+static int dict_map(const char *filename)
+{
+  struct stat st;
+  char *p;
+  size_t got = 0,
+         alloc;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+  if ((uint64_t)st.st_size >= UINT32_MAX) { /* Words are 32-bit offsets */
+    close(fd);
+    errno = EFBIG;
+    return 0;
+  }
+  TextLen = S_ISREG(st.st_mode) ? (size_t)st.st_size : 0;
+  if (TextLen) {
+#ifdef MAP_POPULATE
+    p = mmap(NULL, TextLen, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+#else
+    p = mmap(NULL, TextLen, PROT_READ, MAP_PRIVATE, fd, 0);
+#endif
+    if (MAP_FAILED != p && '\n' == p[TextLen - 1]) {
+      close(fd);
+      Text = p;
+      TextMapped = 1;
+      return 1;
+    }
+    if (MAP_FAILED != p)
+      munmap(p, TextLen);
+  }
+  alloc = S_ISREG(st.st_mode) ? TextLen : LOAD_CHUNK;
+  p = malloc(alloc + 1);
+  for (;;) {
+    ssize_t rd;
+    if (got == alloc) {
+      if (S_ISREG(st.st_mode))
+        break;
+      if (alloc >= UINT32_MAX / 2) {
+        free(p);
+        close(fd);
+        errno = EFBIG;
+        return 0;
+      }
+      alloc *= 2;
+      p = realloc(p, alloc + 1);
+    }
+    rd = read(fd, p + got, alloc - got);
+    if (rd < 0 && EINTR == errno)
+      continue;
+    if (rd < 0) {
+      free(p);
+      close(fd);
+      return 0;
+    }
+    if (!rd)
+      break;
+    got += (size_t)rd;
+  }
+  close(fd);
+  TextLen = got;
+  if (!TextLen || '\n' != p[TextLen - 1])
+    p[TextLen++] = '\n';
+  Text = p;
+  TextMapped = 0;
+  return 1;
+}
+
+static void dict_free(void)
+{
+  if (TextMapped)
+    munmap((void *)Text, TextLen);
+  else
+    free((void *)Text);
+  Text = NULL;
+  TextLen = 0;
+  free(Words);
+  Words = NULL;
+  DictLen = 0;
+  free(Table);
+  Table = NULL;
+  TableSize = 0;
+  Groups = 0;
+  free(Sets);
+  Sets = NULL;
+  free(SetMask);
+  SetMask = NULL;
+  free(SetGroups);
+  SetGroups = NULL;
+  NSets = 0;
+  free(SetHash);
+  SetHash = NULL;
+  SetHashSize = 0;
+}
+
+/*
+ * map the file, find its lines with up to 'threads' threads, and index them
+ */
+static int dict_read(const char *filename, unsigned threads)
+{
+  chunk c[LOAD_THREADS];
+  pthread_t th[LOAD_THREADS];
+  int started[LOAD_THREADS];
+  uint64_t *sigs;
+  size_t pos = 0;
+  unsigned i;
+  if (!dict_map(filename))
+    return 0;
+#ifdef CAN_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    ChunkScan = chunk_scan_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    ChunkScan = chunk_scan_sse2;
+#endif
+  if (threads > TextLen / LOAD_CHUNK + 1)
+    threads = (unsigned)(TextLen / LOAD_CHUNK + 1);
+  if (threads > LOAD_THREADS)
+    threads = LOAD_THREADS;
+  if (!threads)
+    threads = 1;
+  memset(c, 0, sizeof c);
+  for (i = 0; i < threads; i++) {
+    size_t hi = TextLen / threads * (i + 1);
+    const char *nl;
+    c[i].lo = pos;
+    if (i + 1 == threads || hi <= pos)
+      hi = TextLen;
+    else if ((nl = memchr(Text + hi - 1, '\n', TextLen - hi + 1)))
+      hi = (size_t)(nl - Text) + 1;
+    c[i].hi = pos = hi;
+  }
+  for (i = 1; i < threads; i++)
+    started[i] = !pthread_create(&th[i], NULL, chunk_thread, &c[i]);
+  ChunkScan(&c[0]);
+  for (i = 1; i < threads; i++) {
+    if (started[i])
+      pthread_join(th[i], NULL);
+    else
+      ChunkScan(&c[i]);
+  }
+  DictLen = 0;
+  for (i = 0; i < threads; i++)
+    DictLen += (long)c[i].n;
+  Words = malloc((DictLen + 1) * sizeof *Words);
+  sigs = malloc((DictLen + 1) * sizeof *sigs);
+  for (pos = 0, i = 0; i < threads; i++) {
+    if (c[i].n) {
+      memcpy(Words + pos, c[i].off, c[i].n * sizeof *Words);
+      memcpy(sigs + pos, c[i].sig, c[i].n * sizeof *sigs);
+      pos += c[i].n;
+    }
+    free(c[i].off);
+    free(c[i].sig);
+  }
+  dict_index(sigs);
+  free(sigs);
+  return 1;
+}
+
+static unsigned cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned)n : 1;
+}
+
+static void dict_load(const char *filename, int quiet)
+{
+  if (!quiet)
+    printf("Loading '%s'... ", filename);
+  if (!dict_read(filename, cpus())) {
+    perror(filename);
     exit(EXIT_FAILURE);
   }
-  while (fgets(line, sizeof line, f))
-    if (input_legit(line))
-      dict_add(line);
-  fclose(f);
-  qsort(Dict, DictLen, sizeof *Dict, word_cmp);
-  printf("%ld entries.\n", DictLen);
+  if (!DictLen) {
+    fprintf(stderr, "%s: no words\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  sets_index();
+  if (!quiet)
+    printf("%ld entries.\n", DictLen);
+}
+
+#define PHRASE_WORDS 3   /* at most, for '*' */
+#define PHRASE_SHOW  100 /* then stop */
+
+/*
+ * one query's answers: for a person, a line each under "Matches:"; in a
+ * batch, the query and then a tab before each, all on one line
+ */
+typedef struct {
+  outbuf *o;
+  int batch;
+  unsigned n;
+} answers;
+
+static void answer_begin(answers *a)
+{
+  if (a->batch)
+    out_put(a->o, "\t", 1);
+  else if (!a->n)
+    out_str(a->o, "Matches:\n");
+  a->n++;
+}
+
+static void answer_end(answers *a)
+{
+  if (!a->batch)
+    out_put(a->o, "\n", 1);
+}
+
+/*
+ * room for dict_answer()'s candidates: PHRASE_WORDS words' worth
+ */
+static uint32_t * cand_new(void)
+{
+  return malloc((size_t)PHRASE_WORDS * (NSets + 1) * sizeof(uint32_t));
+}
+
+static int phrase_put(const uint32_t *sets, unsigned n, void *arg)
+{
+  answers *a = arg;
+  unsigned i;
+  answer_begin(a);
+  for (i = 0; i < n; i++) {
+    if (i)
+      out_put(a->o, " ", 1);
+    set_put(a->o, sets[i], "/");
+  }
+  answer_end(a);
+  return a->n >= PHRASE_SHOW;
+}
+
+/*
+ * "word": its anagrams; "+letters": every word they make; "*letters":
+ * every phrase of up to PHRASE_WORDS words that uses them all. cand is
+ * from cand_new(); with one each, threads can answer side by side
+ */
+static void dict_answer(outbuf *o, const char *q, int batch, uint32_t *cand)
+{
+  answers a;
+  const anagrams *g;
+  uint32_t i;
+  a.o = o;
+  a.batch = batch;
+  a.n = 0;
+  if (batch)
+    out_word(o, q);
+  if ('+' == q[0]) {
+    size_t n = dict_sub(q + 1, cand),
+           k;
+    for (k = 0; k < n; k++) {
+      answer_begin(&a);
+      set_put(o, cand[k], "/");
+      answer_end(&a);
+    }
+  } else if ('*' == q[0]) {
+    if (dict_phrases(q + 1, PHRASE_WORDS, cand, phrase_put, &a))
+      out_str(o, batch ? "\t..." : "...and more.\n");
+  } else if (NULL != (g = dict_find(q))) {
+    for (i = 0; i < g->n; i++) {
+      answer_begin(&a);
+      out_word(o, Text + Words[g->first + i]);
+      answer_end(&a);
+    }
+  }
+  if (batch)
+    out_put(o, "\n", 1);
+  else if (!a.n)
+    out_str(o, "No matches.\n");
 }
 
 static void dict_check(char *line)
 {
-  word w,
-       *scroll;
+  outbuf o = { NULL, 0, 0 };
+  uint32_t *cand = cand_new();
   input_trim(line);
-  word_compile(&w, line);
 #ifdef DEBUG
   printf("dict_check(\"%s\")\n", line);
 #endif
-  scroll = bsearch(&w, Dict, DictLen, sizeof *Dict, word_cmp);
-  if (NULL == scroll) {
-    printf("No matches.\n");
-  } else {
-    printf("Matches:\n");
-    /* scroll back to first match */
-    while (scroll >= Dict && 0 == word_cmp(scroll - 1, &w))
-      scroll--;
-    if (scroll < Dict)
-      scroll = Dict;
-    /* scroll forwards */
-    while (scroll < Dict + DictLen && 0 == word_cmp(scroll, &w)) {
-      printf("%s\n", scroll->orig);
-      scroll++;
+  dict_answer(&o, line, 0, cand);
+  fwrite(o.p, 1, o.len, stdout);
+  free(o.p);
+  free(cand);
+}
+
+/*
+ * not a person at the other end: input is read up to BATCH_BYTES at a time
+ * and its whole lines are a batch, answered BATCH_RUN lines at a time by
+ * whichever thread is free into that run's own buffer. once they're all
+ * done the runs go out in order, through a stdio buffer as big as a batch,
+ * so answers come out in the order asked and in a few big write()s. a batch
+ * is cut short when there's nothing more to read yet, and flushed, so
+ * whoever is waiting on an answer gets it. a blank or comment line comes
+ * back as it was, so line n out is line n in
+ */
+#define BATCH_BYTES   (1 << 20)
+#define BATCH_RUN     256
+#define BATCH_THREADS 64
+
+typedef struct {
+  char **q;
+  size_t nq,
+         maxq;
+  outbuf *run;
+  size_t nrun,
+         maxrun,
+         next;    /* run for the next thread free */
+} batch;
+
+static void * batch_thread(void *arg)
+{
+  batch *b = arg;
+  uint32_t *cand = cand_new();
+  size_t r;
+  while ((r = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->nrun) {
+    outbuf *o = b->run + r;
+    size_t i = r * BATCH_RUN,
+           end = i + BATCH_RUN < b->nq ? i + BATCH_RUN : b->nq;
+    o->len = 0;
+    for (; i < end; i++) {
+      if (b->q[i][0] && input_legit(b->q[i])) {
+        dict_answer(o, b->q[i], 1, cand);
+      } else {
+        out_str(o, b->q[i]);
+        out_put(o, "\n", 1);
+      }
     }
   }
+  free(cand);
+  return NULL;
+}
+
+static int batch_answer(batch *b, unsigned threads, FILE *out)
+{
+  pthread_t th[BATCH_THREADS];
+  int started[BATCH_THREADS];
+  size_t r;
+  unsigned i;
+  b->nrun = (b->nq + BATCH_RUN - 1) / BATCH_RUN;
+  if (b->nrun > b->maxrun) {
+    b->run = realloc(b->run, b->nrun * sizeof *b->run);
+    memset(b->run + b->maxrun, 0, (b->nrun - b->maxrun) * sizeof *b->run);
+    b->maxrun = b->nrun;
+  }
+  b->next = 0;
+  if (threads > b->nrun)
+    threads = (unsigned)b->nrun;
+  if (threads > BATCH_THREADS)
+    threads = BATCH_THREADS;
+  for (i = 1; i < threads; i++)
+    started[i] = !pthread_create(&th[i], NULL, batch_thread, b);
+  batch_thread(b);
+  for (i = 1; i < threads; i++)
+    if (started[i])
+      pthread_join(th[i], NULL);
+  for (r = 0; r < b->nrun; r++)
+    if (fwrite(b->run[r].p, 1, b->run[r].len, out) != b->run[r].len)
+      return 0;
+  return 1;
 }
 
+/*
+ * is there more to read from fd without waiting
+ */
+static int batch_more(int fd)
+{
+  struct pollfd p;
+  p.fd = fd;
+  p.events = POLLIN;
+  p.revents = 0;
+  return poll(&p, 1, 0) > 0;
+}
+
+/*
+ * answer every line read from fd to out, with up to 'threads' threads
+ */
+static int dict_batch(int fd, FILE *out, unsigned threads)
+{
+  batch b;
+  size_t alloc = BATCH_BYTES,
+         have = 0,
+         r;
+  char *buf = malloc(alloc + 1); /* room to end a last line with no '\n' */
+  int eof = 0,
+      ok = 1;
+  memset(&b, 0, sizeof b);
+  while (ok && !eof) {
+    size_t end,
+           start;
+    ssize_t rd = read(fd, buf + have, alloc - have);
+    if (rd < 0) {
+      if (EINTR == errno)
+        continue;
+      ok = 0;
+      break;
+    }
+    eof = !rd;
+    have += (size_t)rd;
+    if (!eof && have < alloc && batch_more(fd))
+      continue; /* a pipe gives a little at a time; make a batch of it */
+    for (end = have; end && '\n' != buf[end - 1]; end--)
+      ;
+    if (eof) {
+      end = have;
+    } else if (!end) {
+      if (have == alloc) { /* a line longer than the buffer */
+        alloc *= 2;
+        buf = realloc(buf, alloc + 1);
+      }
+      continue;
+    }
+    b.nq = 0;
+    for (start = 0; start < end; ) {
+      char *nl = memchr(buf + start, '\n', end - start);
+      size_t stop = nl ? (size_t)(nl - buf) : end;
+      if (b.nq == b.maxq) {
+        b.maxq = b.maxq ? b.maxq * 2 : 4096;
+        b.q = realloc(b.q, b.maxq * sizeof *b.q);
+      }
+      b.q[b.nq++] = buf + start;
+      buf[stop] = '\0';
+      start = stop + 1;
+    }
+    ok = batch_answer(&b, threads, out) && !fflush(out);
+    memmove(buf, buf + end, have - end);
+    have -= end;
+  }
+  for (r = 0; r < b.maxrun; r++)
+    free(b.run[r].p);
+  free(b.run);
+  free(b.q);
+  free(buf);
+  return ok;
+}
+
+#if !defined(DEBUG) && !defined(BENCH)
+/*
+ * with files to read, or stdin not a terminal, answer a batch at a time
+ * (see dict_batch()); otherwise ask
+ */
 int main(int argc, char *argv[])
 {
+  const char *dict = DICT_FILE;
   char line[256],
        *rd;
+  unsigned threads = 0;
+  int i,
+      nfiles = 0,
+      ok = 1;
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+      dict = argv[++i];
+    } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if ('-' == argv[i][0] && argv[i][1]) {
+      fprintf(stderr, "usage: %s [-d dict] [-j threads] [file|- ...]\n", argv[0]);
+      return EXIT_FAILURE;
+    } else {
+      argv[1 + nfiles++] = argv[i];
+    }
+  }
+  if (!threads)
+    threads = cpus();
+  key_init();
+  if (nfiles || !isatty(STDIN_FILENO)) {
+    setvbuf(stdout, NULL, _IOFBF, BATCH_BYTES);
+    dict_load(dict, 1);
+    if (!nfiles)
+      ok = dict_batch(STDIN_FILENO, stdout, threads);
+    for (i = 1; i <= nfiles; i++) {
+      int fd = strcmp(argv[i], "-") ? open(argv[i], O_RDONLY) : STDIN_FILENO;
+      if (fd < 0 || !dict_batch(fd, stdout, threads)) {
+        perror(argv[i]);
+        ok = 0;
+      }
+      if (fd > STDIN_FILENO)
+        close(fd);
+    }
+    if (fflush(stdout)) {
+      perror("stdout");
+      ok = 0;
+    }
+    dict_free();
+    return ok ? 0 : EXIT_FAILURE;
+  }
   printf("                  ___                                 \n");
   printf("                 |  ~~--.                             \n");
   printf("                 |%%=@%%%%/                              \n");
@@ -159,7 +1272,8 @@ int main(int argc, char *argv[])
   printf("      `\\_~~o%%%%%%o%%%%%%%%%%~~_/'                            \n");
   printf("         `--..____,,--'  CD                           \n");
   setvbuf(stdout, NULL, _IONBF, 0); /* unbuffer stdout */
-  dict_load(DICT_FILE);
+  dict_load(dict, 0);
+  printf("+LETTERS FOR EVERY WORD IN THEM, *LETTERS FOR PHRASES\n");
   do {
     printf("> ");
     if (NULL != (rd = fgets(line, sizeof line, stdin)))
@@ -168,6 +1282,730 @@ int main(int argc, char *argv[])
       else
         printf("...");
   } while (rd);
+  dict_free();
+  return 0;
+}
+#endif
+
+#ifdef DEBUG
+
+/*
+ * a small dictionary: anagram groups, a letterset shared across case
+ * ("Sean", "sane"), a word with no letters, one with a non-ASCII byte, a
+ * comment, and no '\n' at the end, so it's read rather than mapped
+ */
+static const char Fixture[] =
+  "a\nI\nact\ncat\ndog\ngod\nad\nbc\ncb\n"
+  "listen\nsilent\nenlist\ninlets\ntinsel\n"
+  "tea\neat\nate\nnet\nten\non\nno\nit\nAnn's\nSean\nsane\n"
+  "lane\nelan\nnails\nslain\nsnail\nstale\nleast\nslate\nsteal\ntales\n"
+  "to\nnote\ntone\nstone\nonset\ncaf\xC3\xA9\n#not a word\n'\n"
+  "staple\nplates\nlast\nsalt\nslat";
+
+static char * test_file(const char *text, size_t len)
+{
+  static char name[64];
+  int fd;
+  strcpy(name, "/tmp/word-descramble-XXXXXX");
+  fd = mkstemp(name);
+  assert(fd >= 0);
+  assert(write(fd, text, len) == (ssize_t)len);
+  close(fd);
+  return name;
+}
+
+/*
+ * letters a-z in w, case folded, the way a person would count them; -1 for
+ * what the dictionary leaves out of lettersets
+ */
+static int test_count(const char *w, int *cnt)
+{
+  int len = 0;
+  memset(cnt, 0, 26 * sizeof *cnt);
+  for (; !WORD_END(*w); w++) {
+    unsigned c = (unsigned char)*w | 0x20;
+    if ((unsigned char)*w & 0x80)
+      return -1;
+    if (c >= 'a' && c <= 'z')
+      cnt[c - 'a']++, len++;
+  }
+  return len ? len : -1;
+}
+
+static int test_word_cmp(const void *va, const void *vb)
+{
+  const char *a = *(const char * const *)va,
+             *b = *(const char * const *)vb;
+  for (; !WORD_END(*a) && *a == *b; a++, b++)
+    ;
+  return (WORD_END(*a) ? 0 : (unsigned char)*a) - (WORD_END(*b) ? 0 : (unsigned char)*b);
+}
+
+static const char *Fix[64];  /* Fixture's dictionary words */
+static size_t NFix;
+
+static void test_fixture(void)
+{
+  static char copy[sizeof Fixture];
+  char *p,
+       *path = test_file(Fixture, sizeof Fixture - 1);
+  memcpy(copy, Fixture, sizeof Fixture);
+  NFix = 0;
+  for (p = strtok(copy, "\n"); p; p = strtok(NULL, "\n"))
+    if (input_legit(p))
+      Fix[NFix++] = p;
+  dict_load(path, 1);
+  unlink(path);
+}
+
+/*
+ * the group's words, as a comma-separated string
+ */
+static const char * test_group(const char *q)
+{
+  static char s[256];
+  const anagrams *g = dict_find(q);
+  size_t len = 0;
+  uint32_t i;
+  s[0] = '\0';
+  for (i = 0; g && i < g->n; i++)
+    len += (size_t)sprintf(s + len, "%s%.*s", i ? "," : "",
+                           word_len(Text + Words[g->first + i]), Text + Words[g->first + i]);
+  return s;
+}
+
+static void test_exact(void)
+{
+  printf("test_exact... ");
+  assert(!strcmp(test_group("cat"), "act,cat"));
+  assert(!strcmp(test_group("tac"), "act,cat"));
+  assert(!strcmp(test_group("god"), "dog,god"));
+  assert(!strcmp(test_group("tinsel"), "listen,silent,enlist,inlets,tinsel"));
+  assert(!strcmp(test_group("Ann's"), "Ann's"));
+  assert(!strcmp(test_group("sane"), "sane")); /* "Sean" has an 'S' */
+  /* the old word_cmp() took any word of the same length for a match */
+  assert(!dict_find("xyz"));
+  assert(!dict_find("cag"));
+  assert(!dict_find("ca"));
+  assert(!dict_find("catt"));
+  assert(!dict_find("tinsle "));
+  /* "ad" and "bc" have the same signature (see main()); not the same letters */
+  assert(!strcmp(test_group("da"), "ad"));
+  assert(!strcmp(test_group("cb"), "bc,cb"));
+  assert(!dict_find("ab"));
+  printf("OK.\n");
+}
+
+/*
+ * a random query of letters the fixture has plenty of, and some it doesn't
+ */
+static void test_query(char *q)
+{
+  static const char Letters[] = "aeilnstcdogpAE'x";
+  int len = 1 + rand() % 12,
+      i;
+  for (i = 0; i < len; i++)
+    q[i] = Letters[rand() % (sizeof Letters - 1)];
+  q[len] = '\0';
+}
+
+/*
+ * "+" against every fixture word that fits
+ */
+static void test_sub(void)
+{
+  uint32_t *cand = cand_new();
+  const char *want[64],
+             *got[64];
+  int n;
+  printf("test_sub... ");
+  for (n = 0; n < 5000; n++) {
+    char q[16];
+    int have[26],
+        cnt[26];
+    size_t nwant = 0,
+           ngot = 0,
+           k,
+           m;
+    test_query(q);
+    if (test_count(q, have) < 0)
+      continue;
+    for (k = 0; k < NFix; k++) {
+      int j;
+      if (test_count(Fix[k], cnt) < 0)
+        continue;
+      for (j = 0; j < 26 && cnt[j] <= have[j]; j++)
+        ;
+      if (26 == j)
+        want[nwant++] = Fix[k];
+    }
+    m = dict_sub(q, cand);
+    for (k = 0; k < m; k++) {
+      const letterset *s = Sets + cand[k];
+      uint32_t g,
+               i;
+      assert(!k || Sets[cand[k - 1]].len >= s->len);
+      for (g = s->first; g < s->first + s->n; g++)
+        for (i = 0; i < Table[SetGroups[g]].n; i++)
+          got[ngot++] = Text + Words[Table[SetGroups[g]].first + i];
+    }
+    assert(nwant == ngot);
+    qsort(want, nwant, sizeof *want, test_word_cmp);
+    qsort(got, ngot, sizeof *got, test_word_cmp);
+    for (k = 0; k < nwant; k++)
+      assert(!test_word_cmp(want + k, got + k));
+  }
+  free(cand);
+  printf("OK.\n");
+}
+
+typedef struct {
+  int have[26];
+  uint32_t pick[1024][PHRASE_WORDS];
+  unsigned npick[1024],
+           n;
+} test_phrase;
+
+static int test_phrase_got(const uint32_t *sets, unsigned n, void *arg)
+{
+  test_phrase *t = arg;
+  int sum[26] = { 0 };
+  unsigned i,
+           j;
+  assert(n >= 1 && n <= PHRASE_WORDS);
+  for (i = 0; i < n; i++) {
+    assert(!i || sets[i - 1] <= sets[i]); /* in set order, so each comes up once */
+    for (j = 0; j < 26; j++)
+      sum[j] += Sets[sets[i]].cnt[j];
+  }
+  assert(!memcmp(sum, t->have, sizeof sum));
+  for (i = 0; i < t->n; i++)
+    assert(t->npick[i] != n || memcmp(t->pick[i], sets, n * sizeof *sets));
+  assert(t->n < 1024);
+  memcpy(t->pick[t->n], sets, n * sizeof *sets);
+  t->npick[t->n++] = n;
+  return 0;
+}
+
+/*
+ * "*" against every combination of up to PHRASE_WORDS of the fixture's
+ * letter counts that adds up to the query's
+ */
+static void test_phrases(void)
+{
+  static const char * const Named[] = { "listen", "tinselcat", "Ann's tea", "stoneate", "saltslat", "aaa" };
+  int set[64][26];
+  size_t nset = 0,
+         k;
+  uint32_t *cand = cand_new();
+  int n;
+  printf("test_phrases... ");
+  for (k = 0; k < NFix; k++) {
+    size_t j;
+    if (test_count(Fix[k], set[nset]) < 0)
+      continue;
+    for (j = 0; j < nset && memcmp(set[j], set[nset], sizeof set[j]); j++)
+      ;
+    nset += j == nset;
+  }
+  assert(nset == NSets);
+  for (n = 0; n < 3000; n++) {
+    char q[16];
+    test_phrase t;
+    size_t i,
+           j,
+           l,
+           want = 0;
+    if (n < (int)(sizeof Named / sizeof Named[0]))
+      strcpy(q, Named[n]);
+    else
+      test_query(q);
+    if (test_count(q, t.have) < 0)
+      continue;
+    for (i = 0; i < nset; i++)
+      for (j = i; j <= nset; j++)
+        for (l = j == nset ? nset : j; l <= nset; l++) {
+          int m;
+          for (m = 0; m < 26; m++)
+            if (set[i][m] + (j < nset ? set[j][m] : 0) + (l < nset ? set[l][m] : 0) != t.have[m])
+              break;
+          want += 26 == m;
+        }
+    t.n = 0;
+    dict_phrases(q, PHRASE_WORDS, cand, test_phrase_got, &t);
+    assert(want == t.n);
+  }
+  free(cand);
+  printf("OK.\n");
+}
+
+/*
+ * dict_batch()'s answers, in order, blank and comment lines as they were,
+ * are what dict_answer() says one line at a time
+ */
+static void test_batch(void)
+{
+  outbuf in = { NULL, 0, 0 },
+         want = { NULL, 0, 0 };
+  uint32_t *cand = cand_new();
+  FILE *out = tmpfile();
+  char *got,
+       *path;
+  long len;
+  int fd,
+      i;
+  printf("test_batch... ");
+  for (i = 0; i < 3000; i++) {
+    char q[16];
+    switch (rand() % 8) {
+    case 0:  strcpy(q, ""); break;
+    case 1:  strcpy(q, "# comment"); break;
+    case 2:  strcpy(q, ";"); break;
+    case 3:  q[0] = '+'; test_query(q + 1); break;
+    case 4:  q[0] = '*'; test_query(q + 1); break;
+    default: test_query(q); break;
+    }
+    out_str(&in, q);
+    out_put(&in, "\n", 1);
+    if (q[0] && input_legit(q)) {
+      dict_answer(&want, q, 1, cand);
+    } else {
+      out_str(&want, q);
+      out_put(&want, "\n", 1);
+    }
+  }
+  out_str(&in, "tinsel"); /* no '\n' */
+  out_str(&want, "tinsel\tlisten\tsilent\tenlist\tinlets\ttinsel\n");
+  path = test_file(in.p, in.len);
+  fd = open(path, O_RDONLY);
+  unlink(path);
+  assert(fd >= 0 && out);
+  assert(dict_batch(fd, out, 4));
+  close(fd);
+  len = ftell(out);
+  assert(len == (long)want.len);
+  rewind(out);
+  got = malloc(want.len);
+  assert(fread(got, 1, want.len, out) == want.len);
+  assert(!memcmp(got, want.p, want.len));
+  fclose(out);
+  free(got);
+  free(in.p);
+  free(want.p);
+  free(cand);
+  printf("OK.\n");
+}
+
+/*
+ * however many threads find the lines, the index comes out the same
+ */
+static void test_threads(void)
+{
+  const size_t n = 500000;
+  outbuf txt = { NULL, 0, 0 };
+  uint32_t *words;
+  anagrams *table;
+  size_t i,
+         tablesize;
+  long len;
+  char *path;
+  printf("test_threads... ");
+  for (i = 0; i < n; i++) {
+    char w[16];
+    test_query(w);
+    out_str(&txt, w);
+    out_put(&txt, "\n", 1);
+  }
+  path = test_file(txt.p, txt.len);
+  assert(txt.len > 3 * LOAD_CHUNK);
+  assert(dict_read(path, 1));
+  len = DictLen;
+  words = malloc(len * sizeof *words);
+  memcpy(words, Words, len * sizeof *words);
+  tablesize = TableSize;
+  table = malloc(tablesize * sizeof *table);
+  memcpy(table, Table, tablesize * sizeof *table);
+  dict_free();
+  assert(dict_read(path, 4));
+  assert(TextMapped);
+  assert(len == DictLen && tablesize == TableSize);
+  assert(!memcmp(words, Words, len * sizeof *words));
+  assert(!memcmp(table, Table, tablesize * sizeof *table));
+  dict_free();
+  unlink(path);
+  free(words);
+  free(table);
+  free(txt.p);
+  printf("OK.\n");
+}
+
+int main(void)
+{
+  char line[] = "tinsel\n";
+  key_init();
+  Key['d'] = Key['b'] + Key['c'] - Key['a']; /* so "ad" and "bc" collide */
+  test_fixture();
+  dict_check(line);
+  test_exact();
+  test_sub();
+  test_phrases();
+  test_batch();
+  dict_free();
+  test_threads();
+  return 0;
+}
+#endif
+
+#ifdef BENCH
+/*
+ * the old way, for comparison: a 128-entry letter count per word, qsort()ed,
+ * and bsearch()ed with the query's counts
+ */
+typedef struct {
+  int len, /* total amount of letters */
+      letcnt[128];
+  char orig[64];
+} word;
+
+static word *Old;
+
+static void word_compile(word *w, const char *txt)
+{
+  int len = word_len(txt);
+  w->len = 0;
+  memset(w->letcnt, 0, sizeof w->letcnt);
+  if (len > (int)sizeof w->orig - 1)
+    len = (int)sizeof w->orig - 1;
+  memcpy(w->orig, txt, (size_t)len);
+  w->orig[len] = '\0';
+  while (!WORD_END(*txt)) {
+    w->letcnt[*txt & 127]++;
+    w->len++;
+    txt++;
+  }
+}
+
+static int word_cmp(const void *va, const void *vb)
+{
+  const word *a = va,
+             *b = vb;
+  int c = a->len - b->len;
+  if (!c)
+    c = memcmp(a->letcnt, b->letcnt, sizeof a->letcnt);
+  return c;
+}
+
+static char **Query;
+static long NQuery;
+
+static size_t dict_bytes(void)
+{
+  return TextLen + DictLen * sizeof *Words + TableSize * sizeof *Table;
+}
+
+static void trial_old_build(void *arg)
+{
+  long i;
+  (void)arg;
+  Old = realloc(Old, DictLen * sizeof *Old);
+  for (i = 0; i < DictLen; i++)
+    word_compile(Old + i, Text + Words[i]);
+  qsort(Old, DictLen, sizeof *Old, word_cmp);
+}
+
+static void trial_old_find(void *arg)
+{
+  word w;
+  long i,
+       hits = 0;
+  (void)arg;
+  for (i = 0; i < NQuery; i++) {
+    word_compile(&w, Query[i]);
+    hits += !!bsearch(&w, Old, DictLen, sizeof *Old, word_cmp);
+  }
+  BENCH_USE(hits);
+}
+
+static void trial_build(void *arg)
+{
+  (void)arg;
+  dict_index(NULL);
+}
+
+/*
+ * loading, as it was: fgets() into records, realloc()ed as they come
+ */
+static const char *Path;
+
+static void trial_old_load(void *arg)
+{
+  char line[256];
+  word *d = NULL;
+  long alloc = 0,
+       n = 0;
+  FILE *f = fopen(Path, "r");
+  (void)arg;
+  assert(f);
+  while (fgets(line, sizeof line, f)) {
+    if (!input_legit(line))
+      continue;
+    if (n == alloc) {
+      alloc = alloc ? alloc * 2 : 64;
+      d = realloc(d, alloc * sizeof *d);
+    }
+    input_trim(line);
+    word_compile(d + n++, line);
+  }
+  fclose(f);
+  qsort(d, n, sizeof *d, word_cmp);
+  free(d);
+}
+
+static void trial_load(void *arg)
+{
+  dict_free();
+  if (!dict_read(Path, *(unsigned *)arg)) {
+    perror(Path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void trial_find(void *arg)
+{
+  long i,
+       hits = 0;
+  (void)arg;
+  for (i = 0; i < NQuery; i++)
+    hits += !!dict_find(Query[i]);
+  BENCH_USE(hits);
+}
+
+/*
+ * letters to make words and phrases from: scrambled 7-10 letter words, and
+ * two words run together, up to 12 letters
+ */
+#define NSUB 2000
+
+static char *Sub[NSUB],
+            *Phr[NSUB];
+
+static size_t count_sets(size_t (*fit)(const uint8_t *, uint32_t, const uint32_t *, size_t, uint32_t *),
+                         const char *txt, uint32_t *out)
+{
+  uint8_t have[LETTERS];
+  uint32_t mask,
+           len;
+  return letters_count(txt, have, &mask, &len) ? fit(have, mask, NULL, NSets, out) : 0;
+}
+
+static void trial_sub(void *arg)
+{
+  size_t (*fit)(const uint8_t *, uint32_t, const uint32_t *, size_t, uint32_t *) = *(size_t (**)(const uint8_t *, uint32_t, const uint32_t *, size_t, uint32_t *))arg;
+  uint32_t *out = malloc((NSets + 1) * sizeof *out);
+  size_t i,
+         n = 0;
+  for (i = 0; i < NSUB; i++)
+    n += count_sets(fit, Sub[i], out);
+  free(out);
+  BENCH_USE(n);
+}
+
+static int count_phrase(const uint32_t *sets, unsigned n, void *arg)
+{
+  (void)sets, (void)n;
+  ++*(size_t *)arg;
   return 0;
 }
 
+static void trial_phrases(void *arg)
+{
+  uint32_t *cand = cand_new();
+  size_t i,
+         n = 0;
+  for (i = 0; i < NSUB; i++)
+    dict_phrases(Phr[i], PHRASE_WORDS, cand, count_phrase, &n);
+  free(cand);
+  if (arg)
+    *(size_t *)arg = n;
+  BENCH_USE(n);
+}
+
+/*
+ * a file of every query, and some '+' ones, to answer into /dev/null: as it
+ * was, a line at a time with a write() for each line out; and in batches
+ */
+static FILE *In,
+            *Null,     /* unbuffered, like stdout was */
+            *NullBuf;
+static size_t NLine;
+
+static void trial_lines(void *arg)
+{
+  char line[256];
+  uint32_t *cand = cand_new();
+  outbuf o = { NULL, 0, 0 };
+  (void)arg;
+  rewind(In);
+  while (fgets(line, sizeof line, In)) {
+    size_t i,
+           start = 0;
+    fwrite("> ", 1, 2, Null);
+    input_trim(line);
+    o.len = 0;
+    dict_answer(&o, line, 0, cand);
+    for (i = 0; i < o.len; i++)
+      if ('\n' == o.p[i]) {
+        fwrite(o.p + start, 1, i + 1 - start, Null);
+        start = i + 1;
+      }
+  }
+  free(o.p);
+  free(cand);
+}
+
+static void trial_batch(void *arg)
+{
+  lseek(fileno(In), 0, SEEK_SET);
+  dict_batch(fileno(In), NullBuf, *(unsigned *)arg);
+}
+
+static void batch_queries(void)
+{
+  long i;
+  In = tmpfile();
+  Null = fopen("/dev/null", "w");
+  NullBuf = fopen("/dev/null", "w");
+  assert(In && Null && NullBuf);
+  setvbuf(Null, NULL, _IONBF, 0);
+  setvbuf(NullBuf, NULL, _IOFBF, BATCH_BYTES);
+  for (i = 0; i < NQuery; i++, NLine++)
+    fprintf(In, "%s\n", Query[i]);
+  for (i = 0; i < NSUB; i++, NLine++)
+    fprintf(In, "+%s\n", Sub[i]);
+  fflush(In);
+}
+
+static void sub_queries(void)
+{
+  size_t i = 0,
+         k = 0;
+  while (i < NSUB) {
+    const char *w = Query[2 * (k++ % DictLen)];
+    size_t len = strlen(w);
+    if (len >= 7 && len <= 10)
+      Sub[i++] = (char *)w;
+  }
+  for (i = 0; i < NSUB; ) {
+    const char *a = Text + Words[rand() % DictLen],
+               *b = Text + Words[rand() % DictLen];
+    size_t la = (size_t)word_len(a),
+           lb = (size_t)word_len(b);
+    if (la + lb > 12)
+      continue;
+    Phr[i] = malloc(la + lb + 1);
+    memcpy(Phr[i], a, la);
+    memcpy(Phr[i] + la, b, lb);
+    Phr[i][la + lb] = '\0';
+    i++;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  static size_t (*fit[])(const uint8_t *, uint32_t, const uint32_t *, size_t, uint32_t *) = {
+    sets_fit_obvious,
+#ifdef CAN_SIMD
+    sets_fit_sse2,
+    sets_fit_avx2,
+#endif
+  };
+  static const char * const FitName[] = { "obvious", "sse2", "avx2" };
+  uint32_t *out[2];
+  long i;
+  size_t f;
+  unsigned one = 1,
+           all = cpus();
+  key_init();
+  Path = argc > 1 ? argv[1] : DICT_FILE;
+  dict_load(Path, 0);
+  bench_init(1, 7);
+  bench_note("%lu bytes of dictionary, %u cpus\n", (unsigned long)TextLen, all);
+  bench_section("load", "words/s");
+  bench_run("fgets+records+qsort", trial_old_load, NULL, (double)DictLen);
+  bench_run("mmap, 1 thread", trial_load, &one, (double)DictLen);
+  if (all > 1)
+    bench_run("mmap, all cpus", trial_load, &all, (double)DictLen);
+  sets_index();
+  /* every word, scrambled, and as many made-up ones */
+  srand(1);
+  NQuery = 2 * DictLen;
+  Query = malloc(NQuery * sizeof *Query);
+  for (i = 0; i < DictLen; i++) {
+    const char *w = Text + Words[(i * 7919) % DictLen];
+    size_t len = (size_t)word_len(w),
+           j;
+    Query[2*i] = malloc(len + 1);
+    Query[2*i+1] = malloc(len + 1);
+    memcpy(Query[2*i], w, len);
+    Query[2*i][len] = '\0';
+    for (j = len; j > 1; j--) {
+      size_t k = (size_t)rand() % j;
+      char c = Query[2*i][j-1];
+      Query[2*i][j-1] = Query[2*i][k];
+      Query[2*i][k] = c;
+    }
+    for (j = 0; j < len; j++)
+      Query[2*i+1][j] = (char)('a' + rand() % 26);
+    Query[2*i+1][len] = '\0';
+  }
+  trial_old_build(NULL);
+  bench_note("%ld words, %lu groups; records %lu bytes, signatures %lu bytes (%.1fx smaller)\n",
+    DictLen, (unsigned long)Groups, (unsigned long)(DictLen * sizeof *Old),
+    (unsigned long)dict_bytes(), (double)(DictLen * sizeof *Old) / dict_bytes());
+  bench_section("index", "words/s");
+  bench_run("qsort records", trial_old_build, NULL, (double)DictLen);
+  bench_run("hash signatures", trial_build, NULL, (double)DictLen);
+  bench_section("lookup", "queries/s");
+  bench_run("bsearch records", trial_old_find, NULL, (double)NQuery);
+  bench_run("hash signatures", trial_find, NULL, (double)NQuery);
+  sub_queries();
+  /* they all find the same ones */
+  out[0] = malloc((NSets + 1) * sizeof *out[0]);
+  out[1] = malloc((NSets + 1) * sizeof *out[1]);
+  for (i = 0; i < NSUB; i++) {
+    size_t n = count_sets(sets_fit_obvious, Sub[i], out[0]);
+    for (f = 1; f < sizeof fit / sizeof fit[0]; f++)
+      assert(n == count_sets(fit[f], Sub[i], out[1]) && !memcmp(out[0], out[1], n * sizeof *out[0]));
+  }
+  free(out[0]);
+  free(out[1]);
+  bench_note("%lu lettersets\n", (unsigned long)NSets);
+  bench_section("words from 7-10 letters", "queries/s");
+  for (f = 0; f < sizeof fit / sizeof fit[0]; f++)
+    if (f < 2 || __builtin_cpu_supports("avx2"))
+      bench_run(FitName[f], trial_sub, &fit[f], NSUB);
+  trial_phrases(&f);
+  bench_note("%lu phrases a query\n", (unsigned long)(f / NSUB));
+  bench_section("phrases of up to 3 words from <= 12 letters", "queries/s");
+  bench_run("dict_phrases", trial_phrases, NULL, NSUB);
+  batch_queries();
+  bench_section("answered to /dev/null", "queries/s");
+  bench_run("a line at a time, unbuffered", trial_lines, NULL, (double)NLine);
+  bench_run("batches, 1 thread", trial_batch, &one, (double)NLine);
+  if (all > 1)
+    bench_run("batches, all cpus", trial_batch, &all, (double)NLine);
+  fclose(In);
+  fclose(Null);
+  fclose(NullBuf);
+  for (i = 0; i < NSUB; i++)
+    free(Phr[i]);
+  for (i = 0; i < NQuery; i++)
+    free(Query[i]);
+  free(Query);
+  free(Old);
+  dict_free();
+  (void)dict_dump;
+  (void)dict_check;
+  return 0;
+}
+#endif